@@ -0,0 +1,146 @@
+/** @file
+ * Implementacja wektorowego sprawdzania i konwersji numerów telefonów.
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#include <string.h>
+
+#include "digits.h"
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define DIGITS_SSE2 ///< Czy numery są przeglądane rozkazami SSE2.
+#endif
+
+#define STAR_CODE 10        ///< Kod znaku '*'.
+#define HASH_CODE 11        ///< Kod znaku '#'.
+#define BLOCK_SIZE 16       ///< Ilość znaków przetwarzanych jednocześnie.
+#define SCAN_PAGE_SIZE 4096 ///< Najmniejszy możliwy rozmiar strony pamięci.
+
+/*! \def NO_SANITIZE_ADDRESS
+ * Wyłącza kontrolę dostępu do pamięci przez AddressSanitizer dla funkcji,
+ * która celowo czyta cały blok znaków, także za końcem napisu.
+ */
+#if defined(__GNUC__)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+#define NO_SANITIZE_ADDRESS
+#endif
+
+/**
+ * @brief Wyznacza kod cyfry reprezentowanej przez znak.
+ * @param[in] c - znak.
+ * @return Kod cyfry lub -1, jeśli znak nie reprezentuje cyfry.
+ */
+static int digit_code(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c == '*')
+        return STAR_CODE;
+    if (c == '#')
+        return HASH_CODE;
+    return -1;
+}
+
+#ifdef DIGITS_SSE2
+
+/**
+ * @brief Przetwarza blok 16 znaków napisu.
+ * Zamienia cyfry bloku na kody i wyznacza maskę pozycji zajętych przez cyfry.
+ * @param[in] block - wskaźnik na pierwszy znak bloku;
+ * @param[out] codes - kody znaków bloku; dla znaków niebędących cyframi
+ *                     wartości są nieokreślone.
+ * @return Maska bitowa, której i-ty bit jest ustawiony, gdy i-ty znak bloku
+ * jest cyfrą.
+ */
+NO_SANITIZE_ADDRESS
+static unsigned scan_block(const char* block, __m128i* codes) {
+    __m128i chars = _mm_loadu_si128((const __m128i*)block);
+    __m128i values = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    // Różnica jest bez znaku, więc znaki mniejsze od '0' dają duże wartości.
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(values, _mm_set1_epi8(9)), values);
+    __m128i is_star = _mm_cmpeq_epi8(chars, _mm_set1_epi8('*'));
+    __m128i is_hash = _mm_cmpeq_epi8(chars, _mm_set1_epi8('#'));
+
+    *codes = _mm_or_si128(_mm_and_si128(values, is_digit),
+                          _mm_or_si128(_mm_and_si128(is_star, _mm_set1_epi8(STAR_CODE)),
+                                       _mm_and_si128(is_hash, _mm_set1_epi8(HASH_CODE))));
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(is_digit,
+                                                    _mm_or_si128(is_star, is_hash)));
+}
+
+/** @brief Wyznacza długość numeru i kody jego cyfr.
+ * W jednym przebiegu przegląda napis @p str aż do pierwszego znaku, który nie
+ * jest cyfrą, i zamienia cyfry '0'–'9', '*' i '#' na kody od 0 do 11. Jeśli
+ * procesor udostępnia rozkazy SSE2, przetwarza po 16 znaków naraz. Napis jest
+ * numerem, jeśli wynik jest dodatni, a znak @p str[wynik] jest znakiem końca
+ * napisu.
+ * @param[in] str    – wskaźnik na napis zakończony znakiem, który nie jest
+ *                     cyfrą, np. znakiem końca napisu;
+ * @param[out] codes – wskaźnik na tablicę na kody cyfr lub NULL, jeśli
+ *                     @p cap ma wartość 0;
+ * @param[in] cap    – rozmiar tablicy @p codes. Zapisywane są kody co najwyżej
+ *                     @p cap pierwszych cyfr, a pozostałe pozycje tablicy mogą
+ *                     zostać nadpisane.
+ * @return Długość najdłuższego prefiksu napisu złożonego z cyfr.
+ */
+size_t digits_scan(const char *str, uint8_t *codes, size_t cap) {
+    size_t i = 0;
+    for (;;) {
+        // Blok czytany za końcem napisu nie może wyjść poza stronę, na której
+        // napis się kończy, bo następna strona może nie być dostępna.
+        if (((uintptr_t)(str + i) & (SCAN_PAGE_SIZE - 1)) > SCAN_PAGE_SIZE - BLOCK_SIZE) {
+            int code = digit_code(str[i]);
+            if (code < 0)
+                return i;
+            if (i < cap)
+                codes[i] = (uint8_t)code;
+            i++;
+            continue;
+        }
+
+        __m128i block;
+        unsigned digits = scan_block(str + i, &block);
+        if (i + BLOCK_SIZE <= cap) {
+            _mm_storeu_si128((__m128i*)(codes + i), block);
+        }
+        else if (i < cap) {
+            uint8_t tail[BLOCK_SIZE];
+            _mm_storeu_si128((__m128i*)tail, block);
+            memcpy(codes + i, tail, cap - i);
+        }
+        if (digits != (1u << BLOCK_SIZE) - 1)
+            return i + (size_t)__builtin_ctz(~digits);
+        i += BLOCK_SIZE;
+    }
+}
+
+#else
+
+/** @brief Wyznacza długość numeru i kody jego cyfr.
+ * W jednym przebiegu przegląda napis @p str aż do pierwszego znaku, który nie
+ * jest cyfrą, i zamienia cyfry '0'–'9', '*' i '#' na kody od 0 do 11. Jeśli
+ * procesor udostępnia rozkazy SSE2, przetwarza po 16 znaków naraz. Napis jest
+ * numerem, jeśli wynik jest dodatni, a znak @p str[wynik] jest znakiem końca
+ * napisu.
+ * @param[in] str    – wskaźnik na napis zakończony znakiem, który nie jest
+ *                     cyfrą, np. znakiem końca napisu;
+ * @param[out] codes – wskaźnik na tablicę na kody cyfr lub NULL, jeśli
+ *                     @p cap ma wartość 0;
+ * @param[in] cap    – rozmiar tablicy @p codes. Zapisywane są kody co najwyżej
+ *                     @p cap pierwszych cyfr, a pozostałe pozycje tablicy mogą
+ *                     zostać nadpisane.
+ * @return Długość najdłuższego prefiksu napisu złożonego z cyfr.
+ */
+size_t digits_scan(const char *str, uint8_t *codes, size_t cap) {
+    size_t i = 0;
+    for (int code; (code = digit_code(str[i])) >= 0; i++)
+        if (i < cap)
+            codes[i] = (uint8_t)code;
+    return i;
+}
+
+#endif
@@ -0,0 +1,32 @@
+/** @file
+ * Interfejs wektorowego sprawdzania i konwersji numerów telefonów.
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef __DIGITS_H__
+#define __DIGITS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Wyznacza długość numeru i kody jego cyfr.
+ * W jednym przebiegu przegląda napis @p str aż do pierwszego znaku, który nie
+ * jest cyfrą, i zamienia cyfry '0'–'9', '*' i '#' na kody od 0 do 11. Jeśli
+ * procesor udostępnia rozkazy SSE2, przetwarza po 16 znaków naraz. Napis jest
+ * numerem, jeśli wynik jest dodatni, a znak @p str[wynik] jest znakiem końca
+ * napisu.
+ * @param[in] str    – wskaźnik na napis zakończony znakiem, który nie jest
+ *                     cyfrą, np. znakiem końca napisu;
+ * @param[out] codes – wskaźnik na tablicę na kody cyfr lub NULL, jeśli
+ *                     @p cap ma wartość 0;
+ * @param[in] cap    – rozmiar tablicy @p codes. Zapisywane są kody co najwyżej
+ *                     @p cap pierwszych cyfr, a pozostałe pozycje tablicy mogą
+ *                     zostać nadpisane.
+ * @return Długość najdłuższego prefiksu napisu złożonego z cyfr.
+ */
+size_t digits_scan(const char *str, uint8_t *codes, size_t cap);
+
+#endif /* __DIGITS_H__ */
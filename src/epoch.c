@@ -0,0 +1,60 @@
+/** @file
+ * Implementacja mechanizmu epok chroniącego dane czytane bez blokad.
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+#define _POSIX_C_SOURCE 200809L ///< Udostępnienie funkcji sched_yield.
+
+#include <sched.h>
+
+#include "epoch.h"
+
+/** @brief Inicjalizuje mechanizm epok.
+ * @param[out] epoch – wskaźnik na inicjalizowaną strukturę.
+ */
+void epoch_init(Epoch *epoch) {
+    atomic_init(&epoch->current, 0);
+    atomic_init(&epoch->readers[0], 0);
+    atomic_init(&epoch->readers[1], 0);
+}
+
+/** @brief Rozpoczyna sekcję czytelnika.
+ * Po powrocie z funkcji czytelnik może odczytać chroniony wskaźnik i
+ * korzystać ze wskazywanych danych aż do wywołania @ref epoch_leave.
+ * Nie blokuje.
+ * @param[in,out] epoch – wskaźnik na strukturę epok.
+ * @return Numer licznika, który należy przekazać do @ref epoch_leave.
+ */
+unsigned epoch_enter(Epoch *epoch) {
+    for (;;) {
+        unsigned current = atomic_load(&epoch->current);
+        unsigned slot = current & 1u;
+        atomic_fetch_add(&epoch->readers[slot], 1);
+        // Zgłoszenie jest ważne tylko wtedy, gdy epoka nie zmieniła się w międzyczasie.
+        if (atomic_load(&epoch->current) == current)
+            return slot;
+        atomic_fetch_sub(&epoch->readers[slot], 1);
+    }
+}
+
+/** @brief Kończy sekcję czytelnika.
+ * @param[in,out] epoch – wskaźnik na strukturę epok;
+ * @param[in] slot      – wartość zwrócona przez @ref epoch_enter.
+ */
+void epoch_leave(Epoch *epoch, unsigned slot) {
+    atomic_fetch_sub(&epoch->readers[slot], 1);
+}
+
+/** @brief Czeka na zakończenie sekcji czytelników rozpoczętych wcześniej.
+ * Po powrocie z funkcji żaden czytelnik nie korzysta z wskaźnika
+ * zastąpionego przed jej wywołaniem. Wywołania tej funkcji nie mogą się
+ * przeplatać, więc piszący muszą być wzajemnie wykluczeni.
+ * @param[in,out] epoch – wskaźnik na strukturę epok.
+ */
+void epoch_synchronize(Epoch *epoch) {
+    unsigned previous = atomic_fetch_add(&epoch->current, 1) & 1u;
+    while (atomic_load(&epoch->readers[previous]) != 0)
+        sched_yield();
+}
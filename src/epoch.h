@@ -0,0 +1,62 @@
+/** @file
+ * Interfejs mechanizmu epok chroniącego dane czytane bez blokad.
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/**
+ * To jest struktura przechowująca stan mechanizmu epok.
+ * Czytelnik przed odczytem wskaźnika na współdzielone dane zgłasza się w
+ * liczniku odpowiadającym parzystości bieżącej epoki, a po zakończeniu
+ * odczytu wycofuje zgłoszenie. Piszący, po opublikowaniu nowego wskaźnika,
+ * przełącza epokę i czeka, aż wyzeruje się licznik poprzedniej epoki. Od tej
+ * chwili żaden czytelnik nie może posiadać starego wskaźnika, więc wskazywane
+ * przez niego dane można zwolnić. Czytelnicy nigdy nie czekają na piszących.
+ */
+struct Epoch {
+    atomic_uint current;            ///< Numer bieżącej epoki.
+    atomic_size_t readers[2];       ///< Ilości czytelników epok parzystych i nieparzystych.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct Epoch Epoch;
+
+/** @brief Inicjalizuje mechanizm epok.
+ * @param[out] epoch – wskaźnik na inicjalizowaną strukturę.
+ */
+void epoch_init(Epoch *epoch);
+
+/** @brief Rozpoczyna sekcję czytelnika.
+ * Po powrocie z funkcji czytelnik może odczytać chroniony wskaźnik i
+ * korzystać ze wskazywanych danych aż do wywołania @ref epoch_leave.
+ * Nie blokuje.
+ * @param[in,out] epoch – wskaźnik na strukturę epok.
+ * @return Numer licznika, który należy przekazać do @ref epoch_leave.
+ */
+unsigned epoch_enter(Epoch *epoch);
+
+/** @brief Kończy sekcję czytelnika.
+ * @param[in,out] epoch – wskaźnik na strukturę epok;
+ * @param[in] slot      – wartość zwrócona przez @ref epoch_enter.
+ */
+void epoch_leave(Epoch *epoch, unsigned slot);
+
+/** @brief Czeka na zakończenie sekcji czytelników rozpoczętych wcześniej.
+ * Po powrocie z funkcji żaden czytelnik nie korzysta z wskaźnika
+ * zastąpionego przed jej wywołaniem. Wywołania tej funkcji nie mogą się
+ * przeplatać, więc piszący muszą być wzajemnie wykluczeni.
+ * @param[in,out] epoch – wskaźnik na strukturę epok.
+ */
+void epoch_synchronize(Epoch *epoch);
+
+#endif /* __EPOCH_H__ */
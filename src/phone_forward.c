@@ -6,26 +6,173 @@
  * @copyright Uniwersytet Warszawski
  * @date 2022
  */
+#define _POSIX_C_SOURCE 200809L ///< Udostępnienie funkcji POSIX: mmap, fsync.
+
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "digits.h"
+#include "epoch.h"
+#include "phone_forward.h"
+#include "pool.h"
 
 #define HOW_MANY_NUMBERS 12 ///< Ilość cyfr wraz z dodatkowymi znakami.
 #define STAR_VALUE 10       ///< Wartość znaku *.
 #define HASH_VALUE 11       ///< Wartość znaku #.
+#define FWD_INLINE_LABEL 16 ///< Najdłuższa etykieta przechowywana w węźle drzewa.
+#define NUMBER_CODES 64    ///< Ilość cyfr numeru, których kody są wyznaczane z góry.
+#define INLINE_CHILDREN 2   ///< Ilość dzieci przechowywanych bezpośrednio w węźle.
+#define BATCH_LANES 16      ///< Ilość numerów przetwarzanych jednocześnie przez phfwdGetBatch.
+#define STEAL_CHUNK 32      ///< Ilość zapytań pobieranych naraz przez wątek phfwdGetReverseBatch.
+#define DELETE_BATCH 64     ///< Ilość przekierowań wyrejestrowywanych jednocześnie przy usuwaniu.
+#define PENDING_KEEP 256    ///< Największy pusty bufor zmian zachowywany w trybie współbieżnym.
+#define BULK_GROUPS (HOW_MANY_NUMBERS + 1) ///< Ilość grup przy podziale przekierowań według cyfry.
+#define FROZEN_NONE UINT32_MAX ///< Brak przekierowania w węźle zamrożonego drzewa.
+#define FROZEN_VERSION 1    ///< Wersja układu zamrożonych drzew.
+#define FROZEN_BYTE_ORDER 0x01020304u ///< Znacznik kolejności bajtów w pliku.
+
+/*! \def PREFETCH
+    \brief Makro sprowadzające z wyprzedzeniem do pamięci podręcznej podany adres.
+*/
+#if defined(__GNUC__)
+#define PREFETCH(ptr) __builtin_prefetch(ptr)
+#else
+#define PREFETCH(ptr) ((void)(ptr))
+#endif
+
+/*! \def POPCOUNT
+    \brief Makro zliczające zapalone bity liczby.
+*/
+/*! \def LOWEST_BIT
+    \brief Makro wyznaczające numer najmłodszego zapalonego bitu niezerowej liczby.
+*/
+/*! \def LOWEST_BIT64
+    \brief Makro wyznaczające numer najmłodszego zapalonego bitu niezerowej
+    liczby 64-bitowej.
+*/
+#if defined(__GNUC__)
+#define POPCOUNT(x) __builtin_popcount(x)
+#define LOWEST_BIT(x) __builtin_ctz(x)
+#define LOWEST_BIT64(x) __builtin_ctzll(x)
+#else
+#define POPCOUNT(x) popcount_fallback(x)
+#define LOWEST_BIT(x) lowest_bit_fallback(x)
+#define LOWEST_BIT64(x) lowest_bit_fallback(x)
+
+/**
+ * @brief Zlicza zapalone bity liczby.
+ * @param[in] x - liczba.
+ * @return Ilość zapalonych bitów.
+ */
+static int popcount_fallback(unsigned x) {
+    int count = 0;
+    for (; x != 0; x &= x - 1)
+        count++;
+    return count;
+}
+
+/**
+ * @brief Wyznacza numer najmłodszego zapalonego bitu niezerowej liczby.
+ * @param[in] x - liczba.
+ * @return Numer bitu.
+ */
+static int lowest_bit_fallback(uint64_t x) {
+    int bit = 0;
+    while (!(x & 1u)) {
+        x >>= 1;
+        bit++;
+    }
+    return bit;
+}
+#endif
+
+/*! \def FROM_LITTLE_ENDIAN
+    \brief Makro zamieniające liczbę 64-bitową odczytaną z pamięci w kolejności
+    little-endian na wartość.
+*/
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define FROM_LITTLE_ENDIAN(x) __builtin_bswap64(x)
+#else
+#define FROM_LITTLE_ENDIAN(x) (x)
+#endif
 
 
 /*! \def TARGET
     \brief Makro skracające zapis funkcji.
 */
 
+/**
+ * To jest struktura przechowująca dzieci węzła drzewa.
+ * Zamiast tablicy @ref HOW_MANY_NUMBERS wskaźników węzeł przechowuje mapę
+ * bitową zajętych pozycji i zwartą tablicę istniejących dzieci uporządkowaną
+ * według cyfr. Pozycja dziecka w tablicy to ilość zapalonych bitów mapy dla
+ * mniejszych cyfr. Do @ref INLINE_CHILDREN dzieci przechowywanych jest
+ * bezpośrednio w węźle, a większe tablice są alokowane w puli pamięci.
+ */
+struct ChildSet {
+    /// Zwarta tablica dzieci.
+    union {
+        void* embedded[INLINE_CHILDREN]; ///< Dzieci przechowywane w węźle.
+        void** heap;                ///< Tablica dzieci alokowana w puli.
+    } slots;
+    uint16_t mask;                  ///< Mapa bitowa cyfr, dla których istnieje dziecko.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct ChildSet ChildSet;
+
+/**
+ * To jest struktura przechowująca stan trybu współbieżnego.
+ * Przekierowania są przechowywane w dwóch kopiach. Czytelnicy korzystają
+ * wyłącznie z opublikowanej kopii, której nikt nie modyfikuje. Piszący
+ * wykonuje zmianę w drugiej kopii, publikuje ją, czeka, aż żaden czytelnik nie
+ * korzysta z poprzedniej, i powtarza w niej tę samą zmianę. Zmiana kosztuje
+ * więc dwa zwykłe wykonania, a nie kopię całej struktury. Zmiany, które nie
+ * powiodły się w poprzedniej kopii z braku pamięci, są zapamiętywane i
+ * wykonywane w niej przed następną zmianą.
+ */
+struct ConcurrentState {
+    _Atomic(PhoneForward*) snapshot; ///< Opublikowana kopia przekierowań.
+    PhoneForward* copies[2];        ///< Obie kopie przekierowań.
+    /// Zmiany opublikowane, których brakuje w nieopublikowanej kopii, jako
+    /// kolejne pary napisów zakończonych znakiem '\0'. Drugi napis pary jest
+    /// pusty przy usunięciu.
+    char* pending;
+    size_t pending_size;            ///< Ilość zajętych znaków bufora zmian.
+    size_t pending_cap;             ///< Pojemność bufora zmian.
+    Epoch epoch;                    ///< Epoki chroniące opublikowaną kopię.
+    pthread_mutex_t writer;         ///< Blokada wykluczająca piszących.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct ConcurrentState ConcurrentState;
+
 /**
  * To jest struktura przechowująca przekierowania numerów telefonów.
  */
 struct PhoneForward {
     struct PhoneFwd* tree;          ///< Wskaźnik na korzeń drzewa przekierowań.
     struct PhoneBwd* backward_tree; ///< Wskaźnik na korzeń drzewa odwróconych przekierowań.
+    Pool pool;                      ///< Pula pamięci na węzły i napisy obu drzew.
+    ConcurrentState* concurrent;    ///< Stan trybu współbieżnego lub NULL poza nim.
+    /// Statystyki aktualizowane przy każdej modyfikacji drzew. Pola
+    /// @p node_bytes, @p pool_bytes i @p average_fan_out są wyznaczane dopiero
+    /// przez funkcję phfwdStats.
+    PhoneForwardStats stats;
+    size_t inner_nodes;             ///< Ilość węzłów drzewa przekierowań z dziećmi.
 };
 
 /**
@@ -33,13 +180,50 @@ struct PhoneForward {
  */
 typedef struct PhoneForward PhoneForward;
 
+/**
+ * To jest struktura przechowująca ciąg numerów telefonów.
+ */
+struct PhoneNumbers {
+    char** number;                  ///< Ciąg napisów reprezentujących numer.
+    size_t size;                    ///< Rozmiar tablicy napisów.
+    /// Wspólny blok pamięci wszystkich napisów lub NULL, jeśli każdy napis
+    /// jest alokowany osobno.
+    char* block;
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct PhoneNumbers PhoneNumbers;
+
 /**
  * To jest struktura przechowująca węzeł drzewa przekierowań.
+ * Drzewo jest skompresowane: krawędź prowadząca do węzła jest opisana etykietą
+ * złożoną z jednej lub więcej cyfr, a pierwsza cyfra etykiety wyznacza pozycję
+ * węzła w tablicy dzieci rodzica. Węzeł różny od korzenia, który nie
+ * przechowuje przekierowania, ma co najmniej dwoje dzieci.
  */
 struct PhoneFwd {
-    struct PhoneFwd** children;     ///< Wskaźnik na tablicę dzieci danego węzła.
+    ChildSet children;              ///< Dzieci danego węzła.
     struct PhoneFwd* parent;        ///< Wskaźnik na rodzica danego węzła.
-    char* forwarded_prefix;         ///< Nowy prefiks.
+    uint8_t* forwarded_prefix;      ///< Nowy prefiks w zapisie upakowanym lub NULL.
+    /// Etykieta krawędzi prowadzącej do węzła, po dwie cyfry w bajcie.
+    union {
+        uint8_t* heap;              ///< Etykieta dłuższa niż @ref FWD_INLINE_LABEL.
+        uint8_t embedded[FWD_INLINE_LABEL / 2]; ///< Krótka etykieta przechowywana w węźle.
+    } label;
+    uint32_t label_len;             ///< Długość etykiety, 0 dla korzenia.
+    uint32_t depth;                 ///< Długość napisu opisującego węzeł.
+    /// Najbliższy węzeł na ścieżce od korzenia do danego węzła włącznie, który
+    /// przechowuje przekierowanie, lub NULL, jeśli takiego węzła nie ma.
+    struct PhoneFwd* rule;
+    /// Pozycja węzła w tablicy węzła drzewa odwróconych przekierowań, na
+    /// który prowadzi jego przekierowanie.
+    uint32_t backward_index;
+    /// Ilość krótszych przekierowań, które w wyniku funkcji phfwdReverse dają
+    /// ten sam numer co przekierowanie węzła.
+    uint32_t witnesses;
+    size_t rules_below;             ///< Ilość przekierowań w węzłach poddrzewa poza samym węzłem.
 };
 
 /**
@@ -51,10 +235,16 @@ typedef struct PhoneFwd PhoneFwd;
  * To jest struktura przechowująca węzeł drzewa odwróconych przekierowań.
  */
 struct PhoneBwd {
-    struct PhoneBwd** children;     ///< Tablica dzieci danego węzła. 
+    ChildSet children;              ///< Dzieci danego węzła.
     struct PhoneBwd* parent;        ///< Wskaźnik na rodzica danego węzła.
-    struct PhoneNumbers * forwarded_prefix; 
-    ///< Ciąg napisów które przekierowują na dany prefiks.
+    /// Węzły drzewa przekierowań, których przekierowania prowadzą na dany
+    /// prefiks. Każdy z nich pamięta swoją pozycję w tej tablicy.
+    struct PhoneFwd** forwarding;
+    size_t size;                    ///< Ilość węzłów w tablicy.
+    size_t capacity;                ///< Pojemność tablicy węzłów.
+    /// Ilość węzłów tablicy, których przekierowania powtarzają numery
+    /// krótszych przekierowań.
+    size_t duplicates;
 };
 
 /**
@@ -63,32 +253,28 @@ struct PhoneBwd {
 typedef struct PhoneBwd PhoneBwd;
 
 /**
- * To jest struktura przechowująca ciąg numerów telefonów.
- */
-struct PhoneNumbers {
-    char** number;                  ///< Ciąg napisów reprezentujących numer.
-    size_t size;                    ///< Rozmiar tablicy napisów.
-};
-
-/**
- * Pozbycie się konieczności używania słowa kluczowego "struct".
+ * @brief Rozpoczyna odczyt opublikowanej kopii przekierowań.
+ * Funkcja pomocnicza dla funkcji odczytujących przekierowania w trybie
+ * współbieżnym. Nie blokuje. Kopia nie jest modyfikowana aż do wywołania
+ * funkcji snapshot_release.
+ * @param[in] pf - wskaźnik na strukturę w trybie współbieżnym;
+ * @param[out] slot - wskaźnik na numer licznika epoki czytelnika.
+ * @return Wskaźnik na opublikowaną kopię przekierowań, która sama nie jest
+ * w trybie współbieżnym.
  */
-typedef struct PhoneNumbers PhoneNumbers;
-
-// Zapewnienie widoczności funkcji phnumDelete innym funkcjom.
-void phnumDelete(PhoneNumbers *pnum);
+static const PhoneForward * snapshot_acquire(const PhoneForward* pf, unsigned* slot) {
+    *slot = epoch_enter(&pf->concurrent->epoch);
+    return atomic_load(&pf->concurrent->snapshot);
+}
 
 /**
- * @brief Sprawdza, czy znak reprezentuje liczbę.
- * Sprawdza, czy znak reprezentuje liczbę wraz z dodatkowymi liczbami w treści 
- * i zwraca odpowiednią wartość logiczną.
- * @param[in] c znak.
- * @return true - jeśli znak @p c reprezentuje liczbe.
- * @return false - jeśli znak @p c nie reprezentuje liczby.
+ * @brief Kończy odczyt opublikowanej kopii przekierowań.
+ * @param[in] pf - wskaźnik na strukturę w trybie współbieżnym;
+ * @param[in] slot - numer licznika zwrócony przez snapshot_acquire.
  */
-static bool is_number(char c) {
-    return ((c <= '9' && c >= '0') || c == '*' || c == '#');
-} 
+static void snapshot_release(const PhoneForward* pf, unsigned slot) {
+    epoch_leave(&pf->concurrent->epoch, slot);
+}
 
 /**
  * @brief Konwertuje znak do reprezentowanej przez niego liczby.
@@ -108,18 +294,275 @@ static int convert_to_number(char c) {
 }
 
 /**
- * @brief Konwertuje liczbę na reprezentujący ją znak.
- * Konwertuje liczbę na reprezentujący ją znak. Liczby 10 i 11 są konwertowane 
- * na odpowiednio '*' u '#'.
- * @param[in] i - liczba który ma zostać przekonwertowany
- * @return Liczba reprezentowana przez ten znak.
+ * To jest struktura przechowująca sprawdzony numer wraz z kodami jego cyfr.
+ * Kody są wyznaczane jednorazowo przez funkcję digits_scan, więc przejście po
+ * drzewach nie konwertuje ponownie znaków numeru. Te same cyfry są
+ * przechowywane również w zapisie upakowanym, w którym porównywane są z
+ * etykietami. Dla dłuższych numerów przechowywane są tylko
+ * @ref NUMBER_CODES pierwsze cyfry.
+ */
+struct Number {
+    const char* str;                ///< Napis reprezentujący numer.
+    size_t length;                  ///< Długość numeru.
+    uint8_t codes[NUMBER_CODES];    ///< Kody początkowych cyfr numeru.
+    uint8_t packed[NUMBER_CODES / 2]; ///< Początkowe cyfry numeru w zapisie upakowanym.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct Number Number;
+
+/**
+ * @brief Sprawdza, czy napis reprezentuje numer, i wyznacza kody jego cyfr.
+ * Sprawdzenie, wyznaczenie długości i konwersja cyfr odbywają się w jednym
+ * przebiegu po napisie.
+ * @param[out] number - wskaźnik na wypełnianą strukturę;
+ * @param[in] str - napis lub NULL.
+ * @return true - jeśli napis @p str reprezentuje numer.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool number_parse(Number* number, const char* str) {
+    number->str = str;
+    number->length = str == NULL ? 0 : digits_scan(str, number->codes, NUMBER_CODES);
+    size_t known = number->length < NUMBER_CODES ? number->length : NUMBER_CODES;
+    for (size_t i = 0; i + 1 < known; i += 2)
+        number->packed[i / 2] = (uint8_t)(number->codes[i] | number->codes[i + 1] << 4);
+    if (known % 2 == 1)
+        number->packed[known / 2] = number->codes[known - 1];
+    return number->length > 0 && str[number->length] == '\0';
+}
+
+/**
+ * @brief Udostępnia wartość cyfry numeru.
+ * @param[in] number - wskaźnik na numer;
+ * @param[in] i - pozycja cyfry mniejsza od długości numeru.
+ * @return Wartość cyfry na pozycji @p i.
+ */
+static int number_digit(const Number* number, size_t i) {
+    return i < NUMBER_CODES ? number->codes[i] : convert_to_number(number->str[i]);
+}
+
+/**
+ * @brief Udostępnia cyfrę numeru w zapisie upakowanym.
+ * W zapisie upakowanym każdy bajt przechowuje dwie kolejne cyfry, wcześniejszą
+ * na młodszych czterech bitach.
+ * @param[in] packed - numer w zapisie upakowanym;
+ * @param[in] index - pozycja cyfry.
+ * @return Wartość cyfry.
+ */
+static int packed_get(const uint8_t* packed, size_t index) {
+    return (packed[index / 2] >> (index % 2 * 4)) & 0xF;
+}
+
+/**
+ * @brief Ustawia cyfrę numeru w zapisie upakowanym.
+ * @param[in,out] packed - numer w zapisie upakowanym;
+ * @param[in] index - pozycja cyfry;
+ * @param[in] value - wartość cyfry.
+ */
+static void packed_set(uint8_t* packed, size_t index, int value) {
+    unsigned shift = index % 2 * 4;
+    packed[index / 2] = (uint8_t)((packed[index / 2] & ~(0xFu << shift))
+                                  | ((unsigned)value << shift));
+}
+
+/**
+ * @brief Wyznacza rozmiar numeru w zapisie upakowanym.
+ * @param[in] length - ilość cyfr.
+ * @return Ilość bajtów.
+ */
+static size_t packed_bytes(size_t length) {
+    return (length + 1) / 2;
+}
+
+/**
+ * @brief Odczytuje naraz do szesnastu cyfr numeru w zapisie upakowanym.
+ * Odczytuje tylko bajty zawierające odczytywane cyfry.
+ * @param[in] packed - numer w zapisie upakowanym;
+ * @param[in] index - pozycja pierwszej cyfry;
+ * @param[in] count - ilość cyfr, od 1 do 16.
+ * @return Liczba, której kolejne czwórki bitów, od najmłodszych, są
+ * kolejnymi cyframi. Pozostałe bity są zerami.
+ */
+static uint64_t packed_load(const uint8_t* packed, size_t index, size_t count) {
+    uint8_t bytes[9] = {0};
+    memcpy(bytes, packed + index / 2, packed_bytes(index % 2 + count));
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(uint64_t));
+    word = FROM_LITTLE_ENDIAN(word);
+    if (index % 2 == 1)
+        word = word >> 4 | (uint64_t)bytes[8] << 60;
+    return count == 16 ? word : word & ((UINT64_C(1) << (4 * count)) - 1);
+}
+
+/**
+ * @brief Zapisuje numer w zapisie upakowanym.
+ * Napis musi składać się z @p length cyfr.
+ * @param[out] packed - bufor na co najmniej packed_bytes(@p length) bajtów;
+ * @param[in] str - napis reprezentujący numer;
+ * @param[in] length - ilość cyfr.
+ */
+static void packed_from_ascii(uint8_t* packed, const char* str, size_t length) {
+    for (size_t i = 0; i + 1 < length; i += 2)
+        packed[i / 2] = (uint8_t)(convert_to_number(str[i])
+                                  | convert_to_number(str[i + 1]) << 4);
+    if (length % 2 == 1)
+        packed[length / 2] = (uint8_t)convert_to_number(str[length - 1]);
+}
+
+/**
+ * @brief Zapisuje numer w zapisie upakowanym jako napis.
+ * Nie dopisuje znaku końca napisu.
+ * @param[in] packed - numer w zapisie upakowanym;
+ * @param[in] length - ilość cyfr;
+ * @param[out] out - bufor na co najmniej @p length znaków.
+ */
+static void packed_to_ascii(const uint8_t* packed, size_t length, char* out) {
+    static const char digits[HOW_MANY_NUMBERS] = "0123456789*#";
+    for (size_t i = 0; i < length; i++)
+        out[i] = digits[packed_get(packed, i)];
+}
+
+/**
+ * @brief Kopiuje fragment numeru w zapisie upakowanym.
+ * @param[in,out] dst - numer docelowy;
+ * @param[in] dst_index - pozycja pierwszej zapisywanej cyfry;
+ * @param[in] src - numer źródłowy, różny od @p dst;
+ * @param[in] src_index - pozycja pierwszej kopiowanej cyfry;
+ * @param[in] length - ilość kopiowanych cyfr.
+ */
+static void packed_copy(uint8_t* dst, size_t dst_index, const uint8_t* src,
+                        size_t src_index, size_t length) {
+    // Przy parzystych pozycjach całe bajty są kopiowane naraz.
+    if (dst_index % 2 == 0 && src_index % 2 == 0) {
+        memcpy(dst + dst_index / 2, src + src_index / 2, length / 2);
+        if (length % 2 == 1)
+            packed_set(dst, dst_index + length - 1, packed_get(src, src_index + length - 1));
+        return;
+    }
+    for (size_t i = 0; i < length; i++)
+        packed_set(dst, dst_index + i, packed_get(src, src_index + i));
+}
+
+/**
+ * @brief Udostępnia tablicę dzieci węzła.
+ * @param[in] set - wskaźnik na zbiór dzieci.
+ * @return Wskaźnik na pierwszy element zwartej tablicy dzieci.
+ */
+static void * const * child_slots(const ChildSet* set) {
+    if (POPCOUNT(set->mask) > INLINE_CHILDREN)
+        return set->slots.heap;
+    return set->slots.embedded;
+}
+
+/**
+ * @brief Udostępnia dziecko węzła odpowiadające podanej cyfrze.
+ * @param[in] set - wskaźnik na zbiór dzieci;
+ * @param[in] value - wartość cyfry.
+ * @return Wskaźnik na dziecko lub NULL, jeśli takiego dziecka nie ma.
+ */
+static void * child_get(const ChildSet* set, int value) {
+    unsigned bit = 1u << value;
+    if (!(set->mask & bit))
+        return NULL;
+    return child_slots(set)[POPCOUNT(set->mask & (bit - 1))];
+}
+
+/**
+ * @brief Ustawia dziecko węzła odpowiadające podanej cyfrze.
+ * Zastępuje istniejące dziecko lub wstawia nowe w odpowiednie miejsce zwartej
+ * tablicy, w razie potrzeby ją powiększając. W przypadku niepowodzenia
+ * alokacji zbiór dzieci pozostaje bez zmian.
+ * @param[in,out] pool - wskaźnik na pulę pamięci;
+ * @param[in,out] set - wskaźnik na zbiór dzieci;
+ * @param[in] value - wartość cyfry;
+ * @param[in] child - wskaźnik na dziecko różny od NULL.
+ * @return true - jeśli alokowanie pamięci się powiodło.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool child_set(Pool* pool, ChildSet* set, int value, void* child) {
+    unsigned bit = 1u << value;
+    int count = POPCOUNT(set->mask), position = POPCOUNT(set->mask & (bit - 1));
+    if (set->mask & bit) {
+        ((void**)child_slots(set))[position] = child;
+        return true;
+    }
+
+    void** slots;
+    if (count + 1 <= INLINE_CHILDREN)
+        slots = set->slots.embedded;
+    else if (count == INLINE_CHILDREN) {
+        slots = pool_alloc(pool, sizeof(void*) * (count + 1));
+        if (slots == NULL)
+            return false;
+        memcpy(slots, set->slots.embedded, sizeof(void*) * count);
+        set->slots.heap = slots;
+    }
+    else {
+        slots = pool_realloc(pool, set->slots.heap, sizeof(void*) * count,
+                             sizeof(void*) * (count + 1));
+        if (slots == NULL)
+            return false;
+        set->slots.heap = slots;
+    }
+    memmove(slots + position + 1, slots + position, sizeof(void*) * (count - position));
+    slots[position] = child;
+    set->mask |= bit;
+    return true;
+}
+
+/**
+ * @brief Usuwa dziecko węzła odpowiadające podanej cyfrze.
+ * Usuwa dziecko ze zbioru, w razie potrzeby zmniejszając zwartą tablicę.
+ * Nic nie robi, jeśli takiego dziecka nie ma.
+ * @param[in,out] pool - wskaźnik na pulę pamięci;
+ * @param[in,out] set - wskaźnik na zbiór dzieci;
+ * @param[in] value - wartość cyfry.
  */
-static char convert_to_char(int i) {
-    if (i == STAR_VALUE)
-        return '*';
-    if (i == HASH_VALUE)
-        return '#';
-    return ((char)((int)'0' + i));
+static void child_clear(Pool* pool, ChildSet* set, int value) {
+    unsigned bit = 1u << value;
+    if (!(set->mask & bit))
+        return;
+    int count = POPCOUNT(set->mask), position = POPCOUNT(set->mask & (bit - 1));
+    void** slots = (void**)child_slots(set);
+    memmove(slots + position, slots + position + 1, sizeof(void*) * (count - position - 1));
+    set->mask &= ~bit;
+    if (count - 1 == INLINE_CHILDREN) {
+        void* remaining[INLINE_CHILDREN];
+        memcpy(remaining, slots, sizeof(remaining));
+        pool_free(pool, slots, sizeof(void*) * count);
+        memcpy(set->slots.embedded, remaining, sizeof(remaining));
+    }
+    else if (count - 1 > INLINE_CHILDREN) {
+        // Tablica tej samej klasy rozmiaru nie jest przenoszona.
+        void** shrunk = pool_realloc(pool, slots, sizeof(void*) * count,
+                                     sizeof(void*) * (count - 1));
+        if (shrunk != NULL)
+            set->slots.heap = shrunk;
+    }
+}
+
+/**
+ * @brief Inicjalizuje pusty zbiór dzieci.
+ * @param[out] set - wskaźnik na zbiór dzieci.
+ */
+static void child_init(ChildSet* set) {
+    set->mask = 0;
+    for (int i = 0; i < INLINE_CHILDREN; i++)
+        set->slots.embedded[i] = NULL;
+}
+
+/**
+ * @brief Zwalnia tablicę dzieci alokowaną w puli pamięci.
+ * @param[in,out] pool - wskaźnik na pulę pamięci;
+ * @param[in,out] set - wskaźnik na zbiór dzieci.
+ */
+static void child_free(Pool* pool, ChildSet* set) {
+    int count = POPCOUNT(set->mask);
+    if (count > INLINE_CHILDREN)
+        pool_free(pool, set->slots.heap, sizeof(void*) * count);
+    child_init(set);
 }
 
 /**
@@ -136,6 +579,7 @@ static PhoneNumbers * phn_create(char** number, size_t size) {
         return NULL;
 
     phn->size = size;
+    phn->block = NULL;
     phn->number = malloc(sizeof(char*) * size);
     if (phn->number == NULL){
         free(phn);
@@ -158,781 +602,4492 @@ static PhoneNumbers * phn_create(char** number, size_t size) {
 
 /**
  * @brief Tworzy nowy węzeł drzewa przekierowań.
- * Tworzy nowy węzeł drzewa przekierowań. Przyjmuje wskaźnik na rodzica i ustawia 
- * go w strukturze nowopowstałego węzła. Alokuje pamięć na potencjalnych synów.
+ * Tworzy nowy węzeł drzewa przekierowań w puli pamięci struktury @p pf.
+ * Przyjmuje wskaźnik na rodzica i ustawia go w strukturze nowopowstałego
+ * węzła. Tablica potencjalnych synów jest częścią węzła, więc węzeł wymaga
+ * jednej alokacji.
+ * @param[in,out] pf - wskaźnik na strukturę, do której należy węzeł;
  * @param[in] parent - wskaźnik na rodzica
  * @return *Wskaźnik na nowo utworzony węzeł.
  */
-static PhoneFwd * phf_create_node(PhoneFwd* parent) {
-    PhoneFwd * phf_ptr = malloc(sizeof(PhoneFwd));
+static PhoneFwd * phf_create_node(PhoneForward* pf, PhoneFwd* parent) {
+    PhoneFwd * phf_ptr = pool_alloc(&pf->pool, sizeof(PhoneFwd));
     if (phf_ptr == NULL)
         return NULL;
 
+    pf->stats.forward_nodes++;
+
     phf_ptr->forwarded_prefix = NULL;
     phf_ptr->parent = parent;
-    phf_ptr->children = malloc(sizeof(PhoneForward*) * HOW_MANY_NUMBERS);
-    if (phf_ptr->children == NULL) {
-        free(phf_ptr);
-        return NULL;
-    }
-
-    for (int i = 0; i < HOW_MANY_NUMBERS; i++)
-        phf_ptr->children[i] = NULL;
+    phf_ptr->label_len = 0;
+    phf_ptr->depth = 0;
+    phf_ptr->rule = parent == NULL ? NULL : parent->rule;
+    phf_ptr->backward_index = 0;
+    phf_ptr->witnesses = 0;
+    phf_ptr->rules_below = 0;
+    child_init(&phf_ptr->children);
     return phf_ptr;
 }
 
 /**
  * @brief Tworzy nowy węzeł drzewa odwróconych przekierowań.
- * Tworzy nowy węzeł drzewa przekierowań. Przyjmuje wskaźnik na rodzica i ustawia
- * go w strukturze nowopowstałego węzła. Alokuje pamięć na potencjalnych synów.
+ * Tworzy nowy węzeł drzewa odwróconych przekierowań w puli pamięci struktury
+ * @p pf. Przyjmuje wskaźnik na rodzica i ustawia go w strukturze
+ * nowopowstałego węzła. Tablica synów jest częścią węzła, a tablica węzłów
+ * drzewa przekierowań jest początkowo pusta.
+ * @param[in,out] pf - wskaźnik na strukturę, do której należy węzeł;
  * @param[in] parent - wskaźnik na rodzica
  * @return *Wskaźnik na nowo utworzony węzeł.
  */
-static PhoneBwd * phf_create_backward_node(PhoneBwd* parent) {
-    PhoneBwd * bwd_ptr = malloc(sizeof(PhoneBwd));
+static PhoneBwd * phf_create_backward_node(PhoneForward* pf, PhoneBwd* parent) {
+    PhoneBwd * bwd_ptr = pool_alloc(&pf->pool, sizeof(PhoneBwd));
     if (bwd_ptr == NULL)
         return NULL;
 
-    bwd_ptr->forwarded_prefix = phn_create(NULL, 0);
-    if (bwd_ptr->forwarded_prefix == NULL) {
-        free(bwd_ptr);
-        return NULL;
-    }
-    bwd_ptr->parent = parent;
-    bwd_ptr->children = malloc(sizeof(PhoneForward*) * HOW_MANY_NUMBERS);
-    if (bwd_ptr->children == NULL) {
-        free(bwd_ptr->forwarded_prefix);
-        free(bwd_ptr);
-        return NULL;
-    }
+    pf->stats.backward_nodes++;
 
-    for (int i = 0; i < HOW_MANY_NUMBERS; i++)
-        bwd_ptr->children[i] = NULL;
+    bwd_ptr->forwarding = NULL;
+    bwd_ptr->size = 0;
+    bwd_ptr->capacity = 0;
+    bwd_ptr->duplicates = 0;
+    bwd_ptr->parent = parent;
+    child_init(&bwd_ptr->children);
     return bwd_ptr;
 }
 
 /**
- * @brief Zwalnia pamięć zajmowaną przez pojedynczy węzeł w drzewie przekierowań.
- * Zwalnia pamięć zajmowaną przez pojedynczy węzeł w drzewie przekierowań.
- * @param[in] pfd_node - wskaźnik na węzeł, który ma zostać usunięty.
+ * @brief Udostępnia dziecko węzła drzewa przekierowań.
+ * @param[in] pfd_node - wskaźnik na węzeł;
+ * @param[in] value - wartość pierwszej cyfry etykiety dziecka.
+ * @return Wskaźnik na dziecko lub NULL, jeśli takiego dziecka nie ma.
  */
-static void free_node(PhoneFwd * pfd_node) {
-    if (pfd_node == NULL)
-        return;
-    free(pfd_node->forwarded_prefix);
-    free(pfd_node->children);
-    free(pfd_node);
+static PhoneFwd * fwd_child(const PhoneFwd* pfd_node, int value) {
+    return child_get(&pfd_node->children, value);
 }
 
 /**
- * @brief Zwalnia pamięć zajmowaną przez pojedynczy węzeł w odwrócoych drzewie przekierowań.
- * Zwalnia pamięć zajmowaną przez pojedynczy węzeł w drzewie przekierowań.
- * @param[in] pbd_node - wskaźnik na węzeł, który ma zostać usunięty.
+ * @brief Udostępnia dziecko węzła drzewa odwróconych przekierowań.
+ * @param[in] pbd_node - wskaźnik na węzeł;
+ * @param[in] value - wartość cyfry.
+ * @return Wskaźnik na dziecko lub NULL, jeśli takiego dziecka nie ma.
  */
-static void free_backward_node(PhoneBwd * pbd_node) {
-    if (pbd_node == NULL)
-        return;
-    phnumDelete(pbd_node->forwarded_prefix);
-    free(pbd_node->children);
+static PhoneBwd * bwd_child(const PhoneBwd* pbd_node, int value) {
+    return child_get(&pbd_node->children, value);
 }
 
-/** @brief Tworzy nową strukturę.
- * Tworzy nową strukturę niezawierającą żadnych przekierowań.
- * @return Wskaźnik na utworzoną strukturę lub NULL, gdy nie udało się
- *         alokować pamięci.
+/**
+ * @brief Wyznacza rozmiar nagłówka prefiksu przechowywanego w puli pamięci.
+ * Prefiks przekierowania jest przechowywany jako długość zapisana po siedem
+ * bitów w bajcie, od najmłodszych, a po niej cyfry w zapisie upakowanym.
+ * Najstarszy bit bajtu długości oznacza, że po nim następuje kolejny. Długość
+ * prefiksu krótszego niż 128 cyfr zajmuje więc jeden bajt.
+ * @param[in] length - ilość cyfr prefiksu.
+ * @return Ilość bajtów długości.
  */
-PhoneForward * phfwdNew(void) {
-    PhoneForward* new_struct = malloc(sizeof(PhoneForward));
-    if (new_struct == NULL)
-        return NULL;
-
-    new_struct->tree = phf_create_node(NULL);
-    new_struct->backward_tree = phf_create_backward_node(NULL);
-    if (new_struct->tree == NULL || new_struct->backward_tree == NULL) {
-        free_node(new_struct->tree);
-        free_backward_node(new_struct->backward_tree);
-        free(new_struct);
-        return NULL;
-    }
-    return new_struct;
+static size_t prefix_header(size_t length) {
+    size_t bytes = 1;
+    for (; length >= 0x80; length >>= 7)
+        bytes++;
+    return bytes;
 }
 
-/** @brief Usuwa pojedyncze odwrócone przekierowanie z drzewa odwróconych przekierowań.
- * Usuwa pojedyncze odwrócone przekierowanie z drzewa odwróconych przekierowań.
- * @param[in] pfd_backward_node – wskaźnik na korzeń drzewa odwróconych przekierowań;
- * @param[in] forward - wkaźnik na słowo, na które przekierowanie chcemy usunąć;
- * @param[in] to_remove - wkaźnik na napis reprezentując przekierowanie, które usuwamy.
+/**
+ * @brief Wyznacza rozmiar prefiksu przechowywanego w puli pamięci.
+ * @param[in] length - ilość cyfr prefiksu.
+ * @return Ilość bajtów.
  */
-static void delete_forward_from_bwd(PhoneBwd * pfd_backward_node, 
-                                    const char *forward, const char* to_remove) {
-    size_t iterator = 0;
+static size_t prefix_size(size_t length) {
+    return prefix_header(length) + packed_bytes(length);
+}
 
-    while (is_number(forward[iterator])) {
-        int value = convert_to_number(forward[iterator]);
-        if (pfd_backward_node->children[value] == NULL) 
-            return; 
-        pfd_backward_node = pfd_backward_node->children[value];
-        iterator++;
-    }
-#define TARGET pfd_backward_node->forwarded_prefix  
-    for (size_t i = 0; i < TARGET->size; i++)
-        if (strcmp(TARGET->number[i], to_remove) == 0) {
-            TARGET->size--;
-            if (TARGET->size == 0)
-                free(TARGET->number[0]);
-            else {
-                free(TARGET->number[i]);
-                if (TARGET->size != i) {
-                    TARGET->number[i] = TARGET->number[TARGET->size];
-                }
-            }
-            break;
-        }
-#undef TARGET
+/**
+ * @brief Udostępnia długość prefiksu przekierowania.
+ * @param[in] prefix - prefiks przekierowania.
+ * @return Ilość cyfr prefiksu.
+ */
+static size_t prefix_length(const uint8_t* prefix) {
+    size_t length = prefix[0] & 0x7F;
+    for (unsigned shift = 7; *prefix++ & 0x80; shift += 7)
+        length |= (size_t)(*prefix & 0x7F) << shift;
+    return length;
 }
 
 /**
- * @brief Usuwa drzewo odwróconych przekierowań zwalniając pamięć.
- * Usuwa drzewo odwróconych przekierowań zwalniając pamięć.
- * @param[in] pfd_backward_node Korzeń na drzewo odwróconych przekierowań.
+ * @brief Udostępnia cyfry prefiksu przekierowania.
+ * @param[in] prefix - prefiks przekierowania.
+ * @return Cyfry prefiksu w zapisie upakowanym.
  */
-static void remove_backward_tree(PhoneBwd * pfd_backward_node) {
-    if (pfd_backward_node == NULL)
-        return;
+static const uint8_t * prefix_digits(const uint8_t* prefix) {
+    while (*prefix & 0x80)
+        prefix++;
+    return prefix + 1;
+}
 
-    bool found_son = false;
-    // Iteracja po drzewie.
-    while (pfd_backward_node != NULL) {
-        found_son = false;
-        for (int i = 0; i < HOW_MANY_NUMBERS; i++) {
-            if (pfd_backward_node->children[i] != NULL) {
-                found_son = true;
-                pfd_backward_node = pfd_backward_node->children[i];
-                break;
-            }
-        }
-        // Gdy funkcja jest liściem, to przejdź do rodzica i zwolnij pamięć.
-        if (!found_son) {
-            int son_number = 0;
-            PhoneBwd* son = pfd_backward_node;
-            pfd_backward_node = pfd_backward_node->parent;
-            free_backward_node(son);
-            free(son);
-
-            if (pfd_backward_node != NULL) {
-                while (pfd_backward_node->children[son_number] != son) {
-                    son_number++;
-                }
-                pfd_backward_node->children[son_number] = NULL;
-            }
-        }
-    }
+/**
+ * @brief Kopiuje prefiks przekierowania do puli pamięci.
+ * Zapisuje pierwsze @p length cyfr napisu @p str w zapisie upakowanym.
+ * @param[in,out] pool - wskaźnik na pulę pamięci;
+ * @param[in] str - napis reprezentujący prefiks;
+ * @param[in] length - ilość cyfr.
+ * @return Wskaźnik na prefiks lub NULL, gdy nie udało się alokować pamięci.
+ */
+static uint8_t * prefix_create(Pool* pool, const char* str, size_t length) {
+    uint8_t* prefix = pool_alloc(pool, prefix_size(length));
+    if (prefix == NULL)
+        return NULL;
+    uint8_t* digits = prefix;
+    size_t rest = length;
+    for (; rest >= 0x80; rest >>= 7)
+        *digits++ = (uint8_t)(rest | 0x80);
+    *digits++ = (uint8_t)rest;
+    packed_from_ascii(digits, str, length);
+    return prefix;
 }
 
 /**
- * @brief Zwalnia pamięć zajmowaną przez węzeł i wszystkich jego potomków i usuwa ich z drzewa.
- * Zwalnia pamięć zajmowaną przez węzeł i wszystkich jego potomków i usuwa ich
- * z drzewa przekierowań. Jeśli wartość @p pfd_backward_tree jest różna od 
- * wartości null to usuwa również odpowiadający mu węzeł w drzewie odwrotnych
- * przekierowań, którego korzeniem jest podany węzeł. 
- * Jeśli dany węzeł miał rodzica to wskaźnik na usuwany węzeł w tablicy dzieci
- * jest zamieniany na wartość NULL. 
- * @param[in] pfd_node Węzeł, który należy usunąć.;
- * @param[in] pfd_backward_tree Wskaźnik na korzeń drzewa odwrotnych przekierowań;
- * @param[in] path Napis opisujący zwalniany węzeł.
- */
-static void delete_tree(PhoneFwd * pfd_node, PhoneBwd * pfd_backward_tree, 
-                        const char* path) {
-    if (pfd_node == NULL)
-        return;
-    /* Path musi być terminowane nullem bo gdyby nie było to pfd_node byłoby
-    równe NULL ze względu na działanie funkcji pomocniczej go_to_prefix. */
-    size_t current_path_length = strlen(path) + 1, max_path_length = current_path_length * 2; 
-    char* current_path = NULL;
-    if (pfd_backward_tree != NULL) {
-        current_path = malloc(sizeof(char) * max_path_length);
-        if (current_path == NULL) 
-            return;
-        strcpy(current_path, (char*)path);
-    }
+ * @brief Zwraca prefiks utworzony przez @ref prefix_create do puli pamięci.
+ * @param[in,out] pool - wskaźnik na pulę pamięci;
+ * @param[in] prefix - zwalniany prefiks lub NULL.
+ */
+static void prefix_free(Pool* pool, uint8_t* prefix) {
+    if (prefix != NULL)
+        pool_free(pool, prefix, prefix_size(prefix_length(prefix)));
+}
 
-    PhoneFwd * delete_border = pfd_node->parent;
-    bool found_son = false;
-    // Iteracja po drzewie.
-    while (pfd_node != delete_border) {
-        found_son = false;
-        for (int i = 0; i < HOW_MANY_NUMBERS; i++) {
-            if (pfd_node->children[i] != NULL) {
-                found_son = true;
-                pfd_node = pfd_node->children[i];
-                if (pfd_backward_tree != NULL) {
-                    current_path_length++;
-                    if (current_path_length > max_path_length) {
-                        max_path_length *= 2;
-                        current_path = realloc(current_path, sizeof(char) * max_path_length);
-                        if (current_path == NULL) 
-                            return;
-                    }
-                // Dodatkowe miejsce na znak '\0'.
-                current_path[current_path_length - 2] = convert_to_char(i);
-                }
-                break;
-            }
-        }
-        // Gdy funkcja jest liściem, to przejdź do rodzica i zwolnij pamięć.
-        if (!found_son) {
-            int son_number = 0;
-            PhoneFwd* son = pfd_node;
-            pfd_node = pfd_node->parent;
+/**
+ * @brief Zapisuje prefiks przekierowania jako napis.
+ * Nie dopisuje znaku końca napisu.
+ * @param[in] prefix - prefiks przekierowania;
+ * @param[out] out - bufor na co najmniej prefix_length(@p prefix) znaków.
+ */
+static void prefix_write(const uint8_t* prefix, char* out) {
+    packed_to_ascii(prefix_digits(prefix), prefix_length(prefix), out);
+}
 
-            if (pfd_backward_tree != NULL)  {
-                if (son->forwarded_prefix != NULL) {
-                    current_path[current_path_length - 1] = '\0';
-                    delete_forward_from_bwd(pfd_backward_tree, son->forwarded_prefix, current_path);
-                }
-            current_path_length--;
-            }
+/**
+ * @brief Udostępnia etykietę krawędzi prowadzącej do węzła drzewa przekierowań.
+ * @param[in] pfd_node - wskaźnik na węzeł.
+ * @return Etykieta w zapisie upakowanym. Jej długość to @p label_len.
+ */
+static const uint8_t * fwd_label(const PhoneFwd* pfd_node) {
+    if (pfd_node->label_len > FWD_INLINE_LABEL)
+        return pfd_node->label.heap;
+    return pfd_node->label.embedded;
+}
 
-            free_node(son);
-            if (pfd_node != NULL) {
-                while (pfd_node->children[son_number] != son) 
-                    son_number++;
-                pfd_node->children[son_number] = NULL;
-            }
-        }
-    }
-    free(current_path);
+/**
+ * @brief Udostępnia cyfrę etykiety krawędzi prowadzącej do węzła.
+ * @param[in] pfd_node - wskaźnik na węzeł;
+ * @param[in] index - pozycja cyfry w etykiecie.
+ * @return Wartość cyfry.
+ */
+static int fwd_label_digit(const PhoneFwd* pfd_node, size_t index) {
+    return packed_get(fwd_label(pfd_node), index);
 }
 
-/** @brief Usuwa strukturę.
- * Usuwa strukturę wskazywaną przez @p pf. Nic nie robi, jeśli wskaźnik ten ma
- * wartość NULL.
- * @param[in] pf – wskaźnik na usuwaną strukturę.
+/**
+ * @brief Wyznacza długość napisu opisującego węzeł drzewa przekierowań.
+ * @param[in] pfd_node - wskaźnik na węzeł.
+ * @return Suma długości etykiet na ścieżce od korzenia do węzła.
  */
-void phfwdDelete(PhoneForward *pf) {
-    if (pf == NULL)
-        return;
-    delete_tree(pf->tree, NULL, "");
-    remove_backward_tree(pf->backward_tree);
-    free(pf);
+static size_t fwd_depth(const PhoneFwd* pfd_node) {
+    return pfd_node->depth;
 }
 
 /**
- * @brief Sprawdza, czy parametry podane do funkcji @p phfwdAdd są poprawne.
- * Funkcja pomocnicza dla funkcji @p phfwdAdd Sprawdza, czy parametry podane do funkcji phfwdAdd są poprawne. Zwraca 
- * odpowiednią wartość logiczną. Dodatkowo modyfikuje wartość pod wkaźnikiem.
- * @param[in] pf - wskaźnik na korzeń drzewa przekierowań;
- * @param[in] num1 - wskaźnik na napis przekierowywany;
- * @param[in] num2 - wkaźnik na napis, na który należy dodać przekierowanie;
- * @param[in, out] iterator_ptr - wskaźnik na wartość iterator.
- * @return true - parametry funkcji są poprawne.
- * @return false - parametry funkcji są niepoprawne.
+ * @brief Odtwarza napis opisujący węzeł drzewa przekierowań.
+ * Zapisuje etykiety na ścieżce od korzenia do węzła, idąc od węzła w górę
+ * drzewa. Nie dopisuje znaku końca napisu.
+ * @param[in] pfd_node - wskaźnik na węzeł;
+ * @param[out] out - bufor na co najmniej @p depth znaków;
+ * @param[in] depth - długość napisu wyznaczona funkcją fwd_depth.
  */
-bool check_parameters(PhoneForward *pf, char const *num1,
-                      char const *num2, size_t* iterator_ptr) {
-    size_t iterator = 0;
-    bool exact = true;
-    // Sprawdzenie czy podany napis reprezentuje numer.
-    if (!is_number(num1[0]) || !is_number(num2[0]) || pf == NULL) 
-        return false;
-    
-    // Sprawdzenie czy napisy są identyczne i wyliczenie długośći przekierowania.
-    while (is_number(num2[iterator])) {
-        if (exact)
-            if (num1[iterator] != num2[iterator] || !is_number(num1[iterator]))
-                exact = false; 
-        iterator++;
+static void fwd_write_path(const PhoneFwd* pfd_node, char* out, size_t depth) {
+    for (; pfd_node != NULL; pfd_node = pfd_node->parent) {
+        depth -= pfd_node->label_len;
+        packed_to_ascii(fwd_label(pfd_node), pfd_node->label_len, out + depth);
     }
-    // Sprawdzenie poprawności napisu.
-    if (num2[iterator] != '\0') 
-        return false;
-    // Sprawdzenie czy num2 jest równe num1 czy tylko jego prefiksem.
-    if (exact)
-        if (is_number(num1[iterator])) 
-            exact = false; 
-    if (exact) 
-        return false;
-    *iterator_ptr = iterator;
-    return true;
 }
 
-/** @brief Dodaje nowy napis do struktury PhoneNumbers.
- * Dodaje nowy napis do struktury PhoneNumbers. Zwraca prawdę jeśli alokowanie
- * pamięci się powiodło i fałsz w przeciwnym przypadku.
- * @param[in, out] phnum – wskaźnik na strukturę do której dodajemy napis;
- * @param[in] new - napis, który ma zostać dodany do struktury.
+/**
+ * @brief Ustawia etykietę krawędzi prowadzącej do węzła drzewa przekierowań.
+ * Zastępuje etykietę węzła kopią @p length cyfr numeru @p label w zapisie
+ * upakowanym, zaczynając od cyfry na pozycji @p offset. Numer może być
+ * dotychczasową etykietą węzła. W przypadku niepowodzenia alokacji
+ * dotychczasowa etykieta pozostaje bez zmian.
+ * @param[in,out] pool - wskaźnik na pulę pamięci;
+ * @param[in,out] pfd_node - wskaźnik na węzeł;
+ * @param[in] label - numer w zapisie upakowanym;
+ * @param[in] offset - pozycja pierwszej cyfry nowej etykiety;
+ * @param[in] length - długość nowej etykiety.
+ * @return true - jeśli alokowanie pamięci się powiodło.
+ * @return false - w przeciwnym przypadku.
  */
-static bool add_to_phnum(PhoneNumbers* phnum, const char* new) {
-    // Poprawność argumentów została sprawdzona wcześniej.
-    phnum->size++;
-    phnum->number = realloc(phnum->number, sizeof(char*) * phnum->size);
-    if (phnum->number == NULL){
-        phnum->size--;
-        return false;
+static bool fwd_set_label(Pool* pool, PhoneFwd* pfd_node, const uint8_t* label,
+                          size_t offset, size_t length) {
+    if (length <= FWD_INLINE_LABEL) {
+        uint8_t copy[FWD_INLINE_LABEL / 2] = {0};
+        packed_copy(copy, 0, label, offset, length);
+        if (pfd_node->label_len > FWD_INLINE_LABEL)
+            pool_free(pool, pfd_node->label.heap, packed_bytes(pfd_node->label_len));
+        memcpy(pfd_node->label.embedded, copy, sizeof(copy));
     }
-    phnum->number[phnum->size - 1] = malloc(sizeof(char) * (strlen(new) + 1));
-    if (phnum->number[phnum->size - 1] == NULL) {
-        free(phnum->number);
-        phnum->size--;
-        return false;
+    else {
+        uint8_t* copy = pool_alloc(pool, packed_bytes(length));
+        if (copy == NULL)
+            return false;
+        copy[packed_bytes(length) - 1] = 0;
+        packed_copy(copy, 0, label, offset, length);
+        if (pfd_node->label_len > FWD_INLINE_LABEL)
+            pool_free(pool, pfd_node->label.heap, packed_bytes(pfd_node->label_len));
+        pfd_node->label.heap = copy;
     }
-    strcpy(phnum->number[phnum->size - 1], new);
+    pfd_node->label_len = length;
     return true;
 }
 
 /**
- * @brief Tworzy nowy odwrócone przekierowanie i dodaje je do odpowiedniego drzewa.
- * Tworzy nowy węzeł drzewa odwróconych przekierowań. Przyjmuje napis 
- * reprezentujący numer przekierowany i ten, na który ma zostać przekierowany.
- * Zwraca prawde, gdy alokowanie pamięci się powiodło i fałsz w przeciwnym przypadku.
- * @param[in] pbd_node - wskaźnik na korzeń drzewa przekierowań;
- * @param[in] num1 - napis przekierowywany; 
- * @param[in] num2 - napis, na który ma zostać dodane przekierowanie;
- * @return *Wskaźnik na nowo utworzony węzeł.
+ * @brief Ustawia etykietę węzła drzewa przekierowań na fragment napisu.
+ * Działa tak jak funkcja fwd_set_label dla pierwszych @p length cyfr napisu
+ * @p label.
+ * @param[in,out] pool - wskaźnik na pulę pamięci;
+ * @param[in,out] pfd_node - wskaźnik na węzeł;
+ * @param[in] label - napis reprezentujący nową etykietę;
+ * @param[in] length - długość nowej etykiety.
+ * @return true - jeśli alokowanie pamięci się powiodło.
+ * @return false - w przeciwnym przypadku.
  */
-static bool add_forward_to_backward_tree(PhoneBwd * pbd_node, char const *num1, char const *num2) {
-    // Poprawność danych została sprawdzona w funkcji phfwdAdd.
-    int iterator = 0;
-    while (is_number(num2[iterator])) {
-        int value = convert_to_number(num2[iterator]);
-        if (pbd_node->children[value] == NULL) 
-            pbd_node->children[value] = phf_create_backward_node(pbd_node);
-        if (pbd_node->children[value] == NULL)
-            return false;
-        pbd_node = pbd_node->children[value];
-        iterator++;
-    }
+static bool fwd_set_label_ascii(Pool* pool, PhoneFwd* pfd_node, const char* label,
+                                size_t length) {
+    uint8_t stack_label[FWD_INLINE_LABEL / 2];
+    uint8_t* packed = length <= FWD_INLINE_LABEL ? stack_label
+                                                 : malloc(packed_bytes(length));
+    if (packed == NULL)
+        return false;
+    packed_from_ascii(packed, label, length);
+    bool result = fwd_set_label(pool, pfd_node, packed, 0, length);
+    if (packed != stack_label)
+        free(packed);
+    return result;
+}
 
-    // Dodanie kolejnej odwrotności przekierowania.
-    return add_to_phnum(pbd_node->forwarded_prefix, num1);
+/**
+ * @brief Wyznacza długość wspólnego prefiksu etykiety węzła i końcówki numeru.
+ * Porównuje etykietę węzła @p pfd_node z cyframi numeru @p num od pozycji
+ * @p offset po szesnaście cyfr naraz, a pierwszą różną cyfrę wyznacza z
+ * najmłodszego zapalonego bitu różnicy. Cyfry numeru dalsze niż
+ * @ref NUMBER_CODES są porównywane pojedynczo.
+ * @param[in] pfd_node - wskaźnik na węzeł;
+ * @param[in] num - wskaźnik na porównywany numer;
+ * @param[in] offset - pozycja w numerze, od której zaczyna się porównanie.
+ * @return Długość najdłuższego wspólnego prefiksu.
+ */
+static size_t fwd_match_label(const PhoneFwd* pfd_node, const Number* num, size_t offset) {
+    const uint8_t* label = fwd_label(pfd_node);
+    size_t length = pfd_node->label_len, matched = 0;
+    // Numer może skończyć się w środku etykiety.
+    if (length > num->length - offset)
+        length = num->length - offset;
+    while (matched < length && offset + matched < NUMBER_CODES) {
+        size_t count = length - matched;
+        if (count > NUMBER_CODES - offset - matched)
+            count = NUMBER_CODES - offset - matched;
+        if (count > 16)
+            count = 16;
+        uint64_t difference = packed_load(label, matched, count)
+                              ^ packed_load(num->packed, offset + matched, count);
+        if (difference != 0)
+            return matched + (size_t)LOWEST_BIT64(difference) / 4;
+        matched += count;
+    }
+    while (matched < length
+           && number_digit(num, offset + matched) == packed_get(label, matched))
+        matched++;
+    return matched;
 }
 
-/** @brief Dodaje przekierowanie.
- * Dodaje przekierowanie wszystkich numerów mających prefiks @p num1, na numery,
- * w których ten prefiks zamieniono odpowiednio na prefiks @p num2. Każdy numer
+/**
+ * @brief Ustawia dziecko węzła drzewa przekierowań.
+ * Działa tak jak funkcja child_set, aktualizując ilość węzłów z dziećmi.
+ * @param[in,out] pf - wskaźnik na strukturę, do której należy węzeł;
+ * @param[in,out] parent - wskaźnik na węzeł;
+ * @param[in] value - wartość pierwszej cyfry etykiety dziecka;
+ * @param[in] child - wskaźnik na dziecko.
+ * @return true - jeśli alokowanie pamięci się powiodło.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool fwd_link(PhoneForward* pf, PhoneFwd* parent, int value, PhoneFwd* child) {
+    bool was_leaf = parent->children.mask == 0;
+    if (!child_set(&pf->pool, &parent->children, value, child))
+        return false;
+    pf->inner_nodes += was_leaf;
+    return true;
+}
+
+/**
+ * @brief Usuwa dziecko węzła drzewa przekierowań.
+ * Działa tak jak funkcja child_clear, aktualizując ilość węzłów z dziećmi.
+ * @param[in,out] pf - wskaźnik na strukturę, do której należy węzeł;
+ * @param[in,out] parent - wskaźnik na węzeł;
+ * @param[in] value - wartość pierwszej cyfry etykiety dziecka.
+ */
+static void fwd_unlink(PhoneForward* pf, PhoneFwd* parent, int value) {
+    bool was_leaf = parent->children.mask == 0;
+    child_clear(&pf->pool, &parent->children, value);
+    pf->inner_nodes -= !was_leaf && parent->children.mask == 0;
+}
+
+/**
+ * @brief Uwzględnia przekierowanie w statystykach struktury.
+ * @param[in,out] pf - wskaźnik na strukturę;
+ * @param[in] forwarded - prefiks, na który prowadzi przekierowanie;
+ * @param[in] depth - długość prefiksu przekierowywanego;
+ * @param[in] added - true przy dodaniu, false przy usunięciu przekierowania.
+ */
+static void count_rule(PhoneForward* pf, const uint8_t* forwarded, size_t depth,
+                       bool added) {
+    size_t bucket = depth < PHFWD_STATS_DEPTHS ? depth : PHFWD_STATS_DEPTHS - 1;
+    size_t bytes = prefix_size(prefix_length(forwarded));
+    if (added) {
+        pf->stats.rules++;
+        pf->stats.prefix_bytes += bytes;
+        pf->stats.depth_histogram[bucket]++;
+    }
+    else {
+        pf->stats.rules--;
+        pf->stats.prefix_bytes -= bytes;
+        pf->stats.depth_histogram[bucket]--;
+    }
+}
+
+/**
+ * @brief Zwalnia pamięć zajmowaną przez pojedynczy węzeł w drzewie przekierowań.
+ * Zwraca do puli pamięć zajmowaną przez pojedynczy węzeł w drzewie
+ * przekierowań, dzięki czemu zostanie ona użyta przy kolejnych alokacjach.
+ * Przekierowanie węzła musi zostać wcześniej odliczone od statystyk.
+ * @param[in,out] pf - wskaźnik na strukturę, do której należy węzeł;
+ * @param[in] pfd_node - wskaźnik na węzeł, który ma zostać usunięty.
+ */
+static void free_node(PhoneForward* pf, PhoneFwd * pfd_node) {
+    if (pfd_node == NULL)
+        return;
+    Pool* pool = &pf->pool;
+    pf->stats.forward_nodes--;
+    if (pfd_node->children.mask != 0)
+        pf->inner_nodes--;
+    prefix_free(pool, pfd_node->forwarded_prefix);
+    if (pfd_node->label_len > FWD_INLINE_LABEL)
+        pool_free(pool, pfd_node->label.heap, packed_bytes(pfd_node->label_len));
+    child_free(pool, &pfd_node->children);
+    pool_free(pool, pfd_node, sizeof(PhoneFwd));
+}
+
+/**
+ * @brief Przywraca zwartość drzewa przekierowań w okolicy węzła.
+ * Usuwa węzeł, jeśli nie przechowuje on przekierowania ani nie ma dzieci, i
+ * powtarza to dla jego przodków. Węzeł bez przekierowania z jednym dzieckiem
+ * jest scalany z tym dzieckiem, które przejmuje połączoną etykietę. Korzeń
+ * nigdy nie jest usuwany. Jeśli nie uda się alokować pamięci na połączoną
+ * etykietę, węzeł pozostaje w drzewie, co nie wpływa na wyniki wyszukiwania.
+ * @param[in,out] pf - wskaźnik na strukturę, do której należy węzeł;
+ * @param[in,out] pfd_node - wskaźnik na węzeł.
+ */
+static void fwd_compact(PhoneForward* pf, PhoneFwd* pfd_node) {
+    while (pfd_node != NULL && pfd_node->parent != NULL
+           && pfd_node->forwarded_prefix == NULL) {
+        int sons = POPCOUNT(pfd_node->children.mask);
+        if (sons > 1)
+            return;
+
+        PhoneFwd* parent = pfd_node->parent;
+        int slot = fwd_label_digit(pfd_node, 0);
+        if (sons == 1) {
+            PhoneFwd* only_son = child_slots(&pfd_node->children)[0];
+            int son_slot = fwd_label_digit(only_son, 0);
+            size_t length = pfd_node->label_len + only_son->label_len;
+            uint8_t stack_label[FWD_INLINE_LABEL];
+            uint8_t* merged = length <= 2 * sizeof(stack_label) ? stack_label
+                                                                : malloc(packed_bytes(length));
+            if (merged == NULL)
+                return;
+            merged[packed_bytes(length) - 1] = 0;
+            packed_copy(merged, 0, fwd_label(pfd_node), 0, pfd_node->label_len);
+            packed_copy(merged, pfd_node->label_len, fwd_label(only_son), 0,
+                        only_son->label_len);
+            bool relabeled = fwd_set_label(&pf->pool, only_son, merged, 0, length);
+            if (merged != stack_label)
+                free(merged);
+            if (!relabeled)
+                return;
+            only_son->parent = parent;
+            fwd_link(pf, parent, slot, only_son);
+            fwd_unlink(pf, pfd_node, son_slot);
+            free_node(pf, pfd_node);
+            return;
+        }
+        fwd_unlink(pf, parent, slot);
+        free_node(pf, pfd_node);
+        pfd_node = parent;
+    }
+}
+
+/** @brief Tworzy nową strukturę.
+ * Tworzy nową strukturę niezawierającą żadnych przekierowań.
+ * @return Wskaźnik na utworzoną strukturę lub NULL, gdy nie udało się
+ *         alokować pamięci.
+ */
+PhoneForward * phfwdNew(void) {
+    PhoneForward* new_struct = malloc(sizeof(PhoneForward));
+    if (new_struct == NULL)
+        return NULL;
+
+    pool_init(&new_struct->pool);
+    memset(&new_struct->stats, 0, sizeof(PhoneForwardStats));
+    new_struct->inner_nodes = 0;
+    new_struct->tree = phf_create_node(new_struct, NULL);
+    new_struct->backward_tree = phf_create_backward_node(new_struct, NULL);
+    new_struct->concurrent = NULL;
+    if (new_struct->tree == NULL || new_struct->backward_tree == NULL) {
+        pool_destroy(&new_struct->pool);
+        free(new_struct);
+        return NULL;
+    }
+    return new_struct;
+}
+
+/**
+ * @brief Wyznacza następne dziecko rodzica węzła.
+ * Pozycja węzła wśród rodzeństwa wynika z pierwszej cyfry jego etykiety, więc
+ * przejście po drzewie nie wymaga zapamiętywania pozycji na stosie.
+ * @param[in] pfd_node - wskaźnik na węzeł różny od korzenia.
+ * @return Wskaźnik na dziecko rodzica o najmniejszej cyfrze większej od
+ * cyfry węzła @p pfd_node lub NULL, jeśli takiego dziecka nie ma.
+ */
+static PhoneFwd * fwd_next_sibling(const PhoneFwd* pfd_node) {
+    const PhoneFwd* parent = pfd_node->parent;
+    unsigned later = parent->children.mask & ~((2u << fwd_label_digit(pfd_node, 0)) - 1);
+    return later != 0 ? fwd_child(parent, LOWEST_BIT(later)) : NULL;
+}
+
+/**
+ * @brief Wyznacza pierwszy liść poddrzewa.
+ * @param[in] pfd_node - wskaźnik na korzeń poddrzewa;
+ * @param[in,out] depth - wskaźnik na długość napisu opisującego korzeń
+ *                        poddrzewa, zamienianą na długość napisu liścia.
+ * @return Wskaźnik na liść osiągany przez schodzenie do pierwszych dzieci.
+ */
+static PhoneFwd * fwd_first_leaf(PhoneFwd* pfd_node, size_t* depth) {
+    while (pfd_node->children.mask != 0) {
+        pfd_node = child_slots(&pfd_node->children)[0];
+        *depth += pfd_node->label_len;
+    }
+    return pfd_node;
+}
+
+/**
+ * @brief Wyznacza następny węzeł poddrzewa poza poddrzewem danego węzła.
+ * Wraca w górę do najbliższego przodka mającego kolejne dziecko.
+ * @param[in] pfd_node - wskaźnik na bieżący węzeł;
+ * @param[in] subtree - wskaźnik na korzeń przechodzonego poddrzewa.
+ * @return Wskaźnik na następny węzeł w kolejności prefiksowej, który nie
+ * należy do poddrzewa węzła @p pfd_node, lub NULL, gdy takiego węzła nie ma.
+ */
+static PhoneFwd * fwd_next_outside(PhoneFwd* pfd_node, const PhoneFwd* subtree) {
+    while (pfd_node != subtree) {
+        PhoneFwd* sibling = fwd_next_sibling(pfd_node);
+        if (sibling != NULL)
+            return sibling;
+        pfd_node = pfd_node->parent;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Wyznacza następny węzeł poddrzewa w kolejności prefiksowej.
+ * Pozwala przejść poddrzewo bez stosu: schodzi do pierwszego dziecka, a gdy
+ * go nie ma, wraca w górę do najbliższego przodka mającego kolejne dziecko.
+ * @param[in] pfd_node - wskaźnik na bieżący węzeł;
+ * @param[in] subtree - wskaźnik na korzeń przechodzonego poddrzewa.
+ * @return Wskaźnik na następny węzeł lub NULL, gdy poddrzewo zostało przejrzane.
+ */
+static PhoneFwd * fwd_next_preorder(PhoneFwd* pfd_node, const PhoneFwd* subtree) {
+    if (pfd_node->children.mask != 0)
+        return child_slots(&pfd_node->children)[0];
+    return fwd_next_outside(pfd_node, subtree);
+}
+
+/**
+ * @brief Wyznacza najbliższe przekierowania węzłów poddrzewa.
+ * Ustawia pole rule węzła @p subtree i jego potomków w kolejności
+ * prefiksowej: węzeł z przekierowaniem wskazuje na siebie, a pozostałe
+ * przejmują wartość rodzica. Przy kompilacji całego drzewa przechodzi
+ * wszystkie węzły. W przeciwnym przypadku pomija poddrzewa potomków z
+ * przekierowaniem, których wartości nie zależą od przodków, więc koszt jest
+ * proporcjonalny do liczby węzłów, na które wpływa zmiana w @p subtree.
+ * @param[in,out] subtree - wskaźnik na korzeń poddrzewa;
+ * @param[in] compile - czy wyznaczyć wartości wszystkich węzłów poddrzewa.
+ */
+static void fwd_spread_rule(PhoneFwd* subtree, bool compile) {
+    PhoneFwd* node = subtree;
+    while (node != NULL) {
+        bool own = node->forwarded_prefix != NULL;
+        node->rule = own ? node : node->parent == NULL ? NULL : node->parent->rule;
+        node = own && !compile && node != subtree ? fwd_next_outside(node, subtree)
+                                                  : fwd_next_preorder(node, subtree);
+    }
+}
+
+/**
+ * @brief Wyszukuje węzeł drzewa odwróconych przekierowań opisany prefiksem.
+ * @param[in] pbd_node - wskaźnik na korzeń drzewa odwróconych przekierowań;
+ * @param[in] prefix - prefiks w zapisie upakowanym.
+ * @return Wskaźnik na węzeł lub NULL, jeśli takiego węzła nie ma.
+ */
+static PhoneBwd * bwd_find(PhoneBwd* pbd_node, const uint8_t* prefix) {
+    const uint8_t* digits = prefix_digits(prefix);
+    size_t length = prefix_length(prefix);
+    for (size_t iterator = 0; iterator < length && pbd_node != NULL; iterator++)
+        pbd_node = bwd_child(pbd_node, packed_get(digits, iterator));
+    return pbd_node;
+}
+
+/**
+ * @brief Usuwa węzeł drzewa przekierowań z tablicy węzła odwróconych przekierowań.
+ * Wstawia na pozycję usuwanego węzła ostatni element tablicy.
+ * @param[in,out] pbd_node - wskaźnik na węzeł drzewa odwróconych przekierowań;
+ * @param[in] pfd_node - wskaźnik na usuwany węzeł, należący do tablicy.
+ */
+static void bwd_remove(PhoneBwd* pbd_node, const PhoneFwd* pfd_node) {
+    if (pfd_node->witnesses > 0)
+        pbd_node->duplicates--;
+    PhoneFwd* moved = pbd_node->forwarding[--pbd_node->size];
+    pbd_node->forwarding[pfd_node->backward_index] = moved;
+    moved->backward_index = pfd_node->backward_index;
+}
+
+/** @brief Usuwa pojedyncze odwrócone przekierowanie z drzewa odwróconych przekierowań.
+ * Usuwa węzeł @p pfd_node z tablicy węzła drzewa odwróconych przekierowań
+ * opisanego jego przekierowaniem. Węzeł pamięta swoją pozycję w tej tablicy,
+ * więc usunięcie polega na wstawieniu na nią ostatniego elementu i nie zależy
+ * od ilości przekierowań na ten sam prefiks.
+ * @param[in] pfd_backward_node – wskaźnik na korzeń drzewa odwróconych przekierowań;
+ * @param[in] pfd_node - wskaźnik na węzeł drzewa przekierowań z przekierowaniem.
+ */
+static void delete_forward_from_bwd(PhoneBwd * pfd_backward_node, PhoneFwd* pfd_node) {
+    pfd_backward_node = bwd_find(pfd_backward_node, pfd_node->forwarded_prefix);
+    if (pfd_backward_node != NULL)
+        bwd_remove(pfd_backward_node, pfd_node);
+}
+
+/**
+ * @brief Sprawdza, czy węzeł należy do tablicy węzła odwróconych przekierowań.
+ * @param[in] pbd_node - wskaźnik na węzeł drzewa odwróconych przekierowań;
+ * @param[in] pfd_node - wskaźnik na węzeł drzewa przekierowań.
+ * @return true - jeśli węzeł @p pfd_node przekierowuje na prefiks węzła
+ * @p pbd_node.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool bwd_holds(const PhoneBwd* pbd_node, const PhoneFwd* pfd_node) {
+    return pfd_node->forwarded_prefix != NULL && pfd_node->backward_index < pbd_node->size
+           && pbd_node->forwarding[pfd_node->backward_index] == pfd_node;
+}
+
+/**
+ * @brief Zlicza krótsze przekierowania dające ten sam numer co przekierowanie.
+ * Przekierowanie z @p num1 na @p num2 daje w wyniku funkcji phfwdReverse ten
+ * sam numer co przekierowanie między prefiksami tych napisów, które powstają
+ * przez odcięcie tej samej niepustej końcówki. Przechodzi w górę obu drzew
+ * jednocześnie, dopóki odcinane końcówki są równe.
+ * @param[in] pfd_node - wskaźnik na węzeł opisany napisem @p num1;
+ * @param[in] pbd_node - wskaźnik na węzeł opisany napisem @p num2;
+ * @param[in] num1 - napis opisujący węzeł @p pfd_node;
+ * @param[in] num2 - napis opisujący węzeł @p pbd_node;
+ * @param[in] num2_len - długość napisu @p num2.
+ * @return Ilość takich krótszych przekierowań.
+ */
+static uint32_t count_witnesses(const PhoneFwd* pfd_node, const PhoneBwd* pbd_node,
+                                const char* num1, const char* num2, size_t num2_len) {
+    size_t num1_len = pfd_node->depth;
+    uint32_t witnesses = 0;
+    for (size_t cut = 1; cut < num1_len && cut < num2_len
+                         && num1[num1_len - cut] == num2[num2_len - cut]; cut++) {
+        pbd_node = pbd_node->parent;
+        while (pfd_node->depth > num1_len - cut)
+            pfd_node = pfd_node->parent;
+        if (pfd_node->depth == num1_len - cut && bwd_holds(pbd_node, pfd_node))
+            witnesses++;
+    }
+    return witnesses;
+}
+
+/**
+ * @brief Uaktualnia liczniki powtórzeń przekierowań z poddrzewa węzła.
+ * Przekierowanie węzła @p pfd_node na prefiks węzła @p pbd_node powtarza
+ * numery tych przekierowań z poddrzewa, które wydłużają oba prefiksy o tę
+ * samą końcówkę. Przechodzi poddrzewo węzła @p pfd_node i jednocześnie
+ * schodzi w drzewie odwróconych przekierowań po tych samych cyfrach, pomijając
+ * poddrzewa bez przekierowań i końcówki nieobecne w drzewie odwróconych
+ * przekierowań.
+ * @param[in,out] pfd_node - wskaźnik na węzeł z dodawanym lub usuwanym
+ *                           przekierowaniem;
+ * @param[in,out] pbd_node - wskaźnik na węzeł, na którego prefiks prowadzi
+ *                           to przekierowanie;
+ * @param[in] added - czy przekierowanie jest dodawane.
+ */
+static void adjust_witnesses(PhoneFwd* pfd_node, PhoneBwd* pbd_node, bool added) {
+    if (pfd_node->rules_below == 0)
+        return;
+    // Węzeł drzewa odwróconych przekierowań odpowiadający przodkowi bieżącego
+    // węzła o długości napisu probe_depth.
+    PhoneBwd* probe = pbd_node;
+    size_t probe_depth = pfd_node->depth;
+    PhoneFwd* node = child_slots(&pfd_node->children)[0];
+    while (node != NULL) {
+        for (; probe_depth > node->parent->depth; probe_depth--)
+            probe = probe->parent;
+        PhoneBwd* target = probe;
+        for (size_t i = 0; i < node->label_len && target != NULL; i++)
+            target = bwd_child(target, fwd_label_digit(node, i));
+        if (target == NULL) {
+            node = fwd_next_outside(node, pfd_node);
+            continue;
+        }
+        probe = target;
+        probe_depth = node->depth;
+        if (bwd_holds(target, node)) {
+            if (added && node->witnesses++ == 0)
+                target->duplicates++;
+            else if (!added && --node->witnesses == 0)
+                target->duplicates--;
+        }
+        node = node->rules_below > 0 ? fwd_next_preorder(node, pfd_node)
+                                     : fwd_next_outside(node, pfd_node);
+    }
+}
+
+/** @brief Usuwa grupę węzłów z przekierowaniami.
+ * Funkcja pomocnicza dla funkcji delete_tree. Wyszukuje węzły drzewa
+ * odwróconych przekierowań dla wszystkich węzłów grupy jednocześnie, schodząc
+ * w każdym kroku o jeden poziom na każdej ścieżce i sprowadzając z
+ * wyprzedzeniem kolejny węzeł. Dzięki temu oczekiwanie na pamięć dla różnych
+ * ścieżek się nakłada. Następnie usuwa węzły z tablic odwróconych przekierowań
+ * i zwalnia je.
+ * @param[in,out] pf - wskaźnik na strukturę, do której należą węzły;
+ * @param[in] batch - tablica węzłów z przekierowaniami;
+ * @param[in] count - ilość węzłów w tablicy, nie większa od @ref DELETE_BATCH.
+ */
+static void release_rules(PhoneForward* pf, PhoneFwd** batch, size_t count) {
+    PhoneBwd* targets[DELETE_BATCH];
+    for (size_t i = 0; i < count; i++)
+        targets[i] = pf->backward_tree;
+
+    for (size_t depth = 0, active = count; active > 0; depth++) {
+        active = 0;
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t* prefix = batch[i]->forwarded_prefix;
+            if (targets[i] == NULL || depth >= prefix_length(prefix))
+                continue;
+            targets[i] = bwd_child(targets[i], packed_get(prefix_digits(prefix), depth));
+            if (targets[i] != NULL) {
+                PREFETCH(targets[i]);
+                active++;
+            }
+        }
+    }
+
+    // Usunięcie węzła może przesunąć w tablicy inny węzeł grupy, więc węzły są
+    // zwalniane dopiero po usunięciu wszystkich.
+    for (size_t i = 0; i < count; i++)
+        if (targets[i] != NULL)
+            bwd_remove(targets[i], batch[i]);
+    for (size_t i = 0; i < count; i++)
+        free_node(pf, batch[i]);
+}
+
+/**
+ * @brief Zwalnia pamięć zajmowaną przez węzeł i wszystkich jego potomków.
+ * Funkcja pomocnicza dla funkcji delete_tree. Usuwa również odpowiadające
+ * węzłom odwrócone przekierowania z drzewa odwrotnych przekierowań, ale nie
+ * zmienia rodzica węzła.
+ * Poddrzewo jest przechodzone raz, w kolejności wstecznej, bez zmieniania
+ * tablic dzieci i bez alokowania pamięci: pozycję węzła wśród rodzeństwa
+ * wyznacza pierwsza cyfra jego etykiety, a powrót umożliwia wskaźnik na
+ * rodzica. Węzły z przekierowaniami są usuwane grupami po @ref DELETE_BATCH.
+ * Czas działania jest liniowy względem rozmiaru poddrzewa.
+ * @param[in,out] pf Struktura, do której należy węzeł;
+ * @param[in] pfd_node Węzeł różny od korzenia, który należy zwolnić.
+ */
+static void release_subtree(PhoneForward * pf, PhoneFwd * pfd_node) {
+    size_t depth = fwd_depth(pfd_node);
+    PhoneFwd* batch[DELETE_BATCH];
+    size_t batched = 0;
+    PhoneFwd* node = fwd_first_leaf(pfd_node, &depth);
+    for (;;) {
+        // Następnik jest wyznaczany przed zwolnieniem węzła, a rodzic jest
+        // zwalniany dopiero po wszystkich dzieciach.
+        PhoneFwd* next = node == pfd_node ? NULL : fwd_next_sibling(node);
+        PhoneFwd* parent = node->parent;
+        size_t node_depth = depth;
+        depth -= node->label_len;
+        if (next != NULL) {
+            depth += next->label_len;
+            next = fwd_first_leaf(next, &depth);
+        }
+
+        if (node->forwarded_prefix == NULL) {
+            free_node(pf, node);
+        }
+        else {
+            // Węzeł musi istnieć aż do usunięcia go z drzewa odwróconych przekierowań.
+            count_rule(pf, node->forwarded_prefix, node_depth, false);
+            batch[batched++] = node;
+            if (batched == DELETE_BATCH) {
+                release_rules(pf, batch, batched);
+                batched = 0;
+            }
+        }
+        if (node == pfd_node)
+            break;
+        node = next != NULL ? next : parent;
+    }
+    release_rules(pf, batch, batched);
+}
+
+/**
+ * @brief Zwalnia pamięć zajmowaną przez węzeł i wszystkich jego potomków i usuwa ich z drzewa.
+ * Zwalnia pamięć zajmowaną przez węzeł i wszystkich jego potomków i usuwa ich
+ * z drzewa przekierowań. Usuwa również odpowiadające im odwrócone
+ * przekierowania z drzewa odwrotnych przekierowań.
+ * Wskaźnik na usuwany węzeł w tablicy dzieci rodzica jest usuwany, a rodzic
+ * jest w razie potrzeby scalany z pozostałym dzieckiem.
+ * @param[in,out] pf Struktura, do której należy węzeł;
+ * @param[in] pfd_node Węzeł różny od korzenia, który należy usunąć.
+ */
+static void delete_tree(PhoneForward * pf, PhoneFwd * pfd_node) {
+    if (pfd_node == NULL)
+        return;
+
+    PhoneFwd * delete_border = pfd_node->parent;
+    size_t removed = pfd_node->rules_below + (pfd_node->forwarded_prefix != NULL);
+    for (PhoneFwd* ancestor = delete_border; ancestor != NULL; ancestor = ancestor->parent)
+        ancestor->rules_below -= removed;
+    fwd_unlink(pf, delete_border, fwd_label_digit(pfd_node, 0));
+    release_subtree(pf, pfd_node);
+    fwd_compact(pf, delete_border);
+}
+
+/** @brief Usuwa strukturę.
+ * Usuwa strukturę wskazywaną przez @p pf. Nic nie robi, jeśli wskaźnik ten ma
+ * wartość NULL. Węzły obu drzew i ich napisy są zwalniane razem z pulą pamięci,
+ * bez przechodzenia po drzewach.
+ * @param[in] pf – wskaźnik na usuwaną strukturę.
+ */
+void phfwdDelete(PhoneForward *pf) {
+    if (pf == NULL)
+        return;
+    if (pf->concurrent != NULL) {
+        phfwdDelete(pf->concurrent->copies[0]);
+        phfwdDelete(pf->concurrent->copies[1]);
+        free(pf->concurrent->pending);
+        pthread_mutex_destroy(&pf->concurrent->writer);
+        free(pf->concurrent);
+    }
+    pool_destroy(&pf->pool);
+    free(pf);
+}
+
+/** @brief Tworzy nową strukturę w trybie współbieżnym.
+ * Tworzy nową strukturę niezawierającą żadnych przekierowań, której funkcje
+ * @ref phfwdGet, @ref phfwdGetInto, @ref phfwdGetBatch, @ref phfwdReverse i
+ * @ref phfwdGetReverse mogą być wywoływane jednocześnie z wielu wątków i nigdy
+ * nie czekają na blokadę. Odczytują one opublikowaną kopię przekierowań,
+ * której nikt w tym czasie nie modyfikuje. Funkcje @ref phfwdAdd i
+ * @ref phfwdRemove mogą być wywoływane jednocześnie z odczytami i między sobą.
+ * Są wzajemnie wykluczane i wykonują zmianę w drugiej kopii, publikują ją,
+ * czekają na zakończenie odczytów poprzedniej kopii i powtarzają w niej tę
+ * samą zmianę. Koszt modyfikacji jest więc około dwukrotnie większy niż poza
+ * trybem współbieżnym i nie zależy od rozmiaru struktury, a struktura zajmuje
+ * dwukrotnie więcej pamięci. Jeśli w poprzedniej kopii zabraknie pamięci,
+ * zmiana jest zapamiętywana i wykonywana w niej przed następną zmianą. Jeśli
+ * to też się nie powiedzie, następna zmiana nie jest wykonywana, a funkcja
+ * zwraca @p false. Funkcja @ref phfwdDelete nie może być wywołana
+ * jednocześnie z innymi funkcjami.
+ * @return Wskaźnik na utworzoną strukturę lub NULL, gdy nie udało się
+ *         alokować pamięci.
+ */
+PhoneForward * phfwdNewConcurrent(void) {
+    PhoneForward* new_struct = malloc(sizeof(PhoneForward));
+    ConcurrentState* state = malloc(sizeof(ConcurrentState));
+    if (new_struct == NULL || state == NULL || pthread_mutex_init(&state->writer, NULL) != 0) {
+        free(state);
+        free(new_struct);
+        return NULL;
+    }
+    state->copies[0] = phfwdNew();
+    state->copies[1] = phfwdNew();
+    if (state->copies[0] == NULL || state->copies[1] == NULL) {
+        phfwdDelete(state->copies[0]);
+        phfwdDelete(state->copies[1]);
+        pthread_mutex_destroy(&state->writer);
+        free(state);
+        free(new_struct);
+        return NULL;
+    }
+    atomic_init(&state->snapshot, state->copies[0]);
+    state->pending = NULL;
+    state->pending_size = 0;
+    state->pending_cap = 0;
+    epoch_init(&state->epoch);
+
+    // Przekierowania są tylko w kopiach, więc sama struktura nie ma drzew.
+    pool_init(&new_struct->pool);
+    memset(&new_struct->stats, 0, sizeof(PhoneForwardStats));
+    new_struct->inner_nodes = 0;
+    new_struct->tree = NULL;
+    new_struct->backward_tree = NULL;
+    new_struct->concurrent = state;
+    return new_struct;
+}
+
+/**
+ * @brief Sprawdza, czy parametry podane do funkcji @p phfwdAdd są poprawne.
+ * Funkcja pomocnicza dla funkcji @p phfwdAdd. Sprawdza, czy oba napisy
+ * reprezentują numery i czy są różne. Zwraca odpowiednią wartość logiczną.
+ * Dodatkowo zapisuje sprawdzone numery wraz z kodami ich cyfr.
+ * @param[in] pf - wskaźnik na korzeń drzewa przekierowań;
+ * @param[in] num1 - wskaźnik na napis przekierowywany;
+ * @param[in] num2 - wkaźnik na napis, na który należy dodać przekierowanie;
+ * @param[out] number1 - wskaźnik na strukturę na numer @p num1;
+ * @param[out] number2 - wskaźnik na strukturę na numer @p num2.
+ * @return true - parametry funkcji są poprawne.
+ * @return false - parametry funkcji są niepoprawne.
+ */
+static bool check_parameters(PhoneForward *pf, char const *num1, char const *num2,
+                             Number* number1, Number* number2) {
+    if (pf == NULL || !number_parse(number1, num1) || !number_parse(number2, num2))
+        return false;
+    // Przekierowanie numeru na niego samego jest niepoprawne.
+    return number1->length != number2->length
+           || memcmp(num1, num2, number1->length) != 0;
+}
+
+/**
+ * @brief Przygotowuje węzeł drzewa odwróconych przekierowań na nowe przekierowanie.
+ * Wyszukuje węzeł opisany napisem @p num2, tworząc brakujące węzły, i
+ * zapewnia miejsce na @p count kolejnych elementów w jego tablicy,
+ * powiększając ją w razie potrzeby co najmniej dwukrotnie. Dzięki temu dodanie przekierowania do węzła, po
+ * zmianie drzewa przekierowań, nie może się już nie powieść.
+ * @param[in,out] pf - wskaźnik na strukturę, do której należy drzewo;
+ * @param[in] pbd_node - wskaźnik na węzeł opisany pierwszymi @p depth cyframi
+ *                       numeru @p num2, np. na korzeń drzewa odwróconych
+ *                       przekierowań;
+ * @param[in] depth - ilość cyfr opisujących węzeł @p pbd_node;
+ * @param[in] num2 - numer, na który ma zostać dodane przekierowanie;
+ * @param[in] count - ilość przekierowań, dla których zapewnić miejsce.
+ * @return Wskaźnik na węzeł lub NULL, gdy nie udało się alokować pamięci.
+ */
+static PhoneBwd * reserve_backward_node(PhoneForward* pf, PhoneBwd * pbd_node,
+                                        size_t depth, const Number* num2, size_t count) {
+    Pool* pool = &pf->pool;
+    // Poprawność danych została sprawdzona w funkcji phfwdAdd.
+    for (size_t iterator = depth; iterator < num2->length; iterator++) {
+        int value = number_digit(num2, iterator);
+        PhoneBwd* son = bwd_child(pbd_node, value);
+        if (son == NULL) {
+            son = phf_create_backward_node(pf, pbd_node);
+            if (son == NULL)
+                return NULL;
+            if (!child_set(pool, &pbd_node->children, value, son)) {
+                pool_free(pool, son, sizeof(PhoneBwd));
+                pf->stats.backward_nodes--;
+                return NULL;
+            }
+        }
+        pbd_node = son;
+    }
+
+    if (pbd_node->size + count > pbd_node->capacity) {
+        size_t new_capacity = pbd_node->capacity * 2;
+        if (new_capacity < pbd_node->size + count)
+            new_capacity = pbd_node->size + count;
+        PhoneFwd** resized = pool_realloc(pool, pbd_node->forwarding,
+                                          sizeof(PhoneFwd*) * pbd_node->capacity,
+                                          sizeof(PhoneFwd*) * new_capacity);
+        if (resized == NULL)
+            return NULL;
+        pbd_node->forwarding = resized;
+        pf->stats.backward_bytes += sizeof(PhoneFwd*) * (new_capacity - pbd_node->capacity);
+        pbd_node->capacity = new_capacity;
+    }
+    return pbd_node;
+}
+
+/** @brief Dodaje węzeł drzewa przekierowań do węzła drzewa odwróconych przekierowań.
+ * Dopisuje węzeł @p pfd_node na koniec tablicy węzła @p pbd_node i zapamiętuje
+ * w nim jego pozycję. Miejsce w tablicy musi zostać wcześniej zapewnione przez
+ * funkcję reserve_backward_node.
+ * @param[in, out] pbd_node – wskaźnik na węzeł, do którego dodajemy przekierowanie;
+ * @param[in, out] pfd_node - węzeł drzewa przekierowań z przekierowaniem.
+ */
+static void add_to_backward_node(PhoneBwd* pbd_node, PhoneFwd* pfd_node) {
+    if (pfd_node->witnesses > 0)
+        pbd_node->duplicates++;
+    pfd_node->backward_index = (uint32_t)pbd_node->size;
+    pbd_node->forwarding[pbd_node->size++] = pfd_node;
+}
+
+/**
+ * @brief Dzieli krawędź prowadzącą do węzła.
+ * Wstawia między węzeł @p son a jego rodzica nowy węzeł, który przejmuje
+ * pierwsze @p matched znaków etykiety węzła @p son. W przypadku błędu drzewo
+ * pozostaje niezmienione.
+ * @param[in,out] pf - wskaźnik na strukturę, do której należy węzeł;
+ * @param[in,out] son - wskaźnik na węzeł różny od korzenia;
+ * @param[in] matched - długość wspólnej części etykiety, mniejsza od długości
+ *                      etykiety i dodatnia.
+ * @return Wskaźnik na nowy węzeł lub NULL, gdy nie udało się alokować pamięci.
+ */
+static PhoneFwd * fwd_split(PhoneForward* pf, PhoneFwd* son, size_t matched) {
+    PhoneFwd* parent = son->parent;
+    int value = fwd_label_digit(son, 0);
+    PhoneFwd* middle = phf_create_node(pf, parent);
+    if (middle == NULL)
+        return NULL;
+    if (!fwd_set_label(&pf->pool, middle, fwd_label(son), 0, matched)
+        || !fwd_link(pf, middle, fwd_label_digit(son, matched), son)
+        || !fwd_set_label(&pf->pool, son, fwd_label(son), matched,
+                          son->label_len - matched)) {
+        free_node(pf, middle);
+        return NULL;
+    }
+    son->parent = middle;
+    middle->depth = parent->depth + (uint32_t)matched;
+    middle->rules_below = son->rules_below + (son->forwarded_prefix != NULL);
+    fwd_link(pf, parent, value, middle);
+    return middle;
+}
+
+/**
+ * @brief Wyszukuje lub tworzy węzeł drzewa przekierowań opisany podanym numerem.
+ * Przechodzi po drzewie przekierowań po znakach napisu @p num, dzieląc
+ * krawędź, jeśli numer kończy się lub różni w środku jej etykiety. Brakującą
+ * końcówkę numeru dodaje jako pojedynczy liść. Przejście zaczyna się od węzła
+ * @p pfd_node, więc przy wstawianiu posortowanych numerów można zacząć od
+ * miejsca rozejścia z poprzednim numerem zamiast od korzenia.
+ * @param[in,out] pf - wskaźnik na strukturę przechowującą przekierowania;
+ * @param[in,out] pfd_node - wskaźnik na korzeń drzewa przekierowań lub na
+ *                           węzeł, którego napis jest prefiksem numeru @p num;
+ * @param[in] num - numer opisujący węzeł.
+ * @return Wskaźnik na węzeł opisany numerem @p num lub NULL, gdy nie udało się
+ * alokować pamięci.
+ */
+static PhoneFwd * fwd_insert(PhoneForward* pf, PhoneFwd* pfd_node, const Number* num) {
+    size_t iterator = pfd_node->depth, length = num->length;
+    while (iterator < length) {
+        int value = number_digit(num, iterator);
+        PhoneFwd* son = fwd_child(pfd_node, value);
+        if (son == NULL) {
+            son = phf_create_node(pf, pfd_node);
+            if (son == NULL || !fwd_set_label_ascii(&pf->pool, son, num->str + iterator,
+                                                      length - iterator)
+                || !fwd_link(pf, pfd_node, value, son)) {
+                free_node(pf, son);
+                fwd_compact(pf, pfd_node);
+                return NULL;
+            }
+            son->depth = (uint32_t)length;
+            return son;
+        }
+
+        size_t matched = fwd_match_label(son, num, iterator);
+        if (matched < son->label_len) {
+            son = fwd_split(pf, son, matched);
+            if (son == NULL)
+                return NULL;
+        }
+        pfd_node = son;
+        iterator += son->label_len;
+    }
+    return pfd_node;
+}
+
+/**
+ * @brief Zapisuje przekierowanie w węźle drzewa przekierowań.
+ * Zastępuje dotychczasowe przekierowanie węzła, jeśli takie było, i
+ * uaktualnia tablice odwróconych przekierowań, liczniki przekierowań w
+ * poddrzewach, najbliższe przekierowania potomków oraz liczniki powtórzeń.
+ * Nie alokuje pamięci, więc nie może się nie powieść.
+ * @param[in,out] pf - wskaźnik na strukturę, do której należy węzeł;
+ * @param[in,out] pfd_node - wskaźnik na węzeł opisany napisem @p num1;
+ * @param[in,out] pbd_node - wskaźnik na węzeł opisany napisem @p num2 z
+ *                           miejscem zapewnionym przez funkcję
+ *                           reserve_backward_node;
+ * @param[in] forwarded - prefiks @p num2 utworzony funkcją prefix_create;
+ * @param[in] num1 - napis opisujący węzeł @p pfd_node;
+ * @param[in] num2 - napis, na który prowadzi przekierowanie;
+ * @param[in] num2_len - długość napisu @p num2.
+ */
+static void fwd_set_rule(PhoneForward* pf, PhoneFwd* pfd_node, PhoneBwd* pbd_node,
+                         uint8_t* forwarded, const char* num1, const char* num2,
+                         size_t num2_len) {
+    if (pfd_node->forwarded_prefix != NULL) {
+        adjust_witnesses(pfd_node, bwd_find(pf->backward_tree, pfd_node->forwarded_prefix),
+                         false);
+        delete_forward_from_bwd(pf->backward_tree, pfd_node);
+        count_rule(pf, pfd_node->forwarded_prefix, pfd_node->depth, false);
+        prefix_free(&pf->pool, pfd_node->forwarded_prefix);
+    }
+    else {
+        for (PhoneFwd* ancestor = pfd_node->parent; ancestor != NULL; ancestor = ancestor->parent)
+            ancestor->rules_below++;
+    }
+    bool spread = pfd_node->forwarded_prefix == NULL;
+    pfd_node->forwarded_prefix = forwarded;
+    // Zastąpienie przekierowania nie zmienia węzłów, na które ono wskazuje.
+    if (spread)
+        fwd_spread_rule(pfd_node, false);
+    count_rule(pf, forwarded, pfd_node->depth, true);
+    pfd_node->witnesses = count_witnesses(pfd_node, pbd_node, num1, num2, num2_len);
+    add_to_backward_node(pbd_node, pfd_node);
+    adjust_witnesses(pfd_node, pbd_node, true);
+}
+
+/**
+ * @brief Dodaje przekierowanie.
+ * Funkcja pomocnicza dla funkcji phfwdAdd. Dodaje przekierowanie do drzew bez
+ * publikowania go w trybie współbieżnym.
+ * @param[in,out] pf - wskaźnik na strukturę przechowującą przekierowania;
+ * @param[in] num1 - wskaźnik na napis reprezentujący prefiks numerów
+ *                   przekierowywanych;
+ * @param[in] num2 - wskaźnik na napis reprezentujący prefiks numerów,
+ *                   na które jest wykonywane przekierowanie.
+ * @return true - jeśli przekierowanie zostało dodane.
+ * @return false - jeśli parametry są niepoprawne lub nie udało się alokować
+ * pamięci.
+ */
+static bool forward_add(PhoneForward *pf, char const *num1, char const *num2) {
+    Number number1, number2;
+    if (!check_parameters(pf, num1, num2, &number1, &number2))
+        return false;
+    uint8_t* forwarded = prefix_create(&pf->pool, num2, number2.length);
+    if (forwarded == NULL)
+        return false;
+    // Dodawanie numeru do drzewa prefiksowego.
+    PhoneFwd * pfd_node = fwd_insert(pf, pf->tree, &number1);
+    if (pfd_node == NULL) {
+        prefix_free(&pf->pool, forwarded);
+        return false;
+    }
+    // Wszystkie alokacje poprzedzają zmiany, więc błąd nie narusza spójności drzew.
+    PhoneBwd * pbd_node = reserve_backward_node(pf, pf->backward_tree, 0, &number2, 1);
+    if (pbd_node == NULL) {
+        prefix_free(&pf->pool, forwarded);
+        fwd_compact(pf, pfd_node);
+        return false;
+    }
+
+    fwd_set_rule(pf, pfd_node, pbd_node, forwarded, num1, num2, number2.length);
+    return true;
+}
+
+/**
+ * Zmiana wykonywana kolejno na obu kopiach przekierowań w trybie współbieżnym.
+ * Zwraca false, jeśli nie udało się alokować pamięci. Kopia pozostaje wtedy
+ * niezmieniona.
+ */
+typedef bool (*ConcurrentChange)(PhoneForward* copy, void* arg);
+
+/**
+ * @brief Wykonuje w kopii przekierowań zapamiętane zmiany.
+ * Funkcja pomocnicza dla funkcji concurrent_write. Zmiany są wykonywane
+ * kolejno, tak jak funkcjami phfwdAdd i phfwdRemove. Wykonanie całego ciągu
+ * takich zmian po jego początkowym fragmencie daje ten sam wynik co wykonanie
+ * go raz, więc po błędzie ciąg pozostaje zapamiętany w całości. Koszt jest
+ * proporcjonalny do ilości zapamiętanych zmian, a nie do rozmiaru struktury.
+ * @param[in,out] state - wskaźnik na stan trybu współbieżnego;
+ * @param[in,out] copy - wskaźnik na nieopublikowaną kopię przekierowań.
+ * @return true - jeśli kopia jest równa opublikowanej.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool concurrent_catch_up(ConcurrentState* state, PhoneForward* copy) {
+    for (size_t used = 0; used < state->pending_size;) {
+        const char* num1 = state->pending + used;
+        const char* num2 = num1 + strlen(num1) + 1;
+        used = (size_t)(num2 - state->pending) + strlen(num2) + 1;
+        if (num2[0] == '\0')
+            phfwdRemove(copy, num1);
+        else if (!forward_add(copy, num1, num2))
+            return false;
+    }
+    state->pending_size = 0;
+    return true;
+}
+
+/**
+ * @brief Zapewnia miejsce na zapamiętanie zmiany.
+ * @param[in,out] state - wskaźnik na stan trybu współbieżnego;
+ * @param[in] num1 - tablica prefiksów przekierowywanych lub usuwanych;
+ * @param[in] num2 - tablica prefiksów docelowych, z NULL przy usunięciach;
+ * @param[in] count - ilość zmian.
+ * @return true - jeśli miejsce zostało zapewnione.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool concurrent_reserve(ConcurrentState* state, char const * const *num1,
+                               char const * const *num2, size_t count) {
+    size_t size = state->pending_size;
+    for (size_t i = 0; i < count; i++)
+        size += strlen(num1[i]) + (num2[i] == NULL ? 0 : strlen(num2[i])) + 2;
+    if (size <= state->pending_cap)
+        return true;
+    char* grown = realloc(state->pending, size);
+    if (grown == NULL)
+        return false;
+    state->pending = grown;
+    state->pending_cap = size;
+    return true;
+}
+
+/**
+ * @brief Zapamiętuje zmianę, której brakuje w nieopublikowanej kopii.
+ * Miejsce musi być zapewnione funkcją concurrent_reserve, więc zapamiętanie
+ * nie może się nie powieść.
+ * @param[in,out] state - wskaźnik na stan trybu współbieżnego;
+ * @param[in] num1 - tablica prefiksów przekierowywanych lub usuwanych;
+ * @param[in] num2 - tablica prefiksów docelowych, z NULL przy usunięciach;
+ * @param[in] count - ilość zmian.
+ */
+static void concurrent_record(ConcurrentState* state, char const * const *num1,
+                              char const * const *num2, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        size_t len1 = strlen(num1[i]) + 1, len2 = num2[i] == NULL ? 0 : strlen(num2[i]);
+        memcpy(state->pending + state->pending_size, num1[i], len1);
+        state->pending_size += len1;
+        if (num2[i] != NULL)
+            memcpy(state->pending + state->pending_size, num2[i], len2);
+        state->pending[state->pending_size + len2] = '\0';
+        state->pending_size += len2 + 1;
+    }
+}
+
+/**
+ * @brief Wykonuje zmianę w trybie współbieżnym.
+ * Uzupełnia nieopublikowaną kopię o zapamiętane zmiany, wykonuje w niej
+ * zmianę i publikuje ją jednym atomowym zapisem wskaźnika. Następnie czeka,
+ * aż żaden czytelnik nie korzysta z poprzedniej kopii, i wykonuje w niej tę
+ * samą zmianę, więc obie kopie znowu są równe. Jeśli w poprzedniej kopii
+ * zabraknie pamięci, zmiana jest zapamiętywana w miejscu zapewnionym przed
+ * jej wykonaniem. Zmiana musi być opisana kolejnymi dodaniami i usunięciami,
+ * chyba że nie może się nie powieść.
+ * @param[in,out] pf - wskaźnik na strukturę w trybie współbieżnym;
+ * @param[in] change - wykonywana zmiana;
+ * @param[in,out] arg - parametr zmiany;
+ * @param[in] num1 - tablica prefiksów przekierowywanych lub usuwanych;
+ * @param[in] num2 - tablica prefiksów docelowych, z NULL przy usunięciach;
+ * @param[in] count - ilość dodań i usunięć opisujących zmianę.
+ * @return true - jeśli zmiana została opublikowana.
+ * @return false - jeśli nie udało się alokować pamięci. Czytelnicy widzą
+ * wtedy niezmienioną strukturę.
+ */
+static bool concurrent_write(PhoneForward* pf, ConcurrentChange change, void* arg,
+                             char const * const *num1, char const * const *num2,
+                             size_t count) {
+    ConcurrentState* state = pf->concurrent;
+    pthread_mutex_lock(&state->writer);
+    PhoneForward* shown = atomic_load(&state->snapshot);
+    PhoneForward* hidden = state->copies[state->copies[0] == shown];
+    bool result = concurrent_catch_up(state, hidden)
+                  && concurrent_reserve(state, num1, num2, count) && change(hidden, arg);
+    if (result) {
+        atomic_store(&state->snapshot, hidden);
+        epoch_synchronize(&state->epoch);
+        if (!change(shown, arg))
+            concurrent_record(state, num1, num2, count);
+    }
+    if (state->pending_size == 0 && state->pending_cap > PENDING_KEEP) {
+        free(state->pending);
+        state->pending = NULL;
+        state->pending_cap = 0;
+    }
+    pthread_mutex_unlock(&state->writer);
+    return result;
+}
+
+/**
+ * @brief Dodaje przekierowanie do kopii przekierowań.
+ * Zmiana wykonywana przez funkcję phfwdAdd w trybie współbieżnym.
+ * @param[in,out] copy - wskaźnik na kopię przekierowań;
+ * @param[in] arg - tablica dwóch poprawnych napisów @p num1 i @p num2.
+ * @return true - jeśli przekierowanie zostało dodane.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool concurrent_add(PhoneForward* copy, void* arg) {
+    const char** numbers = arg;
+    return forward_add(copy, numbers[0], numbers[1]);
+}
+
+/** @brief Dodaje przekierowanie.
+ * Dodaje przekierowanie wszystkich numerów mających prefiks @p num1, na numery,
+ * w których ten prefiks zamieniono odpowiednio na prefiks @p num2. Każdy numer
  * jest swoim własnym prefiksem. Jeśli wcześniej zostało dodane przekierowanie
  * z takim samym parametrem @p num1, to jest ono zastępowane.
- * Relacja przekierowania numerów nie jest przechodnia.
+ * Relacja przekierowania numerów nie jest przechodnia. W trybie współbieżnym
+ * przekierowanie jest widoczne dla czytelników od chwili zwrócenia wartości
+ * @p true, a wartość @p false oznacza, że czytelnicy go nie zobaczą.
+ * @param[in,out] pf – wskaźnik na strukturę przechowującą przekierowania
+ *                     numerów;
+ * @param[in] num1   – wskaźnik na napis reprezentujący prefiks numerów
+ *                     przekierowywanych;
+ * @param[in] num2   – wskaźnik na napis reprezentujący prefiks numerów,
+ *                     na które jest wykonywane przekierowanie.
+ * @return Wartość @p true, jeśli przekierowanie zostało dodane.
+ *         Wartość @p false, jeśli wystąpił błąd, np. podany napis nie
+ *         reprezentuje numeru, oba podane numery są identyczne lub nie udało
+ *         się alokować pamięci.
+ */
+bool phfwdAdd(PhoneForward *pf, char const *num1, char const *num2) {
+    if (pf == NULL || num1 == NULL || num2 == NULL)
+        return false;
+    if (pf->concurrent == NULL)
+        return forward_add(pf, num1, num2);
+
+    // Niepoprawne parametry są odrzucane przed zmianą którejkolwiek kopii.
+    Number number1, number2;
+    if (!check_parameters(pf, num1, num2, &number1, &number2))
+        return false;
+    const char* numbers[2] = {num1, num2};
+    return concurrent_write(pf, concurrent_add, numbers, &num1, &num2, 1);
+}
+
+/**
+ * To jest struktura opisująca pojedyncze przekierowanie ładowane hurtowo.
+ */
+struct BulkRule {
+    const char* num1;           ///< Prefiks numerów przekierowywanych.
+    size_t num1_len;            ///< Długość prefiksu @p num1.
+    const char* num2;           ///< Prefiks, na który jest wykonywane przekierowanie.
+    size_t num2_len;            ///< Długość prefiksu @p num2.
+    size_t order;               ///< Pozycja przekierowania w danych wejściowych.
+    PhoneFwd* node;             ///< Węzeł drzewa przekierowań z tym przekierowaniem.
+    PhoneBwd* target;           ///< Węzeł drzewa odwróconych przekierowań opisany @p num2.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct BulkRule BulkRule;
+
+/**
+ * @brief Porównuje przekierowania według przekierowywanych prefiksów.
+ * Przekierowania z takim samym prefiksem są porządkowane według pozycji w
+ * danych wejściowych.
+ * @param[in] a - wskaźnik na pierwsze przekierowanie;
+ * @param[in] b - wskaźnik na drugie przekierowanie.
+ * @return Liczba ujemna, zero lub dodatnia, jak w funkcji strcmp.
+ */
+static int bulk_by_num1(const void* a, const void* b) {
+    const BulkRule* first = a;
+    const BulkRule* second = b;
+    int result = strcmp(first->num1, second->num1);
+    if (result != 0)
+        return result;
+    return (first->order > second->order) - (first->order < second->order);
+}
+
+/**
+ * @brief Porównuje wskaźniki na przekierowania według prefiksów docelowych.
+ * @param[in] a - wskaźnik na wskaźnik na pierwsze przekierowanie;
+ * @param[in] b - wskaźnik na wskaźnik na drugie przekierowanie.
+ * @return Liczba ujemna, zero lub dodatnia, jak w funkcji strcmp.
+ */
+static int bulk_by_num2(const void* a, const void* b) {
+    const BulkRule* first = *(const BulkRule* const*)a;
+    const BulkRule* second = *(const BulkRule* const*)b;
+    return strcmp(first->num2, second->num2);
+}
+
+/**
+ * @brief Wyznacza długość najdłuższego wspólnego prefiksu dwóch napisów.
+ * @param[in] first - pierwszy napis;
+ * @param[in] second - drugi napis.
+ * @return Długość wspólnego prefiksu.
+ */
+static size_t common_prefix(const char* first, const char* second) {
+    size_t iterator = 0;
+    while (first[iterator] != '\0' && first[iterator] == second[iterator])
+        iterator++;
+    return iterator;
+}
+
+/**
+ * To jest struktura opisująca fragment tablicy przekierowań o wspólnym
+ * prefiksie, który czeka na podział według kolejnej cyfry.
+ */
+struct BulkSegment {
+    size_t first;               ///< Pozycja pierwszego przekierowania fragmentu.
+    size_t count;               ///< Ilość przekierowań fragmentu.
+    size_t depth;               ///< Długość wspólnego prefiksu.
+    /// Węzeł drzewa odwróconych przekierowań opisany wspólnym prefiksem lub
+    /// NULL, jeśli fragment jest tylko porządkowany.
+    PhoneBwd* node;
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct BulkSegment BulkSegment;
+
+/**
+ * @brief Dzieli fragment przekierowań według cyfry na danej pozycji.
+ * Stabilnie porządkuje przekierowania według znaku na pozycji @p depth
+ * prefiksów @p num1 lub @p num2. Pierwszą grupę tworzą prefiksy o długości
+ * @p depth, a kolejne prefiksy z cyfrą o kolejnej wartości. Znak każdego
+ * przekierowania jest odczytywany raz.
+ * @param[in,out] rules - fragment tablicy wskaźników na przekierowania;
+ * @param[out] buffer - tablica pomocnicza na @p count wskaźników;
+ * @param[out] keys - tablica pomocnicza na @p count numerów grup;
+ * @param[in] count - ilość przekierowań fragmentu;
+ * @param[in] depth - długość wspólnego prefiksu przekierowań fragmentu;
+ * @param[in] by_num2 - czy przekierowania są dzielone według prefiksów @p num2;
+ * @param[out] bounds - tablica na @ref BULK_GROUPS + 1 pozycji początków
+ *                      kolejnych grup i końca fragmentu.
+ */
+static void bulk_partition(BulkRule** rules, BulkRule** buffer, uint8_t* keys,
+                           size_t count, size_t depth, bool by_num2, size_t* bounds) {
+    size_t sizes[BULK_GROUPS] = {0};
+    for (size_t i = 0; i < count; i++) {
+        const char* num = by_num2 ? rules[i]->num2 : rules[i]->num1;
+        size_t length = by_num2 ? rules[i]->num2_len : rules[i]->num1_len;
+        keys[i] = (uint8_t)(depth == length ? 0 : convert_to_number(num[depth]) + 1);
+        sizes[keys[i]]++;
+    }
+    bounds[0] = 0;
+    for (int group = 0; group < BULK_GROUPS; group++)
+        bounds[group + 1] = bounds[group] + sizes[group];
+    if (sizes[keys[0]] == count)
+        return;
+
+    size_t next[BULK_GROUPS];
+    memcpy(next, bounds, sizeof(next));
+    for (size_t i = 0; i < count; i++)
+        buffer[next[keys[i]]++] = rules[i];
+    memcpy(rules, buffer, sizeof(BulkRule*) * count);
+}
+
+/**
+ * @brief Porządkuje przekierowania według prefiksów @p num1.
+ * Funkcja pomocnicza dla funkcji bulk_load_empty. Dzieli wskaźniki na
+ * przekierowania według kolejnych cyfr, zaczynając od pierwszej, tak jak
+ * w sortowaniu pozycyjnym, więc nie porównuje całych napisów, a same
+ * przekierowania przenosi raz, na końcu. Przekierowania o tym samym prefiksie
+ * pozostają w kolejności z danych wejściowych. Porządek cyfr jest porządkiem
+ * dzieci w drzewie, a nie porządkiem funkcji strcmp. W przypadku błędu
+ * tablica pozostaje niezmieniona.
+ * @param[in,out] rules - tablica przekierowań;
+ * @param[in] count - ilość przekierowań;
+ * @param[in] max_len - długość najdłuższego prefiksu @p num1.
+ * @return true - jeśli przekierowania zostały uporządkowane.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool bulk_sort(BulkRule* rules, size_t count, size_t max_len) {
+    BulkRule** sorted = malloc(sizeof(BulkRule*) * count);
+    BulkRule** buffer = malloc(sizeof(BulkRule*) * count);
+    uint8_t* keys = malloc(count);
+    BulkSegment* stack = malloc(sizeof(BulkSegment) * (HOW_MANY_NUMBERS * max_len + 1));
+    BulkRule* copy = malloc(sizeof(BulkRule) * count);
+    bool result = sorted != NULL && buffer != NULL && keys != NULL && stack != NULL
+                  && copy != NULL;
+    size_t top = 0;
+    if (result) {
+        for (size_t i = 0; i < count; i++)
+            sorted[i] = &rules[i];
+        stack[top++] = (BulkSegment){0, count, 0, NULL};
+    }
+
+    while (result && top > 0) {
+        BulkSegment segment = stack[--top];
+        size_t bounds[BULK_GROUPS + 1];
+        bulk_partition(sorted + segment.first, buffer, keys, segment.count,
+                       segment.depth, false, bounds);
+        for (int group = 1; group < BULK_GROUPS; group++)
+            if (bounds[group + 1] - bounds[group] > 1)
+                stack[top++] = (BulkSegment){segment.first + bounds[group],
+                                             bounds[group + 1] - bounds[group],
+                                             segment.depth + 1, NULL};
+    }
+    if (result) {
+        memcpy(copy, rules, sizeof(BulkRule) * count);
+        for (size_t i = 0; i < count; i++)
+            rules[i] = copy[sorted[i] - rules];
+    }
+    free(sorted);
+    free(buffer);
+    free(keys);
+    free(stack);
+    free(copy);
+    return result;
+}
+
+/**
+ * @brief Dodaje liść z przekierowaniem podczas ładowania hurtowego.
+ * W przypadku błędu liść jest zwalniany, a rodzic pozostaje niezmieniony.
+ * @param[in,out] pf - wskaźnik na budowaną strukturę;
+ * @param[in,out] parent - wskaźnik na rodzica nowego liścia;
+ * @param[in,out] rule - przekierowanie zapisywane w liściu;
+ * @param[in] depth - długość prefiksu @p rule->num1 opisanego rodzicem.
+ * @return Wskaźnik na nowy liść lub NULL, gdy nie udało się alokować pamięci.
+ */
+static PhoneFwd * bulk_leaf(PhoneForward* pf, PhoneFwd* parent, BulkRule* rule,
+                            size_t depth) {
+    PhoneFwd* leaf = phf_create_node(pf, parent);
+    if (leaf == NULL)
+        return NULL;
+    leaf->forwarded_prefix = prefix_create(&pf->pool, rule->num2, rule->num2_len);
+    if (leaf->forwarded_prefix == NULL
+        || !fwd_set_label_ascii(&pf->pool, leaf, rule->num1 + depth, rule->num1_len - depth)
+        || !fwd_link(pf, parent, convert_to_number(rule->num1[depth]), leaf)) {
+        free_node(pf, leaf);
+        return NULL;
+    }
+    leaf->depth = (uint32_t)rule->num1_len;
+    count_rule(pf, leaf->forwarded_prefix, rule->num1_len, true);
+    rule->node = leaf;
+    return leaf;
+}
+
+/**
+ * @brief Buduje drzewo przekierowań z posortowanych przekierowań.
+ * Funkcja pomocnicza dla funkcji phfwdBulkLoad. Przekierowania muszą być
+ * posortowane według prefiksów @p num1 i mieć różne prefiksy. Na stosie
+ * pamiętana jest ścieżka do ostatnio dodanego liścia, więc każde
+ * przekierowanie dodawane jest od miejsca rozejścia z poprzednim, bez
+ * przechodzenia od korzenia. Liczniki przekierowań w poddrzewach są
+ * uzupełniane przy zdejmowaniu węzłów ze stosu. Drzewo może być budowane
+ * pod dowolnym węzłem bez dzieci, jeśli napisy wszystkich przekierowań są
+ * dłuższe od napisu tego węzła. W przypadku błędu zbudowane węzły pozostają
+ * połączone, ale liczniki przekierowań w poddrzewach mogą być niepełne.
+ * @param[in,out] built - wskaźnik na strukturę, do której należy @p root;
+ * @param[in,out] root - wskaźnik na węzeł bez dzieci, pod którym budowane
+ *                       jest drzewo;
+ * @param[in,out] rules - tablica przekierowań;
+ * @param[in] count - ilość przekierowań;
+ * @param[in] max_len - długość najdłuższego prefiksu @p num1.
+ * @return true - jeśli drzewo zostało zbudowane.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool bulk_build_forward(PhoneForward* built, PhoneFwd* root, BulkRule* rules,
+                               size_t count, size_t max_len) {
+    PhoneFwd** path = malloc(sizeof(PhoneFwd*) * (max_len + 1));
+    size_t* ends = malloc(sizeof(size_t) * (max_len + 1));
+    bool result = path != NULL && ends != NULL;
+    size_t top = 0;
+    if (result) {
+        path[0] = root;
+        ends[0] = root->depth;
+    }
+
+    for (size_t i = 0; i < count && result; i++) {
+        size_t common = i == 0 ? ends[0] : common_prefix(rules[i - 1].num1, rules[i].num1);
+        // Zdjęcie ze stosu węzłów, do których poddrzew nic już nie zostanie dodane.
+        while (result && ends[top] > common) {
+            PhoneFwd* node = path[top];
+            if (ends[top - 1] < common) {
+                // Podział krawędzi: nowy węzeł zajmuje miejsce na stosie.
+                PhoneFwd* middle = fwd_split(built, node, common - ends[top - 1]);
+                result = middle != NULL;
+                path[top] = middle;
+                ends[top] = common;
+                break;
+            }
+            node->parent->rules_below += node->rules_below + (node->forwarded_prefix != NULL);
+            top--;
+        }
+        if (!result)
+            break;
+
+        PhoneFwd* leaf = bulk_leaf(built, path[top], &rules[i], common);
+        result = leaf != NULL;
+        path[++top] = leaf;
+        ends[top] = rules[i].num1_len;
+    }
+
+    for (; result && top > 0; top--)
+        path[top]->parent->rules_below += path[top]->rules_below
+                                          + (path[top]->forwarded_prefix != NULL);
+    free(path);
+    free(ends);
+    return result;
+}
+
+/**
+ * @brief Zapisuje przekierowania w węźle drzewa odwróconych przekierowań.
+ * Funkcja pomocnicza dla funkcji bulk_build_backward. Alokuje tablicę
+ * o dokładnym rozmiarze i zapisuje w przekierowaniach węzeł, na który prowadzą.
+ * @param[in,out] built - wskaźnik na budowaną strukturę;
+ * @param[in,out] pbd_node - wskaźnik na węzeł bez przekierowań;
+ * @param[in,out] group - tablica wskaźników na przekierowania na ten węzeł;
+ * @param[in] count - ilość przekierowań.
+ * @return true - jeśli przekierowania zostały zapisane.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool bulk_backward_rules(PhoneForward* built, PhoneBwd* pbd_node, BulkRule** group,
+                                size_t count) {
+    pbd_node->forwarding = pool_alloc(&built->pool, sizeof(PhoneFwd*) * count);
+    if (pbd_node->forwarding == NULL)
+        return false;
+    pbd_node->capacity = count;
+    built->stats.backward_bytes += sizeof(PhoneFwd*) * count;
+    for (size_t i = 0; i < count; i++) {
+        add_to_backward_node(pbd_node, group[i]->node);
+        group[i]->target = pbd_node;
+    }
+    return true;
+}
+
+/**
+ * @brief Buduje drzewo odwróconych przekierowań.
+ * Funkcja pomocnicza dla funkcji phfwdBulkLoad. Dzieli przekierowania
+ * według kolejnych cyfr prefiksów @p num2, tak jak w sortowaniu pozycyjnym,
+ * i przy każdym podziale od razu tworzy dzieci węzła dla niepustych grup oraz
+ * tablicę o dokładnym rozmiarze dla prefiksów, które się kończą. Drzewo
+ * powstaje więc w tym samym przebiegu co porządek, bez porównywania napisów.
+ * Pojedyncze przekierowanie dostaje od razu całą pozostałą ścieżkę. Zapisuje
+ * w przekierowaniach węzły, na które prowadzą. W przypadku błędu cała pula
+ * musi zostać zwolniona.
+ * @param[in,out] built - wskaźnik na strukturę ze zbudowanym drzewem
+ *                        przekierowań;
+ * @param[in,out] rules - tablica przekierowań;
+ * @param[in] count - ilość przekierowań;
+ * @param[in] max_len - długość najdłuższego prefiksu @p num2.
+ * @return true - jeśli drzewo zostało zbudowane.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool bulk_build_backward(PhoneForward* built, BulkRule* rules,
+                                size_t count, size_t max_len) {
+    BulkRule** sorted = malloc(sizeof(BulkRule*) * count);
+    BulkRule** buffer = malloc(sizeof(BulkRule*) * count);
+    uint8_t* keys = malloc(count);
+    BulkSegment* stack = malloc(sizeof(BulkSegment) * (HOW_MANY_NUMBERS * max_len + 1));
+    bool result = sorted != NULL && buffer != NULL && keys != NULL && stack != NULL;
+    size_t top = 0;
+    if (result) {
+        for (size_t i = 0; i < count; i++)
+            sorted[i] = &rules[i];
+        stack[top++] = (BulkSegment){0, count, 0, built->backward_tree};
+    }
+
+    while (result && top > 0) {
+        BulkSegment segment = stack[--top];
+        BulkRule** group = sorted + segment.first;
+        PhoneBwd* pbd_node = segment.node;
+        if (segment.count == 1) {
+            for (size_t depth = segment.depth; result && depth < group[0]->num2_len; depth++) {
+                PhoneBwd* son = phf_create_backward_node(built, pbd_node);
+                result = son != NULL
+                         && child_set(&built->pool, &pbd_node->children,
+                                      convert_to_number(group[0]->num2[depth]), son);
+                pbd_node = son;
+            }
+            result = result && bulk_backward_rules(built, pbd_node, group, 1);
+            continue;
+        }
+
+        size_t bounds[BULK_GROUPS + 1];
+        bulk_partition(group, buffer, keys, segment.count, segment.depth, true, bounds);
+        if (bounds[1] > 0)
+            result = bulk_backward_rules(built, pbd_node, group, bounds[1]);
+        // Dzieci są tworzone w kolejności cyfr, więc zawsze trafiają na koniec tablicy.
+        for (int value = 0; result && value < HOW_MANY_NUMBERS; value++) {
+            if (bounds[value + 2] == bounds[value + 1])
+                continue;
+            PhoneBwd* son = phf_create_backward_node(built, pbd_node);
+            result = son != NULL && child_set(&built->pool, &pbd_node->children, value, son);
+            stack[top++] = (BulkSegment){segment.first + bounds[value + 1],
+                                         bounds[value + 2] - bounds[value + 1],
+                                         segment.depth + 1, son};
+        }
+    }
+    free(sorted);
+    free(buffer);
+    free(keys);
+    free(stack);
+    return result;
+}
+
+/**
+ * @brief Ładuje przekierowania do pustej struktury.
+ * Funkcja pomocnicza dla funkcji phfwdBulkLoad. Buduje oba drzewa w osobnej
+ * puli pamięci i podmienia nimi drzewa struktury @p pf dopiero po udanym
+ * zbudowaniu, więc w przypadku błędu struktura pozostaje pusta.
+ * @param[in,out] pf - wskaźnik na pustą strukturę;
+ * @param[in,out] rules - tablica poprawnych przekierowań;
+ * @param[in] count - ilość przekierowań;
+ * @param[in] max1 - długość najdłuższego prefiksu @p num1;
+ * @param[in] max2 - długość najdłuższego prefiksu @p num2.
+ * @return true - jeśli przekierowania zostały załadowane.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool bulk_load_empty(PhoneForward* pf, BulkRule* rules, size_t count,
+                            size_t max1, size_t max2) {
+    bool ordered = true;
+    for (size_t i = 1; i < count && ordered; i++)
+        ordered = bulk_by_num1(&rules[i - 1], &rules[i]) < 0;
+    if (!ordered && !bulk_sort(rules, count, max1))
+        return false;
+    // Z przekierowań o tym samym prefiksie obowiązuje ostatnie dodane.
+    size_t distinct = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (distinct > 0 && strcmp(rules[distinct - 1].num1, rules[i].num1) == 0)
+            distinct--;
+        rules[distinct++] = rules[i];
+    }
+
+    PhoneForward built;
+    pool_init(&built.pool);
+    built.concurrent = NULL;
+    memset(&built.stats, 0, sizeof(PhoneForwardStats));
+    built.inner_nodes = 0;
+    built.tree = phf_create_node(&built, NULL);
+    built.backward_tree = phf_create_backward_node(&built, NULL);
+    if (built.tree == NULL || built.backward_tree == NULL
+        || !bulk_build_forward(&built, built.tree, rules, distinct, max1)
+        || !bulk_build_backward(&built, rules, distinct, max2)) {
+        pool_destroy(&built.pool);
+        return false;
+    }
+    fwd_spread_rule(built.tree, true);
+    for (size_t i = 0; i < distinct; i++) {
+        PhoneFwd* node = rules[i].node;
+        node->witnesses = count_witnesses(node, rules[i].target, rules[i].num1, rules[i].num2,
+                                          rules[i].num2_len);
+        rules[i].target->duplicates += node->witnesses > 0;
+    }
+    pool_destroy(&pf->pool);
+    pf->pool = built.pool;
+    pf->tree = built.tree;
+    pf->backward_tree = built.backward_tree;
+    pf->stats = built.stats;
+    pf->inner_nodes = built.inner_nodes;
+    return true;
+}
+
+/**
+ * @brief Dodaje sprawdzone przekierowania.
+ * Funkcja pomocnicza dla funkcji phfwdBulkLoad. Pustą strukturę buduje od
+ * nowa, a do niepustej dodaje przekierowania pojedynczo.
+ * @param[in,out] pf - wskaźnik na strukturę spoza trybu współbieżnego;
+ * @param[in,out] rules - tablica poprawnych przekierowań, która może zostać
+ *                        uporządkowana;
+ * @param[in] count - ilość przekierowań;
+ * @param[in] max1 - długość najdłuższego prefiksu @p num1;
+ * @param[in] max2 - długość najdłuższego prefiksu @p num2.
+ * @return true - jeśli przekierowania zostały dodane.
+ * @return false - jeśli nie udało się alokować pamięci. Niepusta struktura
+ * może zawierać wtedy część przekierowań.
+ */
+static bool bulk_apply(PhoneForward* pf, BulkRule* rules, size_t count,
+                       size_t max1, size_t max2) {
+    if (pf->tree->children.mask == 0 && count > 0)
+        return bulk_load_empty(pf, rules, count, max1, max2);
+    bool result = true;
+    for (size_t i = 0; i < count && result; i++)
+        result = forward_add(pf, rules[i].num1, rules[i].num2);
+    return result;
+}
+
+/** @brief Dodaje wiele przekierowań naraz.
+ * Dodaje przekierowania z @p num1[i] na @p num2[i] dla kolejnych @p i,
+ * tak jakby zostały dodane kolejnymi wywołaniami funkcji @ref phfwdAdd.
+ * Przekierowania nie muszą być posortowane. Jeśli struktura nie zawiera
+ * żadnych przekierowań, są one porządkowane podziałem według kolejnych cyfr,
+ * bez porównywania całych napisów, chyba że już są posortowane. Drzewo
+ * przekierowań jest budowane w jednym przebiegu po uporządkowanych
+ * przekierowaniach, bez wyszukiwania każdego z nich od korzenia, a drzewo
+ * odwróconych przekierowań powstaje w trakcie takiego samego podziału według
+ * prefiksów docelowych, z tablicami o dokładnym rozmiarze. W przeciwnym
+ * przypadku przekierowania są dodawane pojedynczo. W trybie współbieżnym
+ * przekierowania są dodawane jak w transakcji zatwierdzanej funkcją
+ * @ref phfwdTxnCommit, w całości albo wcale, i publikowane razem.
+ * @param[in,out] pf – wskaźnik na strukturę przechowującą przekierowania
+ *                     numerów;
+ * @param[in] num1   – tablica napisów reprezentujących prefiksy numerów
+ *                     przekierowywanych;
+ * @param[in] num2   – tablica napisów reprezentujących prefiksy numerów,
+ *                     na które są wykonywane przekierowania;
+ * @param[in] count  – ilość przekierowań.
+ * @return Wartość @p true, jeśli wszystkie przekierowania zostały dodane.
+ *         Wartość @p false, jeśli któraś para napisów nie jest poprawnym
+ *         przekierowaniem lub nie udało się alokować pamięci. Wtedy struktura
+ *         pozostaje niezmieniona, chyba że zawierała już przekierowania,
+ *         nie jest w trybie współbieżnym i zabrakło pamięci w trakcie
+ *         dodawania.
+ */
+bool phfwdBulkLoad(PhoneForward *pf, char const * const *num1,
+                   char const * const *num2, size_t count) {
+    if (pf == NULL || (count > 0 && (num1 == NULL || num2 == NULL)))
+        return false;
+    if (pf->concurrent != NULL) {
+        PhoneForwardTxn* txn = phfwdTxnBegin(pf);
+        bool staged = txn != NULL;
+        for (size_t i = 0; i < count && staged; i++)
+            staged = phfwdTxnAdd(txn, num1[i], num2[i]);
+        if (staged)
+            return phfwdTxnCommit(txn);
+        phfwdTxnAbort(txn);
+        return false;
+    }
+
+    BulkRule* rules = malloc(sizeof(BulkRule) * (count == 0 ? 1 : count));
+    if (rules == NULL)
+        return false;
+    size_t max1 = 0, max2 = 0;
+    for (size_t i = 0; i < count; i++) {
+        Number number1, number2;
+        if (!check_parameters(pf, num1[i], num2[i], &number1, &number2)) {
+            free(rules);
+            return false;
+        }
+        size_t num1_len = number1.length, num2_len = number2.length;
+        rules[i] = (BulkRule){num1[i], num1_len, num2[i], num2_len, i, NULL, NULL};
+        max1 = num1_len > max1 ? num1_len : max1;
+        max2 = num2_len > max2 ? num2_len : max2;
+    }
+
+    bool result = bulk_apply(pf, rules, count, max1, max2);
+    free(rules);
+    return result;
+}
+
+/**
+ * @brief Sprawdza, czy znak rozdziela napisy w pliku z przekierowaniami.
+ * @param[in] c - sprawdzany znak.
+ * @return true - jeśli znak jest białym znakiem lub znakiem '\0'.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool is_separator(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v'
+           || c == '\f' || c == '\0';
+}
+
+/** @brief Ładuje przekierowania z pliku.
+ * Wczytuje plik @p path, zawierający pary numerów @p num1 @p num2 rozdzielone
+ * białymi znakami, np. po jednej parze w wierszu, i dodaje je funkcją
+ * @ref phfwdBulkLoad. Cały plik jest wczytywany do jednego bufora, a numery
+ * nie są kopiowane przed zbudowaniem drzew.
  * @param[in,out] pf – wskaźnik na strukturę przechowującą przekierowania
  *                     numerów;
- * @param[in] num1   – wskaźnik na napis reprezentujący prefiks numerów
- *                     przekierowywanych;
- * @param[in] num2   – wskaźnik na napis reprezentujący prefiks numerów,
- *                     na które jest wykonywane przekierowanie.
- * @return Wartość @p true, jeśli przekierowanie zostało dodane.
- *         Wartość @p false, jeśli wystąpił błąd, np. podany napis nie
- *         reprezentuje numeru, oba podane numery są identyczne lub nie udało
- *         się alokować pamięci.
+ * @param[in] path   – ścieżka do pliku z przekierowaniami.
+ * @return Wartość @p true, jeśli wszystkie przekierowania zostały dodane.
+ *         Wartość @p false, jeśli nie udało się odczytać pliku, zawiera on
+ *         nieparzystą ilość napisów lub niepoprawne przekierowanie, bądź nie
+ *         udało się alokować pamięci.
+ */
+bool phfwdLoadFile(PhoneForward *pf, char const *path) {
+    if (pf == NULL || path == NULL)
+        return false;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+
+    char* buffer = NULL;
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0
+        && fseek(file, 0, SEEK_SET) == 0)
+        buffer = malloc((size_t)size + 1);
+    bool result = buffer != NULL && fread(buffer, 1, (size_t)size, file) == (size_t)size;
+    fclose(file);
+    if (!result) {
+        free(buffer);
+        return false;
+    }
+    buffer[size] = '\0';
+
+    // Podział bufora na napisy w miejscu.
+    size_t words = 0;
+    for (long i = 0; i < size; i++) {
+        if (is_separator(buffer[i]))
+            buffer[i] = '\0';
+        else if (i == 0 || buffer[i - 1] == '\0')
+            words++;
+    }
+    const char** numbers = malloc(sizeof(char*) * (words == 0 ? 1 : words));
+    result = numbers != NULL && words % 2 == 0;
+    if (result) {
+        // Napisy num1 trafiają do pierwszej, a num2 do drugiej połowy tablicy.
+        size_t word = 0;
+        for (long i = 0; i < size; i++)
+            if (buffer[i] != '\0' && (i == 0 || buffer[i - 1] == '\0')) {
+                numbers[word % 2 * (words / 2) + word / 2] = buffer + i;
+                word++;
+            }
+        result = phfwdBulkLoad(pf, numbers, numbers + words / 2, words / 2);
+    }
+    free(numbers);
+    free(buffer);
+    return result;
+}
+
+/**
+ * @brief Funkcja przechodząca do węzła drzewa po podanym napisie.
+ * Funkcja przyjmuje napis i przechodzi po drzewie przekierowań po znakach 
+ * tego napisu. Po przeczytaniu wszystkich znaków lub napotkaniu NULL-a w 
+ * drzewie kończy działanie. W przypadku sukcesu zwraca węzeł na, na którym
+ * zakończyło się działanie. Jeśli napis kończy się w środku etykiety krawędzi,
+ * zwracany jest węzeł, do którego ta krawędź prowadzi.
+ * @param[in] pfd_node - wskaźnik na korzeń drzewa przekierowań;
+ * @param[in] num - numer określający węzeł do którego funkcja ma się dostać.
+ * @return Wskaźnik na najpłytszy węzeł, którego napis ma prefiks @p num lub
+ * NULL w przypadku, gdy takiego węzła nie ma w drzewie.
+ */
+static PhoneFwd * go_to_prefix(PhoneFwd *pfd_node, const Number *num) {
+    size_t iterator = 0;
+
+    while (iterator < num->length) {
+        int value = number_digit(num, iterator);
+        PhoneFwd* son = fwd_child(pfd_node, value);
+        if (son == NULL) 
+            return NULL;
+
+        size_t matched = fwd_match_label(son, num, iterator);
+        iterator += matched;
+        // Numer kończący się w środku etykiety opisuje całe poddrzewo syna.
+        if (matched < son->label_len)
+            return iterator == num->length ? son : NULL;
+        pfd_node = son;
+    }
+    return pfd_node;
+}
+
+/**
+ * @brief Usuwa przekierowania z kopii przekierowań.
+ * Zmiana wykonywana przez funkcję phfwdRemove w trybie współbieżnym.
+ * @param[in,out] copy - wskaźnik na kopię przekierowań;
+ * @param[in] arg - poprawny napis reprezentujący prefiks numerów.
+ * @return Wartość true, bo usuwanie nie alokuje pamięci.
+ */
+static bool concurrent_remove(PhoneForward* copy, void* arg) {
+    phfwdRemove(copy, arg);
+    return true;
+}
+
+/** @brief Usuwa przekierowania.
+ * Usuwa wszystkie przekierowania, w których parametr @p num jest prefiksem
+ * parametru @p num1 użytego przy dodawaniu. Jeśli nie ma takich przekierowań
+ * lub napis nie reprezentuje numeru, nic nie robi. Usuwanie nie alokuje
+ * pamięci, ale w trybie współbieżnym przed nim wykonywane są zmiany, które
+ * wcześniej nie powiodły się w drugiej kopii przekierowań.
+ * @param[in,out] pf – wskaźnik na strukturę przechowującą przekierowania
+ *                     numerów;
+ * @param[in] num    – wskaźnik na napis reprezentujący prefiks numerów.
+ * @return Wartość @p false, jeśli @p pf ma wartość NULL lub w trybie
+ *         współbieżnym nie udało się alokować pamięci. Struktura pozostaje
+ *         wtedy niezmieniona. Wartość @p true w przeciwnym przypadku.
+ */
+bool phfwdRemove(PhoneForward *pf, char const *num) {
+    if (pf == NULL)
+        return false;
+    Number number;
+    if (!number_parse(&number, num))
+        return true;
+    // Usunięcie nie może się nie powieść w drugiej kopii, więc nie jest
+    // zapamiętywane.
+    if (pf->concurrent != NULL)
+        return concurrent_write(pf, concurrent_remove, (void*)num, NULL, NULL, 0);
+    delete_tree(pf, go_to_prefix(pf->tree, &number));
+    return true;
+}
+
+/**
+ * @brief Zwraca strukturę PhoneNumbers zawierającą przekierowanie numeru.
+ * Funkcja pomocnicza dla funkcji phfwdGet. Składa przekierowanie ze
+ * znalezionego prefiksu docelowego @p last i cyfr numeru @p num od pozycji
+ * @p last_depth.
+ * @param[in] num - poprawny numer, który należy przekierować;
+ * @param[in] last_depth - długość prefiksu numeru, dla którego znaleziono
+ *                         przekierowanie, lub 0;
+ * @param[in] last - prefiks, na który przekierowywany jest znaleziony prefiks
+ *                   numeru, lub NULL, jeśli numer nie jest przekierowany.
+ * @return Wskaźnik na strukturę przechowującą przekierowanie numeru lub NULL,
+ * gdy nie udało się alokować pamięci.
+ */
+static PhoneNumbers * get_last_number(const Number* num, size_t last_depth,
+                                      const uint8_t* last) {
+    size_t num_len = num->length;
+    size_t forwarded_len = last == NULL ? 0 : prefix_length(last);
+
+    size_t size = num_len - last_depth + forwarded_len + 1;
+    char* forwarded = malloc(sizeof(char) * size);
+    if (forwarded == NULL)
+        return NULL;
+
+    if (last != NULL)
+        prefix_write(last, forwarded); // przekierowana część
+    // pozostała końcówka wraz z '\0'
+    memcpy(forwarded + forwarded_len, num->str + last_depth, num_len - last_depth + 1);
+
+    PhoneNumbers * result = phn_create(&forwarded, 1);
+    free(forwarded);
+    return result;
+}
+
+/**
+ * @brief Wyszukuje najdłuższy prefiks numeru, dla którego dodano przekierowanie.
+ * Funkcja pomocnicza dla funkcji phfwdGet i phfwdGetInto. Schodzi po drzewie
+ * przekierowań po cyfrach numeru @p num do ostatniego w pełni dopasowanego
+ * węzła, który wskazuje najbliższe przekierowanie na swojej ścieżce.
+ * @param[in] probe - wskaźnik na korzeń drzewa przekierowań;
+ * @param[in] num - numer który należy przekierować;
+ * @param[out] last_depth - długość prefiksu, dla którego znaleziono przekierowanie.
+ * @return Prefiks, na który przekierowywany jest znaleziony prefiks numeru lub
+ * NULL, jeśli żaden prefiks numeru nie jest przekierowany.
+ */
+static const uint8_t * find_forwarding(PhoneFwd* probe, const Number* num,
+                                       size_t* last_depth) {
+    size_t iterator = 0;
+    while (iterator < num->length) {
+        int value = number_digit(num, iterator);
+        PhoneFwd* son = fwd_child(probe, value);
+        if (son == NULL || fwd_match_label(son, num, iterator) < son->label_len) 
+            break;
+        
+        probe = son;
+        iterator += son->label_len;
+    }
+    const PhoneFwd* rule = probe->rule;
+    *last_depth = rule == NULL ? 0 : rule->depth;
+    return rule == NULL ? NULL : rule->forwarded_prefix;
+}
+
+/**
+ * @brief Sprawdza, czy przekierowanie węzła jest przesłonięte dla danej końcówki.
+ * Funkcja pomocnicza dla funkcji phfwdGetReverse. Sprawdza, czy numer
+ * złożony z napisu opisującego węzeł @p pfd_node i końcówki numeru @p num od
+ * pozycji @p offset ma dłuższy przekierowany prefiks niż ten napis. Węzeł bez
+ * przekierowań w poddrzewie nie wymaga przechodzenia po drzewie.
+ * @param[in] pfd_node - wskaźnik na węzeł z przekierowaniem;
+ * @param[in] num - numer, którego końcówka jest dołączana do napisu węzła;
+ * @param[in] offset - pozycja początku końcówki w numerze.
+ * @return true - jeśli do numeru stosuje się przekierowanie z głębszego węzła.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool fwd_shadowed(const PhoneFwd* pfd_node, const Number* num, size_t offset) {
+    size_t iterator = offset;
+    while (pfd_node->rules_below != 0 && iterator < num->length) {
+        PhoneFwd* son = fwd_child(pfd_node, number_digit(num, iterator));
+        if (son == NULL || fwd_match_label(son, num, iterator) < son->label_len)
+            return false;
+        if (son->forwarded_prefix != NULL)
+            return true;
+        pfd_node = son;
+        iterator += son->label_len;
+    }
+    return false;
+}
+
+/** @brief Wyznacza przekierowanie numeru.
+ * Wyznacza przekierowanie podanego numeru. Szuka najdłuższego pasującego
+ * prefiksu. Wynikiem jest ciąg zawierający co najwyżej jeden numer. Jeśli dany
+ * numer nie został przekierowany, to wynikiem jest ciąg zawierający ten numer.
+ * Jeśli podany napis nie reprezentuje numeru, wynikiem jest pusty ciąg.
+ * Alokuje strukturę @p PhoneNumbers, która musi być zwolniona za pomocą
+ * funkcji @ref phnumDelete. Zwraca wartość NULL dla @p pf o wartości NULL.
+ * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci bądź dane wejściowe były niepoprawne.
+ */
+PhoneNumbers * phfwdGet(PhoneForward const *pf, char const *num) {
+    if (pf == NULL)
+        return NULL;
+    if (pf->concurrent != NULL) {
+        unsigned slot;
+        PhoneNumbers* result = phfwdGet(snapshot_acquire(pf, &slot), num);
+        snapshot_release(pf, slot);
+        return result;
+    }
+    Number number;
+    if (!number_parse(&number, num))
+        return phn_create(NULL, 0);
+
+    size_t last_depth;
+    const uint8_t* last = find_forwarding(pf->tree, &number, &last_depth);
+    return get_last_number(&number, last_depth, last);
+}
+
+/**
+ * @brief Zapisuje przekierowanie numeru do podanego bufora.
+ * Funkcja pomocnicza dla funkcji zapisujących wynik do bufora. Łączy
+ * prefiks @p last, na który przekierowano pierwsze @p last_depth cyfr numeru,
+ * z pozostałą końcówką numeru.
+ * @param[in] num - napis reprezentujący numer;
+ * @param[in] num_len - długość numeru;
+ * @param[in] last - prefiks, na który przekierowano numer lub NULL;
+ * @param[in] last_depth - długość przekierowanego prefiksu numeru;
+ * @param[out] out - wskaźnik na bufor na wynik;
+ * @param[in] cap - rozmiar bufora @p out w bajtach;
+ * @param[out] len - wskaźnik na długość wyniku lub NULL.
+ * @return true - jeśli wynik zmieścił się w buforze.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool splice_forwarding(const char* num, size_t num_len, const uint8_t* last,
+                              size_t last_depth, char* out, size_t cap, size_t* len) {
+    size_t forwarded_len = last == NULL ? 0 : prefix_length(last);
+    size_t result_len = forwarded_len + num_len - last_depth;
+    if (len != NULL)
+        *len = result_len;
+    if (out == NULL || cap <= result_len)
+        return false;
+
+    if (last != NULL)
+        prefix_write(last, out);
+    // Pozostała końcówka wraz z '\0'.
+    memcpy(out + forwarded_len, num + last_depth, num_len - last_depth + 1);
+    return true;
+}
+
+/** @brief Wyznacza przekierowanie numeru do podanego bufora.
+ * Wyznacza przekierowanie podanego numeru tak jak funkcja @ref phfwdGet, ale
+ * zamiast alokować strukturę @p PhoneNumbers zapisuje wynik wraz ze znakiem
+ * końca napisu w buforze @p out. Nie alokuje pamięci.
+ * @param[in] pf   – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num  – wskaźnik na napis reprezentujący numer;
+ * @param[out] out – wskaźnik na bufor na wynik;
+ * @param[in] cap  – rozmiar bufora @p out w bajtach;
+ * @param[out] len – wskaźnik na długość wyniku bez znaku końca napisu lub NULL.
+ *                   Ustawiana również wtedy, gdy wynik nie mieści się w
+ *                   buforze, a na 0, gdy napis nie reprezentuje numeru.
+ * @return Wartość @p true, jeśli wynik został zapisany w buforze.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL, napis nie reprezentuje
+ *         numeru lub wynik nie mieści się w buforze.
+ */
+bool phfwdGetInto(PhoneForward const *pf, char const *num, char *out,
+                  size_t cap, size_t *len) {
+    if (len != NULL)
+        *len = 0;
+    if (pf == NULL || num == NULL)
+        return false;
+    if (pf->concurrent != NULL) {
+        unsigned slot;
+        bool written = phfwdGetInto(snapshot_acquire(pf, &slot), num, out, cap, len);
+        snapshot_release(pf, slot);
+        return written;
+    }
+
+    Number number;
+    if (!number_parse(&number, num))
+        return false;
+
+    size_t last_depth;
+    const uint8_t* last = find_forwarding(pf->tree, &number, &last_depth);
+    return splice_forwarding(num, number.length, last, last_depth, out, cap, len);
+}
+
+/**
+ * To jest struktura przechowująca stan wyszukiwania pojedynczego numeru
+ * w funkcji phfwdGetBatch.
+ */
+struct BatchLane {
+    Number number;                  ///< Wyszukiwany numer; pusty, jeśli jest niepoprawny.
+    PhoneFwd* node;                 ///< Bieżący węzeł drzewa przekierowań.
+    size_t depth;                   ///< Ilość dopasowanych cyfr numeru.
+    const PhoneFwd* matched;        ///< Ostatni w pełni dopasowany węzeł.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct BatchLane BatchLane;
+
+/**
+ * @brief Przechodzi drzewo przekierowań jednocześnie dla kilku numerów.
+ * Funkcja pomocnicza dla funkcji phfwdGetBatch. W każdym kroku przesuwa każdy
+ * z aktywnych numerów o jeden poziom w dół drzewa i sprowadza z wyprzedzeniem
+ * kolejny węzeł, który zostanie odczytany dopiero w następnym kroku. Dzięki
+ * temu oczekiwanie na pamięć dla różnych numerów się nakłada.
+ * @param[in,out] lanes - tablica stanów wyszukiwania;
+ * @param[in] count - ilość stanów w tablicy.
+ */
+static void batch_walk(BatchLane* lanes, size_t count) {
+    size_t active = count;
+    while (active > 0) {
+        active = 0;
+        for (size_t i = 0; i < count; i++) {
+            BatchLane* lane = &lanes[i];
+            if (lane->node == NULL)
+                continue;
+            // Węzeł został sprowadzony w poprzednim kroku.
+            PhoneFwd* node = lane->node;
+            if (fwd_match_label(node, &lane->number, lane->depth) < node->label_len) {
+                lane->node = NULL;
+                continue;
+            }
+            lane->depth += node->label_len;
+            lane->matched = node;
+            if (lane->depth == lane->number.length) {
+                lane->node = NULL;
+                continue;
+            }
+            int value = number_digit(&lane->number, lane->depth);
+            lane->node = fwd_child(node, value);
+            if (lane->node != NULL) {
+                PREFETCH(lane->node);
+                active++;
+            }
+        }
+    }
+}
+
+/** @brief Wyznacza przekierowania wielu numerów do podanego bufora.
+ * Wyznacza przekierowania numerów @p nums[0], ..., @p nums[n - 1] tak jak
+ * funkcja @ref phfwdGetInto i zapisuje je kolejno w buforze @p out, każdy
+ * zakończony znakiem końca napisu. Dla napisu, który nie reprezentuje numeru,
+ * zapisywany jest pusty napis. Numery są wyszukiwane w drzewie jednocześnie,
+ * co pozwala ukryć opóźnienia dostępu do pamięci. Nie alokuje pamięci.
+ * @param[in] pf       – wskaźnik na strukturę przechowującą przekierowania
+ *                       numerów;
+ * @param[in] nums     – tablica wskaźników na napisy reprezentujące numery;
+ * @param[in] n        – ilość numerów;
+ * @param[out] out     – wskaźnik na bufor na wyniki;
+ * @param[in] cap      – rozmiar bufora @p out w bajtach;
+ * @param[out] offsets – tablica co najmniej @p n pozycji, na której zapisywane
+ *                       są przesunięcia kolejnych wyników w buforze @p out.
+ * @return Ilość numerów, których przekierowania zmieściły się w buforze. Jeśli
+ *         jest mniejsza od @p n, to wywołanie można powtórzyć dla pozostałych
+ *         numerów. Wartość 0, jeśli @p pf ma wartość NULL.
+ */
+size_t phfwdGetBatch(PhoneForward const *pf, char const * const *nums, size_t n,
+                     char *out, size_t cap, size_t *offsets) {
+    if (pf == NULL || nums == NULL || out == NULL || offsets == NULL)
+        return 0;
+    if (pf->concurrent != NULL) {
+        unsigned slot;
+        size_t done = phfwdGetBatch(snapshot_acquire(pf, &slot), nums, n, out, cap, offsets);
+        snapshot_release(pf, slot);
+        return done;
+    }
+
+    BatchLane lanes[BATCH_LANES];
+    size_t used = 0;
+    for (size_t first = 0; first < n; first += BATCH_LANES) {
+        size_t count = n - first < BATCH_LANES ? n - first : BATCH_LANES;
+        for (size_t i = 0; i < count; i++) {
+            BatchLane* lane = &lanes[i];
+            if (!number_parse(&lane->number, nums[first + i])) {
+                // Dla napisu niebędącego numerem wynikiem jest pusty napis.
+                lane->number.length = 0;
+                lane->node = NULL;
+            }
+            else {
+                lane->node = pf->tree;
+                PREFETCH(fwd_child(pf->tree, lane->number.codes[0]));
+            }
+            lane->depth = 0;
+            lane->matched = pf->tree;
+        }
+
+        batch_walk(lanes, count);
+
+        for (size_t i = 0; i < count; i++) {
+            BatchLane* lane = &lanes[i];
+            const PhoneFwd* rule = lane->matched->rule;
+            const uint8_t* last = rule == NULL ? NULL : rule->forwarded_prefix;
+            size_t last_depth = rule == NULL ? 0 : rule->depth;
+            size_t forwarded_len = last == NULL ? 0 : prefix_length(last);
+            size_t rest_len = lane->number.length - last_depth;
+            if (cap - used <= forwarded_len + rest_len)
+                return first + i;
+
+            offsets[first + i] = used;
+            if (last != NULL)
+                prefix_write(last, out + used);
+            if (rest_len > 0)
+                memcpy(out + used + forwarded_len, lane->number.str + last_depth,
+                       rest_len);
+            used += forwarded_len + rest_len;
+            out[used++] = '\0';
+        }
+    }
+    return n;
+}
+
+/**
+ * To jest struktura opisująca kandydata do wyniku funkcji wyznaczających
+ * odwrócone przekierowania. Kandydat jest złączeniem dwóch napisów, które nie
+ * są kopiowane przed wybraniem wyniku.
+ */
+struct Candidate {
+    const char* prefix;             ///< Przekierowywany prefiks.
+    size_t prefix_len;              ///< Długość prefiksu.
+    const char* rest;               ///< Nieprzekierowywana końcówka numeru.
+    size_t rest_len;                ///< Długość końcówki.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct Candidate Candidate;
+
+/**
+ * @brief Udostępnia znak kandydata na podanej pozycji.
+ * @param[in] candidate - wskaźnik na kandydata;
+ * @param[in] position - pozycja mniejsza od łącznej długości kandydata.
+ * @return Znak na pozycji @p position złączenia prefiksu i końcówki.
+ */
+static char candidate_char(const Candidate* candidate, size_t position) {
+    if (position < candidate->prefix_len)
+        return candidate->prefix[position];
+    return candidate->rest[position - candidate->prefix_len];
+}
+
+/** @brief Komparator kandydatów dla funkcji bibliotecznej qsort.
+ * Porównuje leksykograficznie złączenia prefiksów i końcówek, przy czym znaki
+ * '*' i '#' są większe od cyfr.
+ * @param[in] first – wskaźnik na pierwszego kandydata;
+ * @param[in] second – wskaźnik na drugiego kandydata.
+ * @return Liczba ujemna, zero lub dodatnia, gdy pierwszy kandydat jest
+ * odpowiednio mniejszy, równy lub większy od drugiego.
+ */
+static int candidate_comparator(const void* first, const void* second) {
+    const Candidate* a = first;
+    const Candidate* b = second;
+    size_t a_len = a->prefix_len + a->rest_len, b_len = b->prefix_len + b->rest_len;
+    size_t common = a_len < b_len ? a_len : b_len;
+
+    for (size_t i = 0; i < common; i++) {
+        char a_char = candidate_char(a, i), b_char = candidate_char(b, i);
+        // Wartości znaków są wyznaczane dopiero dla pierwszej różnicy.
+        if (a_char != b_char)
+            return convert_to_number(a_char) - convert_to_number(b_char);
+    }
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+/**
+ * @brief Przywraca własność kopca list kandydatów.
+ * Przesuwa listę z pozycji @p position kopca w dół, aż jej bieżący kandydat
+ * nie będzie większy od bieżących kandydatów list w poddrzewie.
+ * @param[in,out] heap - kopiec numerów list;
+ * @param[in] size - rozmiar kopca;
+ * @param[in] position - pozycja przesuwanej listy;
+ * @param[in] candidates - tablica kandydatów;
+ * @param[in] heads - pozycje bieżących kandydatów list.
+ */
+static void merge_sift_down(size_t* heap, size_t size, size_t position,
+                            const Candidate* candidates, const size_t* heads) {
+    for (;;) {
+        size_t smallest = position;
+        for (size_t son = 2 * position + 1; son <= 2 * position + 2 && son < size; son++)
+            if (candidate_comparator(&candidates[heads[heap[son]]],
+                                     &candidates[heads[heap[smallest]]]) < 0)
+                smallest = son;
+        if (smallest == position)
+            return;
+        size_t swapped = heap[position];
+        heap[position] = heap[smallest];
+        heap[smallest] = swapped;
+        position = smallest;
+    }
+}
+
+/**
+ * @brief Tworzy strukturę PhoneNumbers ze scalonych list kandydatów.
+ * Kandydaci są pogrupowani w listy o wspólnej końcówce, odpowiadające kolejnym
+ * węzłom drzewa odwróconych przekierowań. Sortuje każdą listę osobno, scala je
+ * w jednym przebiegu za pomocą kopca i pomija powtórzenia, porównując
+ * kandydata tylko z poprzednio wybranym. Wynik zajmuje trzy alokacje: strukturę,
+ * tablicę wskaźników i wspólny blok wszystkich napisów, których rozmiar jest
+ * znany przed scalaniem.
+ * @param[in,out] candidates - tablica kandydatów;
+ * @param[in] ends - pozycje końców kolejnych list w tablicy kandydatów;
+ * @param[in] lists - ilość list.
+ * @return Wskaźnik na utworzoną strukturę lub NULL, gdy nie udało się
+ *         alokować pamięci.
+ */
+static PhoneNumbers * phn_merge_candidates(Candidate* candidates, const size_t* ends,
+                                           size_t lists) {
+    size_t count = lists == 0 ? 0 : ends[lists - 1], strings_size = 0;
+    for (size_t j = 0; j < lists; j++) {
+        size_t begin = j == 0 ? 0 : ends[j - 1];
+        qsort(candidates + begin, ends[j] - begin, sizeof(Candidate), candidate_comparator);
+    }
+    for (size_t i = 0; i < count; i++)
+        strings_size += candidates[i].prefix_len + candidates[i].rest_len + 1;
+
+    PhoneNumbers* result = malloc(sizeof(PhoneNumbers));
+    size_t* heads = malloc(sizeof(size_t) * 2 * lists);
+    if (result != NULL) {
+        result->size = 0;
+        // Dodatkowy element zapewnia niezerowy rozmiar alokacji dla pustego wyniku.
+        result->number = malloc(sizeof(char*) * (count + 1));
+        result->block = malloc(strings_size + 1);
+    }
+    if (result == NULL || heads == NULL || result->number == NULL || result->block == NULL) {
+        phnumDelete(result);
+        free(heads);
+        return NULL;
+    }
+
+    // Kopiec niepustych list uporządkowany według ich bieżących kandydatów.
+    size_t* heap = heads + lists;
+    size_t heap_size = 0, used = 0;
+    for (size_t j = 0; j < lists; j++) {
+        heads[j] = j == 0 ? 0 : ends[j - 1];
+        if (heads[j] < ends[j])
+            heap[heap_size++] = j;
+    }
+    for (size_t position = heap_size; position-- > 0;)
+        merge_sift_down(heap, heap_size, position, candidates, heads);
+
+    const Candidate* previous = NULL;
+    while (heap_size > 0) {
+        size_t list = heap[0];
+        const Candidate* candidate = &candidates[heads[list]++];
+        if (previous == NULL || candidate_comparator(previous, candidate) != 0) {
+            char* number = result->block + used;
+            memcpy(number, candidate->prefix, candidate->prefix_len);
+            memcpy(number + candidate->prefix_len, candidate->rest, candidate->rest_len);
+            used += candidate->prefix_len + candidate->rest_len;
+            result->block[used++] = '\0';
+            result->number[result->size++] = number;
+            previous = candidate;
+        }
+        if (heads[list] == ends[list])
+            heap[0] = heap[--heap_size];
+        merge_sift_down(heap, heap_size, 0, candidates, heads);
+    }
+    free(heads);
+    return result;
+}
+
+/**
+ * To jest struktura przechowująca bufory pomocnicze wyznaczania odwróconych
+ * przekierowań. Bufory rosną w miarę potrzeby i są używane ponownie przez
+ * kolejne zapytania tego samego wątku.
+ */
+struct ReverseScratch {
+    Candidate* candidates;          ///< Tablica kandydatów.
+    size_t candidates_cap;          ///< Rozmiar tablicy kandydatów.
+    size_t* ends;                   ///< Pozycje końców list kandydatów.
+    size_t ends_cap;                ///< Rozmiar tablicy końców list.
+    char* paths;                    ///< Odtworzone prefiksy przekierowywane.
+    size_t paths_cap;               ///< Rozmiar bufora prefiksów.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct ReverseScratch ReverseScratch;
+
+/**
+ * @brief Zapewnia bufor o podanym rozmiarze.
+ * Powiększa bufor co najmniej dwukrotnie, jeśli jest za mały.
+ * @param[in,out] buffer - wskaźnik na bufor;
+ * @param[in,out] cap - ilość elementów bufora;
+ * @param[in] count - wymagana ilość elementów;
+ * @param[in] size - rozmiar elementu.
+ * @return true - jeśli bufor ma co najmniej @p count elementów.
+ * @return false - jeśli nie udało się alokować pamięci. Bufor pozostaje wtedy
+ * niezmieniony.
+ */
+static bool scratch_reserve(void** buffer, size_t* cap, size_t count, size_t size) {
+    if (count <= *cap)
+        return true;
+    size_t new_cap = *cap * 2 > count ? *cap * 2 : count;
+    void* grown = realloc(*buffer, new_cap * size);
+    if (grown == NULL)
+        return false;
+    *buffer = grown;
+    *cap = new_cap;
+    return true;
+}
+
+/**
+ * @brief Zwalnia bufory pomocnicze.
+ * @param[in,out] scratch - wskaźnik na bufory.
+ */
+static void scratch_free(ReverseScratch* scratch) {
+    free(scratch->candidates);
+    free(scratch->ends);
+    free(scratch->paths);
+}
+
+/**
+ * @brief Zbiera kandydatów do numerów przekierowywanych na dany numer.
+ * Funkcja pomocnicza dla funkcji collect_reverse i reverse_iter. Zbiera
+ * kandydatów z węzłów drzewa odwróconych przekierowań na ścieżce numeru
+ * @p number do buforów @p scratch. Końcówki kandydatów wskazują na napis
+ * numeru. Jeśli @p preimage ma wartość true, pomija kandydatów, do których
+ * funkcja phfwdGet zastosowałaby inne przekierowanie, oraz sam numer, jeśli
+ * jest on przekierowywany. Wynik jest wtedy przeciwobrazem numeru.
+ * @param[in] pf - wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] number - poprawny numer;
+ * @param[in] preimage - czy wyznaczyć przeciwobraz numeru;
+ * @param[in,out] scratch - bufory pomocnicze wątku;
+ * @param[out] lists - ilość list kandydatów o wspólnej końcówce.
+ * @return true - jeśli kandydaci zostali zebrani.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool gather_candidates(PhoneForward const *pf, const Number* number,
+                              bool preimage, ReverseScratch* scratch, size_t* lists) {
+    const char* num = number->str;
+    size_t num_len = number->length;
+
+    // Zliczenie kandydatów i długości ich prefiksów, aby alokować pamięć jednorazowo.
+    size_t count = 1, paths_size = 0;
+    const PhoneBwd* probe = pf->backward_tree;
+    for (size_t i = 0; i < num_len; i++) {
+        probe = bwd_child(probe, number_digit(number, i));
+        if (probe == NULL)
+            break;
+        count += probe->size;
+        for (size_t j = 0; j < probe->size; j++)
+            paths_size += fwd_depth(probe->forwarding[j]);
+    }
+
+    if (!scratch_reserve((void**)&scratch->candidates, &scratch->candidates_cap,
+                         count, sizeof(Candidate))
+        || !scratch_reserve((void**)&scratch->ends, &scratch->ends_cap,
+                            num_len + 1, sizeof(size_t))
+        || !scratch_reserve((void**)&scratch->paths, &scratch->paths_cap,
+                            paths_size + 1, sizeof(char)))
+        return false;
+    Candidate* candidates = scratch->candidates;
+    size_t* ends = scratch->ends;
+    char* paths = scratch->paths;
+    // Każdy węzeł na ścieżce numeru daje listę kandydatów o wspólnej końcówce.
+    size_t last_depth;
+    count = 0;
+    if (!preimage || find_forwarding(pf->tree, number, &last_depth) == NULL)
+        candidates[count++] = (Candidate){num, num_len, "", 0};
+    ends[0] = count;
+    *lists = 1;
+    paths_size = 0;
+    probe = pf->backward_tree;
+    for (size_t i = 0; i < num_len; i++) {
+        probe = bwd_child(probe, number_digit(number, i));
+        if (probe == NULL)
+            break;
+        if (probe->size == 0)
+            continue;
+        for (size_t j = 0; j < probe->size; j++) {
+            if (preimage && fwd_shadowed(probe->forwarding[j], number, i + 1))
+                continue;
+            // Przekierowywany prefiks jest odtwarzany z etykiet przodków węzła.
+            size_t depth = fwd_depth(probe->forwarding[j]);
+            fwd_write_path(probe->forwarding[j], paths + paths_size, depth);
+            candidates[count++] = (Candidate){paths + paths_size, depth,
+                                              num + i + 1, num_len - i - 1};
+            paths_size += depth;
+        }
+        ends[(*lists)++] = count;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Wyznacza numery przekierowywane na dany numer.
+ * Funkcja pomocnicza dla funkcji phfwdReverse i phfwdGetReverse. Scala
+ * posortowane listy kandydatów zebranych funkcją gather_candidates.
+ * @param[in] pf - wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num - wskaźnik na napis reprezentujący numer;
+ * @param[in] preimage - czy wyznaczyć przeciwobraz numeru;
+ * @param[in,out] scratch - bufory pomocnicze wątku.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ * udało się alokować pamięci.
+ */
+static PhoneNumbers * collect_reverse(PhoneForward const *pf, char const *num,
+                                      bool preimage, ReverseScratch* scratch) {
+    Number number;
+    if (!number_parse(&number, num))
+        return phn_create(NULL, 0);
+    size_t lists;
+    if (!gather_candidates(pf, &number, preimage, scratch, &lists))
+        return NULL;
+    return phn_merge_candidates(scratch->candidates, scratch->ends, lists);
+}
+
+/** @brief Wyznacza przekierowania na dany numer.
+ * Wyznacza następujący ciąg numerów: jeśli istnieje numer @p x, taki że jeśli
+ * w drzewie przekierowań istnieje takie przekierowanie, które przekierowuje
+ * numer @p x na @p num, to numer @p x należy do wyniku wywołania 
+ * @ref phfwdReverse z numerem @p num. Dodatkowo ciągwynikowy zawsze zawiera
+ * też numer @p num. Wynikowe numery są posortowane
+ * leksykograficznie i nie mogą się powtarzać. Jeśli podany napis nie
+ * reprezentuje numeru, wynikiem jest pusty ciąg. Alokuje strukturę
+ * @p PhoneNumbers, która musi być zwolniona za pomocą funkcji @ref phnumDelete.
+ * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci.
+ */
+PhoneNumbers * phfwdReverse(PhoneForward const *pf, char const *num) {
+    if (pf == NULL)
+        return NULL;
+    if (pf->concurrent != NULL) {
+        unsigned slot;
+        PhoneNumbers* result = phfwdReverse(snapshot_acquire(pf, &slot), num);
+        snapshot_release(pf, slot);
+        return result;
+    }
+    ReverseScratch scratch = {0};
+    PhoneNumbers* result = collect_reverse(pf, num, false, &scratch);
+    scratch_free(&scratch);
+    return result;
+}
+
+/** @brief Usuwa strukturę.
+ * Usuwa strukturę wskazywaną przez @p pnum. Nic nie robi, jeśli wskaźnik ten ma
+ * wartość NULL.
+ * @param[in] pnum – wskaźnik na usuwaną strukturę.
+ */
+void phnumDelete(PhoneNumbers *pnum) {
+    if (pnum == NULL)
+        return;
+
+    if (pnum->block != NULL)
+        free(pnum->block);
+    else
+        for (size_t i = 0; i < pnum->size; i++)
+            free(pnum->number[i]);
+
+    free(pnum->number);
+    free(pnum);
+}
+
+/** @brief Udostępnia numer.
+ * Udostępnia wskaźnik na napis reprezentujący numer. Napisy są indeksowane
+ * kolejno od zera.
+ * @param[in] pnum – wskaźnik na strukturę przechowującą ciąg numerów telefonów;
+ * @param[in] idx  – indeks numeru telefonu.
+ * @return Wskaźnik na napis reprezentujący numer telefonu. Wartość NULL, jeśli
+ *         wskaźnik @p pnum ma wartość NULL lub indeks ma za dużą wartość.
+ */
+char const * phnumGet(PhoneNumbers const *pnum, size_t idx) {
+    if (pnum == NULL)
+        return NULL;
+        
+    if (idx >= pnum->size)
+        return NULL;
+
+    return pnum->number[idx];
+}
+
+/** @brief Scala posortowane ciągi numerów.
+ * Tworzy ciąg zawierający numery ze wszystkich ciągów @p lists[0], ...,
+ * @p lists[count - 1], posortowane leksykograficznie tak jak wyniki funkcji
+ * @ref phfwdReverse i bez powtórzeń. Ciągi wejściowe pozostają niezmienione.
+ * Alokuje strukturę @p PhoneNumbers, która musi być zwolniona za pomocą
+ * funkcji @ref phnumDelete.
+ * @param[in] lists – tablica wskaźników na scalane ciągi;
+ * @param[in] count – ilość ciągów.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci bądź któryś ze wskaźników ma wartość NULL.
+ */
+PhoneNumbers * phnumMerge(PhoneNumbers const * const *lists, size_t count) {
+    if (count == 0)
+        return phn_create(NULL, 0);
+    if (lists == NULL)
+        return NULL;
+
+    size_t total = 0;
+    for (size_t j = 0; j < count; j++) {
+        if (lists[j] == NULL)
+            return NULL;
+        total += lists[j]->size;
+    }
+    Candidate* candidates = malloc(sizeof(Candidate) * (total + 1));
+    size_t* ends = malloc(sizeof(size_t) * count);
+    if (candidates == NULL || ends == NULL) {
+        free(candidates);
+        free(ends);
+        return NULL;
+    }
+    // Każdy ciąg jest osobną listą kandydatów z pustą końcówką.
+    total = 0;
+    for (size_t j = 0; j < count; j++) {
+        for (size_t i = 0; i < lists[j]->size; i++) {
+            const char* number = lists[j]->number[i];
+            candidates[total++] = (Candidate){number, strlen(number), "", 0};
+        }
+        ends[j] = total;
+    }
+
+    PhoneNumbers* result = phn_merge_candidates(candidates, ends, count);
+    free(candidates);
+    free(ends);
+    return result;
+}
+
+/** @brief Wyznacza przekierowania na dany numer.
+ * Wyznacza następujący ciąg numerów: jeśli istnieje numer @p x, taki że jeśli
+ * wywołamy funkcję @ref phfwdGet na numerze @p x i w wyniku otrzymamy numer
+ * @p num, to numer @p x należy do wyniku wywołania @ref phfwdGetReverse 
+ * z numerem @p num. Dodatkowo ciągwynikowy zawsze zawiera
+ * też numer @p num. Wynikowe numery są posortowane
+ * leksykograficznie i nie mogą się powtarzać. Jeśli podany napis nie
+ * reprezentuje numeru, wynikiem jest pusty ciąg. Alokuje strukturę
+ * @p PhoneNumbers, która musi być zwolniona za pomocą funkcji @ref phnumDelete.
+ * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci.
+ */
+PhoneNumbers * phfwdGetReverse(PhoneForward const *pf, char const *num) {
+    if (pf == NULL)
+        return NULL;
+    if (pf->concurrent != NULL) {
+        unsigned slot;
+        PhoneNumbers* result = phfwdGetReverse(snapshot_acquire(pf, &slot), num);
+        snapshot_release(pf, slot);
+        return result;
+    }
+    ReverseScratch scratch = {0};
+    PhoneNumbers* result = collect_reverse(pf, num, true, &scratch);
+    scratch_free(&scratch);
+    return result;
+}
+
+/**
+ * To jest struktura opisująca wątek wykonujący zapytania funkcji
+ * phfwdGetReverseBatch. Wątek wykonuje zapytania ze swojego przedziału, a gdy
+ * go wyczerpie, przejmuje drugą połowę przedziału innego wątku.
+ */
+struct ReverseWorker {
+    pthread_mutex_t lock;           ///< Blokada przedziału zapytań.
+    size_t next;                    ///< Pierwsze nieprzydzielone zapytanie.
+    size_t end;                     ///< Koniec przedziału zapytań.
+    struct ReverseJob* job;         ///< Wspólny opis zadania.
+    pthread_t thread;               ///< Identyfikator wątku.
+    bool started;                   ///< Czy wątek został utworzony.
+    bool failed;                    ///< Czy nie udało się alokować pamięci.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct ReverseWorker ReverseWorker;
+
+/**
+ * To jest struktura opisująca zadanie funkcji phfwdGetReverseBatch.
+ */
+struct ReverseJob {
+    PhoneForward const* pf;         ///< Struktura przechowująca przekierowania.
+    char const* const* nums;        ///< Numery, dla których wyznaczane są wyniki.
+    PhoneNumbers** results;         ///< Tablica na wyniki.
+    ReverseWorker* workers;         ///< Tablica wątków.
+    size_t count;                   ///< Ilość wątków.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct ReverseJob ReverseJob;
+
+/**
+ * @brief Pobiera kolejną porcję zapytań z przedziału wątku.
+ * @param[in,out] worker - wskaźnik na wątek;
+ * @param[out] begin - pierwsze zapytanie porcji;
+ * @param[out] end - koniec porcji.
+ * @return true - jeśli porcja jest niepusta.
+ * @return false - jeśli przedział wątku jest pusty.
+ */
+static bool worker_take(ReverseWorker* worker, size_t* begin, size_t* end) {
+    pthread_mutex_lock(&worker->lock);
+    *begin = worker->next;
+    *end = worker->end - worker->next > STEAL_CHUNK ? worker->next + STEAL_CHUNK
+                                                     : worker->end;
+    worker->next = *end;
+    pthread_mutex_unlock(&worker->lock);
+    return *begin < *end;
+}
+
+/**
+ * @brief Przejmuje zapytania innego wątku.
+ * Przegląda pozostałe wątki, zaczynając od następnego, i przejmuje drugą
+ * połowę pierwszego niepustego przedziału. Przejęte zapytania stają się
+ * przedziałem wątku @p thief. Wątek nigdy nie trzyma dwóch blokad naraz.
+ * @param[in,out] job - wskaźnik na zadanie;
+ * @param[in,out] thief - wskaźnik na wątek przejmujący zapytania.
+ * @return true - jeśli udało się przejąć zapytania.
+ * @return false - jeśli wszystkie przedziały są puste.
+ */
+static bool worker_steal(ReverseJob* job, ReverseWorker* thief) {
+    size_t index = (size_t)(thief - job->workers);
+    for (size_t i = 1; i < job->count; i++) {
+        ReverseWorker* victim = &job->workers[(index + i) % job->count];
+        pthread_mutex_lock(&victim->lock);
+        size_t remaining = victim->end - victim->next;
+        size_t middle = victim->next + remaining / 2, end = victim->end;
+        victim->end = middle;
+        pthread_mutex_unlock(&victim->lock);
+        if (middle < end) {
+            pthread_mutex_lock(&thief->lock);
+            thief->next = middle;
+            thief->end = end;
+            pthread_mutex_unlock(&thief->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Wykonuje zapytania wątku funkcji phfwdGetReverseBatch.
+ * Wyniki są wyznaczane z użyciem własnych buforów pomocniczych wątku.
+ * @param[in,out] arg - wskaźnik na wątek typu ReverseWorker.
+ * @return Wartość NULL.
+ */
+static void * worker_run(void* arg) {
+    ReverseWorker* worker = arg;
+    ReverseJob* job = worker->job;
+    ReverseScratch scratch = {0};
+    size_t begin, end;
+    while (worker_take(worker, &begin, &end) || worker_steal(job, worker)) {
+        for (size_t i = begin; i < end; i++) {
+            job->results[i] = job->pf->concurrent != NULL
+                ? phfwdGetReverse(job->pf, job->nums[i])
+                : collect_reverse(job->pf, job->nums[i], true, &scratch);
+            if (job->results[i] == NULL)
+                worker->failed = true;
+        }
+    }
+    scratch_free(&scratch);
+    return NULL;
+}
+
+/** @brief Wyznacza przeciwobrazy wielu numerów równolegle.
+ * Wyznacza dla numerów @p nums[0], ..., @p nums[n - 1] wyniki takie jak
+ * funkcja @ref phfwdGetReverse i zapisuje je w @p results[0], ...,
+ * @p results[n - 1]. Zapytania są rozdzielane między wątki, a wątek, który
+ * wyczerpie swoje zapytania, przejmuje część zapytań innego wątku. Każdy wątek
+ * używa własnych buforów pomocniczych. Struktura @p pf nie może być w tym
+ * czasie modyfikowana, chyba że została utworzona przez
+ * @ref phfwdNewConcurrent. Każdy wynik musi być zwolniony za pomocą funkcji
+ * @ref phnumDelete.
+ * @param[in] pf       – wskaźnik na strukturę przechowującą przekierowania
+ *                       numerów;
+ * @param[in] nums     – tablica wskaźników na napisy reprezentujące numery;
+ * @param[in] n        – ilość numerów;
+ * @param[out] results – tablica co najmniej @p n pozycji na wyniki;
+ * @param[in] threads  – ilość wątków lub 0, aby użyć tylu wątków, ile jest
+ *                       dostępnych procesorów.
+ * @return Wartość @p true, jeśli wszystkie wyniki zostały wyznaczone.
+ *         Wartość @p false, jeśli któryś ze wskaźników ma wartość NULL lub nie
+ *         udało się alokować pamięci. Wszystkie pozycje @p results mają wtedy
+ *         wartość NULL.
+ */
+bool phfwdGetReverseBatch(PhoneForward const *pf, char const * const *nums, size_t n,
+                          PhoneNumbers **results, unsigned threads) {
+    if (pf == NULL || (n > 0 && (nums == NULL || results == NULL)))
+        return false;
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (unsigned)online : 1;
+    }
+    size_t count = (n + STEAL_CHUNK - 1) / STEAL_CHUNK;
+    if (count > threads)
+        count = threads;
+    if (count == 0)
+        return true;
+
+    ReverseWorker* workers = malloc(sizeof(ReverseWorker) * count);
+    if (workers == NULL) {
+        for (size_t i = 0; i < n; i++)
+            results[i] = NULL;
+        return false;
+    }
+    ReverseJob job = {pf, nums, results, workers, count};
+    // Początkowo każdy wątek dostaje spójny przedział zapytań równej długości.
+    for (size_t i = 0; i < count; i++) {
+        workers[i] = (ReverseWorker){.next = n * i / count, .end = n * (i + 1) / count,
+                                     .job = &job};
+        pthread_mutex_init(&workers[i].lock, NULL);
+    }
+    // Wątek wywołujący jest pierwszym wątkiem. Zapytania wątków, których nie
+    // udało się utworzyć, zostaną przejęte przez pozostałe.
+    for (size_t i = 1; i < count; i++)
+        workers[i].started = pthread_create(&workers[i].thread, NULL,
+                                            worker_run, &workers[i]) == 0;
+    worker_run(&workers[0]);
+
+    bool failed = workers[0].failed;
+    for (size_t i = 1; i < count; i++) {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+        failed = failed || workers[i].failed;
+    }
+    for (size_t i = 0; i < count; i++)
+        pthread_mutex_destroy(&workers[i].lock);
+    free(workers);
+
+    if (failed) {
+        for (size_t i = 0; i < n; i++) {
+            phnumDelete(results[i]);
+            results[i] = NULL;
+        }
+    }
+    return !failed;
+}
+
+/** @brief Zlicza przekierowania na dany numer.
+ * Wyznacza ilość numerów w wyniku funkcji @ref phfwdReverse bez tworzenia go.
+ * Każdy węzeł drzewa odwróconych przekierowań pamięta, ile jego przekierowań
+ * powtarza numery krótszych przekierowań, a liczniki te są uaktualniane przy
+ * każdej modyfikacji. Działa w czasie proporcjonalnym do długości numeru i nie
+ * alokuje pamięci. W trybie współbieżnym odczytuje opublikowaną kopię
+ * przekierowań bez czekania na piszących.
+ * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Ilość numerów lub 0, jeśli napis nie reprezentuje numeru bądź @p pf
+ *         ma wartość NULL.
+ */
+size_t phfwdReverseCount(PhoneForward const *pf, char const *num) {
+    Number number;
+    if (pf == NULL || !number_parse(&number, num))
+        return 0;
+    if (pf->concurrent != NULL) {
+        unsigned slot;
+        size_t count = phfwdReverseCount(snapshot_acquire(pf, &slot), num);
+        snapshot_release(pf, slot);
+        return count;
+    }
+    // Sam numer nigdy nie powtarza numeru przekierowania.
+    size_t count = 1;
+    const PhoneBwd* probe = pf->backward_tree;
+    for (size_t i = 0; i < number.length; i++) {
+        probe = bwd_child(probe, number_digit(&number, i));
+        if (probe == NULL)
+            break;
+        count += probe->size - probe->duplicates;
+    }
+    return count;
+}
+
+/** @brief Zlicza numery przekierowywane na dany numer.
+ * Wyznacza ilość numerów w wyniku funkcji @ref phfwdGetReverse bez tworzenia
+ * go i bez alokowania pamięci. Przekierowanie jest sprawdzane w drzewie
+ * przekierowań tylko wtedy, gdy jego poddrzewo zawiera dłuższe
+ * przekierowania. W trybie współbieżnym odczytuje opublikowaną kopię
+ * przekierowań bez czekania na piszących.
+ * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Ilość numerów lub 0, jeśli napis nie reprezentuje numeru bądź @p pf
+ *         ma wartość NULL.
+ */
+size_t phfwdGetReverseCount(PhoneForward const *pf, char const *num) {
+    Number number;
+    if (pf == NULL || !number_parse(&number, num))
+        return 0;
+    if (pf->concurrent != NULL) {
+        unsigned slot;
+        size_t count = phfwdGetReverseCount(snapshot_acquire(pf, &slot), num);
+        snapshot_release(pf, slot);
+        return count;
+    }
+    // Powtórzenia są przesłonięte przez dłuższe przekierowania, więc nie
+    // wymagają osobnego pomijania.
+    size_t last_depth;
+    size_t count = find_forwarding(pf->tree, &number, &last_depth) == NULL;
+    const PhoneBwd* probe = pf->backward_tree;
+    for (size_t i = 0; i < number.length; i++) {
+        probe = bwd_child(probe, number_digit(&number, i));
+        if (probe == NULL)
+            break;
+        for (size_t j = 0; j < probe->size; j++)
+            count += !fwd_shadowed(probe->forwarding[j], &number, i + 1);
+    }
+    return count;
+}
+
+/**
+ * To jest struktura przechowująca stan leniwego wyznaczania numerów
+ * przekierowywanych na dany numer. Kandydaci zebrani z drzewa odwróconych
+ * przekierowań tworzą kopiec uporządkowany leksykograficznie, z którego
+ * kolejne numery są zdejmowane dopiero na żądanie.
+ */
+struct PhoneNumbersIter {
+    ReverseScratch scratch;         ///< Kopiec kandydatów i ich prefiksy.
+    size_t size;                    ///< Ilość kandydatów w kopcu.
+    char* num;                      ///< Kopia numeru, zawierająca końcówki kandydatów.
+    char* current;                  ///< Bufor na ostatnio wyznaczony numer.
+    size_t current_len;             ///< Długość ostatnio wyznaczonego numeru.
+    bool started;                   ///< Czy wyznaczono już jakiś numer.
+    /// Ciąg wyznaczony z góry z opublikowanej kopii w trybie współbieżnym lub
+    /// NULL.
+    PhoneNumbers* materialized;
+    size_t position;                ///< Pozycja kolejnego numeru ciągu @p materialized.
+};
+
+/**
+ * @brief Przywraca własność kopca kandydatów.
+ * Przesuwa kandydata z pozycji @p position w dół kopca, aż nie będzie on
+ * większy od kandydatów w swoim poddrzewie.
+ * @param[in,out] heap - kopiec kandydatów;
+ * @param[in] size - rozmiar kopca;
+ * @param[in] position - pozycja przesuwanego kandydata.
+ */
+static void candidate_sift_down(Candidate* heap, size_t size, size_t position) {
+    for (;;) {
+        size_t smallest = position;
+        for (size_t son = 2 * position + 1; son <= 2 * position + 2 && son < size; son++)
+            if (candidate_comparator(&heap[son], &heap[smallest]) < 0)
+                smallest = son;
+        if (smallest == position)
+            return;
+        Candidate swapped = heap[position];
+        heap[position] = heap[smallest];
+        heap[smallest] = swapped;
+        position = smallest;
+    }
+}
+
+/**
+ * @brief Tworzy iterator po numerach przekierowywanych na dany numer.
+ * Funkcja pomocnicza dla funkcji phfwdReverseIter i phfwdGetReverseIter.
+ * Zbiera kandydatów tak jak funkcja collect_reverse, ale zamiast sortować
+ * listy i kopiować wszystkie numery, układa kandydatów w kopiec w czasie
+ * liniowym.
+ * @param[in] pf - wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num - wskaźnik na napis reprezentujący numer;
+ * @param[in] preimage - czy wyznaczyć przeciwobraz numeru.
+ * @return Wskaźnik na iterator lub NULL, gdy nie udało się alokować pamięci
+ * bądź @p pf ma wartość NULL.
+ */
+static PhoneNumbersIter * reverse_iter(PhoneForward const *pf, char const *num,
+                                       bool preimage) {
+    if (pf == NULL)
+        return NULL;
+    PhoneNumbersIter* iter = calloc(1, sizeof(PhoneNumbersIter));
+    if (iter == NULL)
+        return NULL;
+    if (pf->concurrent != NULL) {
+        iter->materialized = preimage ? phfwdGetReverse(pf, num) : phfwdReverse(pf, num);
+        if (iter->materialized == NULL) {
+            free(iter);
+            return NULL;
+        }
+        return iter;
+    }
+    Number number;
+    if (!number_parse(&number, num))
+        return iter;
+
+    // Końcówki kandydatów wskazują na kopię, więc napis num może zostać zwolniony.
+    iter->num = malloc(number.length + 1);
+    size_t lists;
+    if (iter->num == NULL) {
+        free(iter);
+        return NULL;
+    }
+    memcpy(iter->num, num, number.length + 1);
+    number.str = iter->num;
+    if (!gather_candidates(pf, &number, preimage, &iter->scratch, &lists)) {
+        phnumIterDelete(iter);
+        return NULL;
+    }
+
+    Candidate* heap = iter->scratch.candidates;
+    size_t longest = 0;
+    iter->size = iter->scratch.ends[lists - 1];
+    for (size_t i = 0; i < iter->size; i++)
+        if (heap[i].prefix_len + heap[i].rest_len > longest)
+            longest = heap[i].prefix_len + heap[i].rest_len;
+    iter->current = malloc(longest + 1);
+    if (iter->current == NULL) {
+        phnumIterDelete(iter);
+        return NULL;
+    }
+    for (size_t position = iter->size / 2; position-- > 0;)
+        candidate_sift_down(heap, iter->size, position);
+    return iter;
+}
+
+/** @brief Tworzy iterator po przekierowaniach na dany numer.
+ * Tworzy iterator zwracający kolejno te same numery co funkcja
+ * @ref phfwdReverse, w tym samym porządku. Numery nie są wyznaczane z góry:
+ * iterator przechowuje tylko kandydatów zebranych z drzewa odwróconych
+ * przekierowań i wyznacza kolejny numer dopiero przy wywołaniu
+ * @ref phnumIterNext, więc przerwanie iteracji oszczędza sortowanie i
+ * kopiowanie pozostałych numerów. Późniejsze zmiany @p pf nie wpływają na
+ * iterator. Iterator musi być zwolniony za pomocą funkcji
+ * @ref phnumIterDelete.
+ * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na iterator lub NULL, gdy nie udało się alokować pamięci
+ *         bądź @p pf ma wartość NULL.
+ */
+PhoneNumbersIter * phfwdReverseIter(PhoneForward const *pf, char const *num) {
+    return reverse_iter(pf, num, false);
+}
+
+/** @brief Tworzy iterator po przeciwobrazie numeru.
+ * Działa tak jak funkcja @ref phfwdReverseIter, ale zwraca numery takie jak
+ * funkcja @ref phfwdGetReverse.
+ * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na iterator lub NULL, gdy nie udało się alokować pamięci
+ *         bądź @p pf ma wartość NULL.
+ */
+PhoneNumbersIter * phfwdGetReverseIter(PhoneForward const *pf, char const *num) {
+    return reverse_iter(pf, num, true);
+}
+
+/** @brief Udostępnia kolejny numer iteratora.
+ * Wyznacza kolejny numer w porządku leksykograficznym, pomijając powtórzenia.
+ * @param[in,out] iter – wskaźnik na iterator.
+ * @return Wskaźnik na napis reprezentujący numer, ważny do następnego
+ *         wywołania funkcji dla tego iteratora lub do jego usunięcia.
+ *         Wartość NULL, jeśli numery się skończyły lub @p iter ma wartość
+ *         NULL.
+ */
+char const * phnumIterNext(PhoneNumbersIter *iter) {
+    if (iter == NULL)
+        return NULL;
+    if (iter->materialized != NULL) {
+        const char* number = phnumGet(iter->materialized, iter->position);
+        iter->position += number != NULL;
+        return number;
+    }
+
+    Candidate* heap = iter->scratch.candidates;
+    while (iter->size > 0) {
+        Candidate top = heap[0];
+        heap[0] = heap[--iter->size];
+        candidate_sift_down(heap, iter->size, 0);
+        // Równi kandydaci są zdejmowani kolejno, więc wystarcza porównanie z poprzednim.
+        size_t length = top.prefix_len + top.rest_len;
+        if (iter->started && length == iter->current_len
+            && memcmp(iter->current, top.prefix, top.prefix_len) == 0
+            && memcmp(iter->current + top.prefix_len, top.rest, top.rest_len) == 0)
+            continue;
+        memcpy(iter->current, top.prefix, top.prefix_len);
+        memcpy(iter->current + top.prefix_len, top.rest, top.rest_len);
+        iter->current[length] = '\0';
+        iter->current_len = length;
+        iter->started = true;
+        return iter->current;
+    }
+    return NULL;
+}
+
+/** @brief Usuwa iterator.
+ * Usuwa iterator wskazywany przez @p iter. Nic nie robi, jeśli wskaźnik ten
+ * ma wartość NULL.
+ * @param[in] iter – wskaźnik na usuwany iterator.
+ */
+void phnumIterDelete(PhoneNumbersIter *iter) {
+    if (iter == NULL)
+        return;
+    scratch_free(&iter->scratch);
+    phnumDelete(iter->materialized);
+    free(iter->num);
+    free(iter->current);
+    free(iter);
+}
+
+/**
+ * To jest struktura opisująca pojedynczą zmianę zapamiętaną w transakcji.
+ * Napisy zmian są przechowywane we wspólnym buforze transakcji, który może
+ * zostać przeniesiony przy powiększaniu, więc zmiana pamięta ich położenie w
+ * buforze zamiast wskaźników.
+ */
+struct TxnOp {
+    size_t num1;                ///< Położenie prefiksu przekierowywanego w buforze.
+    size_t num1_len;            ///< Długość prefiksu @p num1.
+    size_t num2;                ///< Położenie prefiksu docelowego w buforze.
+    size_t num2_len;            ///< Długość prefiksu @p num2 lub 0 przy usuwaniu.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct TxnOp TxnOp;
+
+/**
+ * To jest struktura przechowująca zmiany przekierowań czekające na
+ * zatwierdzenie.
+ */
+struct PhoneForwardTxn {
+    PhoneForward* pf;           ///< Struktura, której dotyczy transakcja.
+    TxnOp* ops;                 ///< Zmiany w kolejności zapamiętania.
+    size_t count;               ///< Ilość zmian.
+    size_t ops_cap;             ///< Pojemność tablicy zmian.
+    char* text;                 ///< Napisy zmian zakończone znakami '\0'.
+    size_t text_size;           ///< Ilość zajętych znaków bufora napisów.
+    size_t text_cap;            ///< Pojemność bufora napisów.
+};
+
+/**
+ * To jest struktura opisująca usunięcie, które obejmuje dodawane
+ * przekierowania. Poddrzewo usuwanego prefiksu jest zastępowane w całości
+ * drzewem dodawanych przekierowań zbudowanym przed pierwszą zmianą.
+ */
+struct TxnGraft {
+    /// Najpłytszy węzeł, którego napis rozszerza usuwany prefiks, lub NULL,
+    /// jeśli takiego węzła nie ma i dodania są wstawiane pojedynczo.
+    PhoneFwd* replaced;
+    /// Niepodłączony węzeł o długości napisu rodzica węzła @p replaced, pod
+    /// którym zbudowano drzewo dodań, lub NULL, jeśli jeszcze go nie ma.
+    PhoneFwd* root;
+    size_t first;               ///< Pozycja pierwszego dodania w poddrzewie.
+    size_t end;                 ///< Pozycja za ostatnim dodaniem w poddrzewie.
+    size_t removal;             ///< Pozycja usunięcia.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct TxnGraft TxnGraft;
+
+/**
+ * To jest struktura przechowująca wszystko, co jest potrzebne do
+ * zatwierdzenia transakcji bez alokowania pamięci.
+ */
+struct TxnPlan {
+    /// Prefiksy docelowe dodań wstawianych pojedynczo, a dla pozostałych NULL.
+    uint8_t** forwarded;
+    PhoneBwd** targets;         ///< Węzły drzewa odwróconych przekierowań z zapewnionym miejscem.
+    TxnGraft* grafts;           ///< Usunięcia obejmujące dodania, w porządku rosnącym.
+    size_t graft_count;         ///< Ilość takich usunięć.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct TxnPlan TxnPlan;
+
+/** @brief Rozpoczyna transakcję.
+ * Tworzy pustą transakcję, w której można zapamiętać zmiany przekierowań
+ * struktury @p pf funkcjami @ref phfwdTxnAdd i @ref phfwdTxnRemove. Zmiany nie
+ * są widoczne w strukturze aż do wywołania funkcji @ref phfwdTxnCommit.
+ * Zapamiętywanie zmian nie korzysta ze struktury @p pf, która musi jednak
+ * istnieć aż do zatwierdzenia lub porzucenia transakcji.
+ * @param[in] pf – wskaźnik na strukturę przechowującą przekierowania numerów.
+ * @return Wskaźnik na utworzoną transakcję lub NULL, gdy nie udało się
+ *         alokować pamięci bądź @p pf ma wartość NULL.
+ */
+PhoneForwardTxn * phfwdTxnBegin(PhoneForward *pf) {
+    if (pf == NULL)
+        return NULL;
+    PhoneForwardTxn* txn = malloc(sizeof(PhoneForwardTxn));
+    if (txn == NULL)
+        return NULL;
+    *txn = (PhoneForwardTxn){pf, NULL, 0, 0, NULL, 0, 0};
+    return txn;
+}
+
+/**
+ * @brief Zapamiętuje zmianę w transakcji.
+ * Kopiuje napisy zmiany do bufora transakcji.
+ * @param[in,out] txn - wskaźnik na transakcję;
+ * @param[in] num1 - sprawdzony prefiks numerów;
+ * @param[in] num2 - sprawdzony prefiks docelowy lub NULL przy usuwaniu.
+ * @return true - jeśli zmiana została zapamiętana.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool txn_stage(PhoneForwardTxn* txn, const Number* num1, const Number* num2) {
+    size_t num2_len = num2 == NULL ? 0 : num2->length;
+    if (!scratch_reserve((void**)&txn->ops, &txn->ops_cap, txn->count + 1, sizeof(TxnOp))
+        || !scratch_reserve((void**)&txn->text, &txn->text_cap,
+                            txn->text_size + num1->length + num2_len + 2, sizeof(char)))
+        return false;
+
+    TxnOp* op = &txn->ops[txn->count++];
+    op->num1 = txn->text_size;
+    op->num1_len = num1->length;
+    memcpy(txn->text + op->num1, num1->str, num1->length);
+    txn->text[op->num1 + num1->length] = '\0';
+    op->num2 = op->num1 + num1->length + 1;
+    op->num2_len = num2_len;
+    if (num2 != NULL)
+        memcpy(txn->text + op->num2, num2->str, num2_len);
+    txn->text[op->num2 + num2_len] = '\0';
+    txn->text_size = op->num2 + num2_len + 1;
+    return true;
+}
+
+/** @brief Zapamiętuje w transakcji dodanie przekierowania.
+ * Sprawdza parametry tak jak funkcja @ref phfwdAdd i zapamiętuje dodanie
+ * przekierowania z @p num1 na @p num2, wykonywane przy zatwierdzeniu
+ * transakcji. Napisy są kopiowane.
+ * @param[in,out] txn – wskaźnik na transakcję;
+ * @param[in] num1    – wskaźnik na napis reprezentujący prefiks numerów
+ *                      przekierowywanych;
+ * @param[in] num2    – wskaźnik na napis reprezentujący prefiks numerów,
+ *                      na które jest wykonywane przekierowanie.
+ * @return Wartość @p true, jeśli dodanie zostało zapamiętane.
+ *         Wartość @p false, jeśli podany napis nie reprezentuje numeru, oba
+ *         podane numery są identyczne, @p txn ma wartość NULL lub nie udało
+ *         się alokować pamięci. Transakcja pozostaje wtedy niezmieniona.
+ */
+bool phfwdTxnAdd(PhoneForwardTxn *txn, char const *num1, char const *num2) {
+    Number number1, number2;
+    if (txn == NULL || !check_parameters(txn->pf, num1, num2, &number1, &number2))
+        return false;
+    return txn_stage(txn, &number1, &number2);
+}
+
+/** @brief Zapamiętuje w transakcji usunięcie przekierowań.
+ * Zapamiętuje usunięcie wszystkich przekierowań, w których parametr @p num
+ * jest prefiksem parametru @p num1 użytego przy dodawaniu, wykonywane przy
+ * zatwierdzeniu transakcji. Obejmuje ono również przekierowania dodane
+ * wcześniej w tej samej transakcji. Jeśli napis nie reprezentuje numeru,
+ * nic nie robi.
+ * @param[in,out] txn – wskaźnik na transakcję;
+ * @param[in] num     – wskaźnik na napis reprezentujący prefiks numerów.
+ * @return Wartość @p true, jeśli usunięcie zostało zapamiętane lub napis nie
+ *         reprezentuje numeru. Wartość @p false, jeśli @p txn ma wartość NULL
+ *         lub nie udało się alokować pamięci.
+ */
+bool phfwdTxnRemove(PhoneForwardTxn *txn, char const *num) {
+    if (txn == NULL)
+        return false;
+    Number number;
+    return !number_parse(&number, num) || txn_stage(txn, &number, NULL);
+}
+
+/**
+ * @brief Wyznacza wypadkowy skutek zmian transakcji.
+ * Zmiany muszą być posortowane według prefiksów @p num1 i kolejności
+ * zapamiętania. Usunięcie anuluje wcześniejsze dodania przekierowań, których
+ * prefiksy rozszerzają usuwany prefiks, a z dodań o tym samym prefiksie
+ * obowiązuje ostatnie. Pozostałe dodania można więc wykonać po wszystkich
+ * usunięciach, które dotyczą wtedy tylko przekierowań sprzed transakcji.
+ * Usunięcia są przeglądane ze stosem usunięć, których prefiksy są prefiksami
+ * bieżącego napisu, i pomijane, jeśli obejmuje je krótsze usunięcie.
+ * @param[in,out] rules - tablica zmian; na jej początek trafiają dodania o
+ *                        różnych prefiksach, w porządku rosnącym;
+ * @param[in] count - ilość zmian;
+ * @param[out] stack - bufor na co najmniej @p count usunięć;
+ * @param[out] removals - tablica na usunięcia o prefiksach niebędących
+ *                        wzajemnie swoimi prefiksami, w porządku rosnącym;
+ * @param[out] adds - wskaźnik na ilość dodań;
+ * @param[out] removes - wskaźnik na ilość usunięć.
+ */
+static void txn_normalize(BulkRule* rules, size_t count, BulkRule* stack,
+                          BulkRule* removals, size_t* adds, size_t* removes) {
+    size_t top = 0, kept = 0, cut = 0;
+    for (size_t i = 0; i < count; i++) {
+        BulkRule rule = rules[i];
+        while (top > 0 && (stack[top - 1].num1_len > rule.num1_len
+                           || memcmp(stack[top - 1].num1, rule.num1, stack[top - 1].num1_len) != 0))
+            top--;
+        // Pole order elementu stosu to pozycja najpóźniejszego usunięcia
+        // obejmującego jego prefiks.
+        bool covered = top > 0;
+        size_t latest = covered ? stack[top - 1].order : 0;
+        bool replaces = kept > 0 && strcmp(rules[kept - 1].num1, rule.num1) == 0;
+
+        if (rule.num2 == NULL) {
+            if (!covered)
+                removals[cut++] = rule;
+            kept -= replaces;
+            if (covered && latest > rule.order)
+                rule.order = latest;
+            stack[top++] = rule;
+        }
+        else if (!covered || latest < rule.order) {
+            kept -= replaces;
+            rules[kept++] = rule;
+        }
+    }
+    *adds = kept;
+    *removes = cut;
+}
+
+/**
+ * @brief Wyznacza dodania obejmowane przez usunięcie.
+ * Kolejne wywołania muszą dotyczyć usunięć w porządku rosnącym.
+ * @param[in] removal - wskaźnik na usunięcie;
+ * @param[in] adds - posortowana tablica dodań;
+ * @param[in] count - ilość dodań;
+ * @param[in,out] first - wskaźnik na pozycję pierwszego dodania, które nie
+ *                        poprzedza prefiksu @p removal, początkowo 0.
+ * @return Pozycja za ostatnim dodaniem, którego prefiks rozszerza usuwany
+ * prefiks, równa *@p first, jeśli takich dodań nie ma.
+ */
+static size_t txn_covered(const BulkRule* removal, const BulkRule* adds, size_t count,
+                          size_t* first) {
+    while (*first < count && strcmp(adds[*first].num1, removal->num1) < 0)
+        (*first)++;
+    size_t end = *first;
+    while (end < count && strncmp(adds[end].num1, removal->num1, removal->num1_len) == 0)
+        end++;
+    return end;
+}
+
+/**
+ * @brief Zwalnia niepodłączone drzewo dodań.
+ * Przekierowania drzewa nie zostały jeszcze dodane do drzewa odwróconych
+ * przekierowań, więc są tylko odliczane od statystyk.
+ * @param[in,out] pf - wskaźnik na strukturę, do której należą węzły;
+ * @param[in] root - wskaźnik na korzeń drzewa bez rodzica.
+ */
+static void txn_free_detached(PhoneForward* pf, PhoneFwd* root) {
+    size_t depth = 0;
+    PhoneFwd* node = fwd_first_leaf(root, &depth);
+    for (;;) {
+        PhoneFwd* next = node == root ? NULL : fwd_next_sibling(node);
+        PhoneFwd* parent = node->parent;
+        bool last = node == root;
+        if (next != NULL)
+            next = fwd_first_leaf(next, &depth);
+        if (node->forwarded_prefix != NULL)
+            count_rule(pf, node->forwarded_prefix, node->depth, false);
+        free_node(pf, node);
+        if (last)
+            return;
+        node = next != NULL ? next : parent;
+    }
+}
+
+/**
+ * @brief Zwalnia bufory planu zatwierdzenia transakcji.
+ * @param[in,out] plan - wskaźnik na plan.
+ */
+static void txn_plan_free(TxnPlan* plan) {
+    free(plan->forwarded);
+    free(plan->targets);
+    free(plan->grafts);
+}
+
+/**
+ * @brief Wycofuje przygotowanie transakcji.
+ * Zwalnia niepodłączone drzewa dodań i utworzone prefiksy docelowe oraz
+ * przywraca zwartość drzewa przekierowań w węzłach utworzonych dla dodań
+ * wstawianych pojedynczo. Nieudane wstawienie mogło scalić wcześniej
+ * utworzone węzły, więc są one wyszukiwane od nowa. Węzły drzewa odwróconych
+ * przekierowań pozostają, tak jak w funkcji phfwdAdd, i nie wpływają na
+ * wyniki.
+ * @param[in,out] pf - wskaźnik na strukturę;
+ * @param[in] adds - tablica dodań;
+ * @param[in] count - ilość dodań;
+ * @param[in,out] plan - wskaźnik na plan, którego bufory są zwalniane.
+ */
+static void txn_rollback(PhoneForward* pf, const BulkRule* adds, size_t count,
+                         TxnPlan* plan) {
+    for (size_t i = 0; i < plan->graft_count; i++)
+        if (plan->grafts[i].root != NULL)
+            txn_free_detached(pf, plan->grafts[i].root);
+    for (size_t i = 0; i < count && plan->forwarded != NULL; i++) {
+        if (plan->forwarded[i] == NULL)
+            continue;
+        prefix_free(&pf->pool, plan->forwarded[i]);
+        Number number;
+        number_parse(&number, adds[i].num1);
+        PhoneFwd* node = go_to_prefix(pf->tree, &number);
+        if (node != NULL && node->depth == number.length)
+            fwd_compact(pf, node);
+    }
+    txn_plan_free(plan);
+}
+
+/**
+ * @brief Zapewnia miejsce na dodawane przekierowania w drzewie odwróconych
+ * przekierowań.
+ * Porządkuje dodania według prefiksów @p num2 i dla każdego prefiksu raz
+ * schodzi od miejsca rozejścia z poprzednim prefiksem, zapewniając w węźle
+ * miejsce na wszystkie prowadzące na niego przekierowania.
+ * @param[in,out] pf - wskaźnik na strukturę;
+ * @param[in] adds - tablica dodań;
+ * @param[in] count - ilość dodań;
+ * @param[out] targets - tablica na węzły kolejnych dodań.
+ * @return true - jeśli miejsce zostało zapewnione.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool txn_reserve_backward(PhoneForward* pf, BulkRule* adds, size_t count,
+                                 PhoneBwd** targets) {
+    BulkRule** sorted = malloc(sizeof(BulkRule*) * (count == 0 ? 1 : count));
+    if (sorted == NULL)
+        return false;
+    bool ordered = true;
+    for (size_t i = 0; i < count; i++) {
+        sorted[i] = &adds[i];
+        if (i > 0 && ordered && bulk_by_num2(&sorted[i - 1], &sorted[i]) > 0)
+            ordered = false;
+    }
+    if (!ordered)
+        qsort(sorted, count, sizeof(BulkRule*), bulk_by_num2);
+
+    PhoneBwd* pbd_node = pf->backward_tree;
+    size_t depth = 0;
+    bool result = true;
+    for (size_t first = 0, last; first < count && result; first = last) {
+        last = first + 1;
+        while (last < count && bulk_by_num2(&sorted[first], &sorted[last]) == 0)
+            last++;
+        size_t common = first == 0 ? 0 : common_prefix(sorted[first - 1]->num2,
+                                                       sorted[first]->num2);
+        for (; depth > common; depth--)
+            pbd_node = pbd_node->parent;
+
+        Number number;
+        number_parse(&number, sorted[first]->num2);
+        pbd_node = reserve_backward_node(pf, pbd_node, depth, &number, last - first);
+        result = pbd_node != NULL;
+        depth = number.length;
+        for (size_t i = first; i < last; i++)
+            targets[sorted[i] - adds] = pbd_node;
+    }
+    free(sorted);
+    return result;
+}
+
+/**
+ * @brief Przygotowuje zatwierdzenie transakcji.
+ * Wykonuje wszystkie alokacje potrzebne do zatwierdzenia. Dodania objęte
+ * usunięciem istniejącego poddrzewa są budowane jak przy ładowaniu hurtowym
+ * pod niepodłączonym węzłem, który zastąpi to poddrzewo. Dla pozostałych
+ * dodań tworzy prefiksy docelowe i wstawia do drzewa przekierowań ich węzły,
+ * zaczynając każde wstawienie od miejsca rozejścia z poprzednim prefiksem.
+ * Zapewnia też miejsce w drzewie odwróconych przekierowań. Nie zmienia
+ * przekierowań struktury, a w przypadku błędu wycofuje zmiany w drzewach.
+ * @param[in,out] pf - wskaźnik na niepustą strukturę;
+ * @param[out] plan - wskaźnik na wypełniany plan;
+ * @param[in,out] adds - posortowana tablica dodań, w której zapisywane są
+ *                       węzły drzewa przekierowań;
+ * @param[in] add_count - ilość dodań;
+ * @param[in] removals - posortowana tablica usunięć;
+ * @param[in] remove_count - ilość usunięć.
+ * @return true - jeśli zatwierdzenie zostało przygotowane.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool txn_prepare(PhoneForward* pf, TxnPlan* plan, BulkRule* adds, size_t add_count,
+                        const BulkRule* removals, size_t remove_count) {
+    size_t slots = add_count == 0 ? 1 : add_count;
+    *plan = (TxnPlan){calloc(slots, sizeof(uint8_t*)), malloc(sizeof(PhoneBwd*) * slots),
+                      malloc(sizeof(TxnGraft) * (remove_count == 0 ? 1 : remove_count)), 0};
+    bool result = plan->forwarded != NULL && plan->targets != NULL && plan->grafts != NULL;
+    for (size_t i = 0, next = 0; i < remove_count && result; i++) {
+        size_t end = txn_covered(&removals[i], adds, add_count, &next);
+        if (end == next)
+            continue;
+        Number number;
+        number_parse(&number, removals[i].num1);
+        plan->grafts[plan->graft_count++] = (TxnGraft){go_to_prefix(pf->tree, &number), NULL,
+                                                       next, end, i};
+    }
+
+    PhoneFwd* previous = pf->tree;
+    const char* before = "";
+    size_t max_len = 0;
+    for (size_t i = 0, graft = 0; i < add_count && result; i++) {
+        max_len = adds[i].num1_len > max_len ? adds[i].num1_len : max_len;
+        for (; graft < plan->graft_count && plan->grafts[graft].end <= i; graft++)
+            ;
+        if (graft < plan->graft_count && plan->grafts[graft].first <= i
+            && plan->grafts[graft].replaced != NULL)
+            continue;
+        Number number;
+        number_parse(&number, adds[i].num1);
+        size_t common = common_prefix(before, adds[i].num1);
+        while (previous->depth > common)
+            previous = previous->parent;
+        plan->forwarded[i] = prefix_create(&pf->pool, adds[i].num2, adds[i].num2_len);
+        adds[i].node = plan->forwarded[i] == NULL ? NULL : fwd_insert(pf, previous, &number);
+        result = adds[i].node != NULL;
+        previous = adds[i].node;
+        before = adds[i].num1;
+    }
+
+    // Wstawienia mogły podzielić krawędzie nad zastępowanymi poddrzewami, więc
+    // drzewa dodań są budowane dopiero po nich.
+    for (size_t i = 0; i < plan->graft_count && result; i++) {
+        TxnGraft* graft = &plan->grafts[i];
+        if (graft->replaced == NULL)
+            continue;
+        PhoneFwd* root = phf_create_node(pf, NULL);
+        result = root != NULL;
+        if (result) {
+            root->depth = graft->replaced->parent->depth;
+            result = bulk_build_forward(pf, root, adds + graft->first,
+                                        graft->end - graft->first, max_len);
+            if (result)
+                graft->root = root;
+            else
+                txn_free_detached(pf, root);
+        }
+    }
+    result = result && txn_reserve_backward(pf, adds, add_count, plan->targets);
+
+    if (!result)
+        txn_rollback(pf, adds, add_count, plan);
+    return result;
+}
+
+/**
+ * @brief Zastępuje poddrzewo usuwanego prefiksu drzewem dodań.
+ * Podłącza jedyne dziecko niepodłączonego węzła w miejsce zastępowanego
+ * poddrzewa, które jest zwalniane razem z przekierowaniami, i dodaje nowe
+ * przekierowania do drzewa odwróconych przekierowań. Nowe przekierowania są
+ * przeglądane w porządku rosnącym, więc liczniki powtórzeń wyznaczane od
+ * przodków uwzględniają też wcześniejsze nowe przekierowania, a żadne stare
+ * przekierowanie nie leży pod nowym. Nie alokuje pamięci.
+ * @param[in,out] pf - wskaźnik na strukturę;
+ * @param[in] graft - wskaźnik na opis zastępowanego poddrzewa;
+ * @param[in] adds - posortowana tablica dodań;
+ * @param[in] targets - węzły drzewa odwróconych przekierowań kolejnych dodań.
+ */
+static void txn_graft(PhoneForward* pf, const TxnGraft* graft, const BulkRule* adds,
+                      PhoneBwd* const* targets) {
+    PhoneFwd* replaced = graft->replaced;
+    PhoneFwd* parent = replaced->parent;
+    PhoneFwd* top = child_slots(&graft->root->children)[0];
+    size_t removed = replaced->rules_below + (replaced->forwarded_prefix != NULL);
+    for (PhoneFwd* ancestor = parent; ancestor != NULL; ancestor = ancestor->parent)
+        ancestor->rules_below = ancestor->rules_below - removed + graft->root->rules_below;
+    release_subtree(pf, replaced);
+    // Miejsce w tablicy dzieci jest zajęte, więc podmiana nie alokuje pamięci.
+    top->parent = parent;
+    fwd_link(pf, parent, fwd_label_digit(top, 0), top);
+    free_node(pf, graft->root);
+    fwd_spread_rule(top, true);
+
+    for (size_t i = graft->first; i < graft->end; i++) {
+        PhoneFwd* node = adds[i].node;
+        node->witnesses = count_witnesses(node, targets[i], adds[i].num1, adds[i].num2,
+                                          adds[i].num2_len);
+        add_to_backward_node(targets[i], node);
+    }
+}
+
+/**
+ * @brief Wykonuje wypadkowe zmiany transakcji.
+ * Pustą strukturę buduje od nowa tak jak funkcja phfwdBulkLoad. W przeciwnym
+ * przypadku najpierw przygotowuje wszystkie alokacje, a następnie, już bez
+ * możliwości błędu, podmienia poddrzewa usuwanych prefiksów obejmujących
+ * dodania, zapisuje pozostałe dodawane przekierowania w przygotowanych
+ * węzłach i usuwa poddrzewa pozostałych usuwanych prefiksów.
+ * @param[in,out] pf - wskaźnik na strukturę;
+ * @param[in,out] adds - posortowana tablica dodań o różnych prefiksach;
+ * @param[in] add_count - ilość dodań;
+ * @param[in] removals - posortowana tablica usunięć;
+ * @param[in] remove_count - ilość usunięć.
+ * @return true - jeśli zmiany zostały wykonane.
+ * @return false - jeśli nie udało się alokować pamięci. Struktura pozostaje
+ * wtedy niezmieniona.
+ */
+static bool txn_apply(PhoneForward* pf, BulkRule* adds, size_t add_count,
+                      const BulkRule* removals, size_t remove_count) {
+    if (pf->tree->children.mask == 0) {
+        size_t max1 = 0, max2 = 0;
+        for (size_t i = 0; i < add_count; i++) {
+            max1 = adds[i].num1_len > max1 ? adds[i].num1_len : max1;
+            max2 = adds[i].num2_len > max2 ? adds[i].num2_len : max2;
+        }
+        return add_count == 0 || bulk_load_empty(pf, adds, add_count, max1, max2);
+    }
+
+    TxnPlan plan;
+    if (!txn_prepare(pf, &plan, adds, add_count, removals, remove_count))
+        return false;
+    // Podmiany poprzedzają zmiany, które mogłyby scalić rodziców poddrzew.
+    for (size_t i = 0; i < plan.graft_count; i++)
+        if (plan.grafts[i].root != NULL)
+            txn_graft(pf, &plan.grafts[i], adds, plan.targets);
+    for (size_t i = 0; i < add_count; i++)
+        if (plan.forwarded[i] != NULL)
+            fwd_set_rule(pf, adds[i].node, plan.targets[i], plan.forwarded[i], adds[i].num1,
+                         adds[i].num2, adds[i].num2_len);
+
+    for (size_t i = 0, graft = 0; i < remove_count; i++) {
+        if (graft < plan.graft_count && plan.grafts[graft].removal == i) {
+            graft++;
+            continue;
+        }
+        Number number;
+        number_parse(&number, removals[i].num1);
+        delete_tree(pf, go_to_prefix(pf->tree, &number));
+    }
+    txn_plan_free(&plan);
+    return true;
+}
+
+/**
+ * To jest struktura opisująca wypadkowe zmiany transakcji w trybie
+ * współbieżnym.
+ */
+struct TxnChange {
+    BulkRule* adds;             ///< Posortowana tablica dodań o różnych prefiksach.
+    size_t add_count;           ///< Ilość dodań.
+    const BulkRule* removals;   ///< Posortowana tablica usunięć.
+    size_t remove_count;        ///< Ilość usunięć.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct TxnChange TxnChange;
+
+/**
+ * @brief Wykonuje zmiany transakcji w kopii przekierowań.
+ * Zmiana wykonywana przez funkcję phfwdTxnCommit w trybie współbieżnym.
+ * Dodania są już uporządkowane, więc ta sama tablica służy obu kopiom.
+ * @param[in,out] copy - wskaźnik na kopię przekierowań;
+ * @param[in,out] arg - wskaźnik na opis zmian typu TxnChange.
+ * @return true - jeśli zmiany zostały wykonane.
+ * @return false - jeśli nie udało się alokować pamięci. Kopia pozostaje wtedy
+ * niezmieniona.
+ */
+static bool concurrent_txn(PhoneForward* copy, void* arg) {
+    TxnChange* change = arg;
+    return txn_apply(copy, change->adds, change->add_count, change->removals,
+                     change->remove_count);
+}
+
+/**
+ * @brief Wykonuje zmiany transakcji w trybie współbieżnym.
+ * Funkcja pomocnicza dla funkcji phfwdTxnCommit. Zmiany są opisywane dla
+ * funkcji concurrent_write najpierw usunięciami, a potem dodaniami, bo
+ * dodania anulowane późniejszymi usunięciami są już pominięte.
+ * @param[in,out] pf - wskaźnik na strukturę w trybie współbieżnym;
+ * @param[in,out] change - wskaźnik na opis zmian.
+ * @return true - jeśli zmiany zostały opublikowane.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool concurrent_commit(PhoneForward* pf, TxnChange* change) {
+    size_t count = change->remove_count + change->add_count;
+    const char** record = malloc(sizeof(char*) * 2 * count);
+    if (record == NULL)
+        return false;
+    const char** num2 = record + count;
+    for (size_t i = 0; i < change->remove_count; i++) {
+        record[i] = change->removals[i].num1;
+        num2[i] = NULL;
+    }
+    for (size_t i = 0; i < change->add_count; i++) {
+        record[change->remove_count + i] = change->adds[i].num1;
+        num2[change->remove_count + i] = change->adds[i].num2;
+    }
+    bool result = concurrent_write(pf, concurrent_txn, change, record, num2, count);
+    free(record);
+    return result;
+}
+
+/** @brief Zatwierdza transakcję.
+ * Wykonuje zmiany zapamiętane w transakcji @p txn tak, jakby zostały
+ * wykonane kolejnymi wywołaniami funkcji @ref phfwdAdd i @ref phfwdRemove w
+ * kolejności zapamiętania, i usuwa transakcję. Zmiany są wykonywane w całości
+ * albo wcale. Najpierw wyznaczany jest ich wypadkowy skutek: zmiany są
+ * sortowane według prefiksów, a dodania anulowane późniejszymi usunięciami
+ * pomijane. Następnie wszystkie potrzebne alokacje są wykonywane przed
+ * pierwszą zmianą przekierowań, a w przypadku błędu wycofywane. Posortowane
+ * dodania są wstawiane do drzewa przekierowań od miejsca rozejścia z
+ * poprzednim prefiksem, a poddrzewo usuwanego prefiksu, pod którym są
+ * dodawane przekierowania, jest zastępowane w całości nowym drzewem. W drzewie
+ * odwróconych przekierowań każdy prefiks docelowy jest wyszukiwany raz. W
+ * trybie współbieżnym blokada piszących jest zakładana raz, a zmiany są
+ * publikowane razem, po wykonaniu wszystkich.
+ * @param[in] txn – wskaźnik na zatwierdzaną transakcję.
+ * @return Wartość @p true, jeśli zmiany zostały wykonane.
+ *         Wartość @p false, jeśli @p txn ma wartość NULL lub nie udało się
+ *         alokować pamięci. Struktura pozostaje wtedy niezmieniona.
+ */
+bool phfwdTxnCommit(PhoneForwardTxn *txn) {
+    if (txn == NULL)
+        return false;
+    PhoneForward* pf = txn->pf;
+    size_t count = txn->count, slots = count == 0 ? 1 : count;
+    BulkRule* rules = malloc(sizeof(BulkRule) * slots);
+    BulkRule* removals = malloc(sizeof(BulkRule) * slots);
+    BulkRule* stack = malloc(sizeof(BulkRule) * slots);
+    bool result = rules != NULL && removals != NULL && stack != NULL;
+    size_t adds = 0, removes = 0;
+    if (result) {
+        for (size_t i = 0; i < count; i++) {
+            const TxnOp* op = &txn->ops[i];
+            rules[i] = (BulkRule){txn->text + op->num1, op->num1_len,
+                                  op->num2_len == 0 ? NULL : txn->text + op->num2,
+                                  op->num2_len, i, NULL, NULL};
+        }
+        qsort(rules, count, sizeof(BulkRule), bulk_by_num1);
+        txn_normalize(rules, count, stack, removals, &adds, &removes);
+    }
+
+    if (result && adds + removes > 0) {
+        TxnChange change = {rules, adds, removals, removes};
+        result = pf->concurrent == NULL ? txn_apply(pf, rules, adds, removals, removes)
+                                        : concurrent_commit(pf, &change);
+    }
+    free(rules);
+    free(removals);
+    free(stack);
+    phfwdTxnAbort(txn);
+    return result;
+}
+
+/** @brief Porzuca transakcję.
+ * Usuwa transakcję wskazywaną przez @p txn bez wykonywania zapamiętanych w
+ * niej zmian. Nic nie robi, jeśli wskaźnik ten ma wartość NULL.
+ * @param[in] txn – wskaźnik na usuwaną transakcję.
+ */
+void phfwdTxnAbort(PhoneForwardTxn *txn) {
+    if (txn == NULL)
+        return;
+    free(txn->ops);
+    free(txn->text);
+    free(txn);
+}
+
+/** @brief Wyznacza statystyki rozmiaru struktury.
+ * Zapisuje do @p stats ilości węzłów obu drzew i przekierowań, rozmiary
+ * napisów, tablic i węzłów, histogram długości prefiksów przekierowywanych
+ * oraz średnią ilość dzieci węzła. Wartości są aktualizowane przy każdej
+ * modyfikacji struktury, więc wywołanie nie przechodzi po drzewach i działa w
+ * czasie stałym.
+ * @param[in] pf     – wskaźnik na strukturę przechowującą przekierowania
+ *                     numerów;
+ * @param[out] stats – wskaźnik na strukturę na statystyki.
+ * @return Wartość @p true, jeśli statystyki zostały wyznaczone.
+ *         Wartość @p false, jeśli któryś ze wskaźników ma wartość NULL.
+ */
+bool phfwdStats(PhoneForward const *pf, PhoneForwardStats *stats) {
+    if (pf == NULL || stats == NULL)
+        return false;
+    if (pf->concurrent != NULL) {
+        unsigned slot;
+        bool result = phfwdStats(snapshot_acquire(pf, &slot), stats);
+        snapshot_release(pf, slot);
+        return result;
+    }
+    *stats = pf->stats;
+    stats->node_bytes = stats->forward_nodes * sizeof(PhoneFwd)
+                        + stats->backward_nodes * sizeof(PhoneBwd);
+    stats->pool_bytes = pf->pool.reserved;
+    // Każdy węzeł poza korzeniem jest dzieckiem dokładnie jednego węzła.
+    stats->average_fan_out = pf->inner_nodes == 0 ? 0.0
+        : (double)(stats->forward_nodes - 1) / (double)pf->inner_nodes;
+    return true;
+}
+
+/**
+ * To jest nagłówek bloku pamięci przechowującego zamrożone drzewa przekierowań.
+ * Ten sam blok jest zapisywany do pliku, więc nagłówek opisuje rozmiary
+ * wszystkich sekcji, które następują po nim w kolejności: węzły drzewa
+ * przekierowań, węzły drzewa odwróconych przekierowań, tablica odwróconych
+ * przekierowań i pula napisów.
+ */
+struct FrozenHeader {
+    char magic[4];                  ///< Sygnatura "PHFZ".
+    uint32_t version;               ///< Wersja układu, @ref FROZEN_VERSION.
+    uint32_t byte_order;            ///< Wartość @ref FROZEN_BYTE_ORDER zapisana przez twórcę.
+    uint32_t node_count;            ///< Ilość węzłów drzewa przekierowań.
+    uint32_t bwd_node_count;        ///< Ilość węzłów drzewa odwróconych przekierowań.
+    uint32_t entry_count;           ///< Ilość odwróconych przekierowań.
+    uint32_t strings_size;          ///< Rozmiar puli napisów w bajtach.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct FrozenHeader FrozenHeader;
+
+/**
+ * To jest struktura przechowująca węzeł zamrożonego drzewa przekierowań.
+ * Węzły są ułożone w tablicy w kolejności przeszukiwania wszerz, więc dzieci
+ * każdego węzła zajmują kolejne pozycje tablicy. Zamiast wskaźników węzeł
+ * przechowuje indeksy i przesunięcia w puli napisów.
  */
-bool phfwdAdd(PhoneForward *pf, char const *num1, char const *num2) {
-    if (pf == NULL || num1 == NULL || num2 == NULL)
-        return false;
+struct FrozenNode {
+    uint32_t first_child;           ///< Indeks pierwszego dziecka węzła.
+    uint32_t label;                 ///< Przesunięcie etykiety w puli napisów.
+    uint32_t label_len;             ///< Długość etykiety.
+    uint32_t forwarded;             ///< Przesunięcie przekierowania lub @ref FROZEN_NONE.
+    uint16_t mask;                  ///< Mapa bitowa cyfr, dla których istnieje dziecko.
+};
 
-    PhoneFwd * pfd_node = pf->tree;
-    size_t iterator = 0;
-    char* forwarded = NULL;
-    if (!check_parameters(pf, num1, num2, &iterator))
-        return false;
-    // Dodatkowe miejsce na '\0'.
-    forwarded = malloc(sizeof(char) * (iterator + 1)); 
-    if (forwarded == NULL)
-        return false;
-    iterator = 0;
-    while (is_number(num2[iterator])) {
-        forwarded[iterator] = num2[iterator];
-        iterator++;
-    }
-    // Dodanie znaku końca napisu.
-    forwarded[iterator] = '\0';
-    // Dodawanie numeru do drzewa prefiksowego.
-    iterator = 0;
-    if (!is_number(num1[iterator])) {
-        free(forwarded);
-        return false;
-    }
-    while (is_number(num1[iterator + 1])) {
-        int value = convert_to_number(num1[iterator]);
-        if (pfd_node->children[value] == NULL) 
-            pfd_node->children[value] = phf_create_node(pfd_node);
-        if (pfd_node->children[value] == NULL) {
-            free(forwarded);
-            return false;
-        }   
-        pfd_node = pfd_node->children[value];
-        iterator++;
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct FrozenNode FrozenNode;
+
+/**
+ * To jest struktura przechowująca węzeł zamrożonego drzewa odwróconych
+ * przekierowań. Węzły są ułożone wszerz tak jak w drzewie przekierowań,
+ * a przekierowania na prefiks węzła zajmują kolejne pozycje tablicy
+ * odwróconych przekierowań.
+ */
+struct FrozenBwdNode {
+    uint32_t first_child;           ///< Indeks pierwszego dziecka węzła.
+    uint32_t first_entry;           ///< Indeks pierwszego odwróconego przekierowania.
+    uint32_t entry_count;           ///< Ilość odwróconych przekierowań węzła.
+    uint16_t mask;                  ///< Mapa bitowa cyfr, dla których istnieje dziecko.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct FrozenBwdNode FrozenBwdNode;
+
+/**
+ * To jest struktura przechowująca niezmienną kopię przekierowań.
+ * Cała zawartość zajmuje jeden ciągły blok pamięci opisany nagłówkiem
+ * @ref FrozenHeader. Blok jest alokowany przez @ref phfwdFreeze albo
+ * odwzorowywany z pliku przez @ref phfwdFrozenMap.
+ */
+struct PhoneForwardFrozen {
+    const FrozenHeader* header;     ///< Nagłówek bloku.
+    const FrozenNode* nodes;        ///< Węzły drzewa przekierowań, korzeń ma indeks 0.
+    const FrozenBwdNode* bwd_nodes; ///< Węzły drzewa odwróconych przekierowań.
+    const uint32_t* entries;        ///< Przesunięcia napisów odwróconych przekierowań.
+    const char* strings;            ///< Pula napisów.
+    void* block;                    ///< Początek bloku.
+    size_t mapped_size;             ///< Rozmiar odwzorowania pliku lub 0 dla bloku alokowanego.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct PhoneForwardFrozen PhoneForwardFrozen;
+
+/**
+ * @brief Wyznacza położenie sekcji bloku zamrożonych drzew.
+ * Na podstawie rozmiarów zapisanych w nagłówku wyznacza przesunięcia sekcji
+ * względem początku bloku i ustawia wskaźniki struktury @p pff.
+ * @param[in,out] pff - wskaźnik na strukturę z ustawionym polem @p block;
+ * @param[in] header - nagłówek opisujący blok.
+ * @return Rozmiar całego bloku w bajtach.
+ */
+static uint64_t frozen_layout(PhoneForwardFrozen* pff, const FrozenHeader* header) {
+    uint64_t nodes_offset = sizeof(FrozenHeader);
+    uint64_t bwd_offset = nodes_offset + (uint64_t)sizeof(FrozenNode) * header->node_count;
+    uint64_t entries_offset = bwd_offset
+                              + (uint64_t)sizeof(FrozenBwdNode) * header->bwd_node_count;
+    uint64_t strings_offset = entries_offset + (uint64_t)sizeof(uint32_t) * header->entry_count;
+    uint64_t total = strings_offset + header->strings_size;
+
+    if (pff != NULL) {
+        char* block = pff->block;
+        pff->header = (const FrozenHeader*)block;
+        pff->nodes = (const FrozenNode*)(block + nodes_offset);
+        pff->bwd_nodes = (const FrozenBwdNode*)(block + bwd_offset);
+        pff->entries = (const uint32_t*)(block + entries_offset);
+        pff->strings = block + strings_offset;
     }
-    if (num1[iterator + 1] != '\0') {
-        free(forwarded);
-        return false;
+    return total;
+}
+
+/**
+ * @brief Układa węzły drzewa odwróconych przekierowań w kolejności wszerz.
+ * Funkcja pomocnicza dla funkcji phfwdFreeze. Zlicza również odwrócone
+ * przekierowania i długość ich napisów.
+ * @param[in] root - wskaźnik na korzeń drzewa odwróconych przekierowań;
+ * @param[out] count - ilość węzłów;
+ * @param[out] entry_count - ilość odwróconych przekierowań;
+ * @param[out] strings_size - łączna długość napisów wraz ze znakami końca napisu.
+ * @return Tablica węzłów, którą należy zwolnić funkcją free, lub NULL, gdy nie
+ * udało się alokować pamięci.
+ */
+static PhoneBwd ** bwd_order(PhoneBwd* root, size_t* count, size_t* entry_count,
+                             size_t* strings_size) {
+    size_t capacity = 16, tail = 1;
+    PhoneBwd** order = malloc(sizeof(PhoneBwd*) * capacity);
+    if (order == NULL)
+        return NULL;
+    order[0] = root;
+    *entry_count = 0;
+    *strings_size = 0;
+
+    for (size_t head = 0; head < tail; head++) {
+        PhoneBwd* node = order[head];
+        int sons = POPCOUNT(node->children.mask);
+        if (tail + sons > capacity) {
+            capacity = (tail + sons) * 2;
+            PhoneBwd** resized = realloc(order, sizeof(PhoneBwd*) * capacity);
+            if (resized == NULL) {
+                free(order);
+                return NULL;
+            }
+            order = resized;
+        }
+        void* const * slots = child_slots(&node->children);
+        for (int i = 0; i < sons; i++)
+            order[tail++] = slots[i];
+
+        *entry_count += node->size;
+        for (size_t i = 0; i < node->size; i++)
+            *strings_size += fwd_depth(node->forwarding[i]) + 1;
     }
-    int value = convert_to_number(num1[iterator]);
-    if (pfd_node->children[value] == NULL)
-        pfd_node->children[value] = phf_create_node(pfd_node);
-    if (pfd_node->children[value] == NULL) {
-        free(forwarded);
+    *count = tail;
+    return order;
+}
+
+/**
+ * @brief Zapisuje drzewo przekierowań w bloku zamrożonych drzew.
+ * Funkcja pomocnicza dla funkcji phfwdFreeze.
+ * @param[in] pf - wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in,out] pff - wskaźnik na zamrożone drzewa z ustawionym układem bloku;
+ * @param[in,out] used - ilość zajętych bajtów puli napisów.
+ * @return true - jeśli alokowanie pamięci się powiodło.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool freeze_forward_tree(const PhoneForward* pf, PhoneForwardFrozen* pff,
+                                size_t* used) {
+    size_t node_count = pff->header->node_count;
+    FrozenNode* nodes = (FrozenNode*)pff->nodes;
+    char* strings = (char*)pff->strings;
+    PhoneFwd** order = malloc(sizeof(PhoneFwd*) * node_count);
+    if (order == NULL)
         return false;
-    }   
-    pfd_node = pfd_node->children[value];
 
-    if (pfd_node->forwarded_prefix != NULL) {
-        delete_forward_from_bwd(pf->backward_tree, pfd_node->forwarded_prefix, num1);
-        free(pfd_node->forwarded_prefix);
+    // Przejście wszerz: kolejka węzłów jest jednocześnie ich docelową kolejnością.
+    size_t tail = 1;
+    order[0] = pf->tree;
+    for (size_t head = 0; head < node_count; head++) {
+        PhoneFwd* node = order[head];
+        FrozenNode* frozen = &nodes[head];
+        frozen->first_child = (uint32_t)tail;
+        frozen->mask = node->children.mask;
+        void* const * slots = child_slots(&node->children);
+        for (int i = 0; i < POPCOUNT(node->children.mask); i++)
+            order[tail++] = slots[i];
+
+        frozen->label = (uint32_t)*used;
+        frozen->label_len = (uint32_t)node->label_len;
+        packed_to_ascii(fwd_label(node), node->label_len, strings + *used);
+        *used += node->label_len;
+        frozen->forwarded = FROZEN_NONE;
+        if (node->forwarded_prefix != NULL) {
+            size_t length = prefix_length(node->forwarded_prefix);
+            frozen->forwarded = (uint32_t)*used;
+            prefix_write(node->forwarded_prefix, strings + *used);
+            strings[*used + length] = '\0';
+            *used += length + 1;
+        }
     }
-    pfd_node->forwarded_prefix = forwarded;
-    return add_forward_to_backward_tree(pf->backward_tree, num1, num2);
+    free(order);
+    return true;
 }
 
 /**
- * @brief Funkcja przechodząca do węzła drzewa po podanym napisie.
- * Funkcja przyjmuje napis i przechodzi po drzewie przekierowań po znakach 
- * tego napisu. Po przeczytaniu wszystkich znaków lub napotkaniu NULL-a w 
- * drzewie kończy działanie. W przypadku sukcesu zwraca węzeł na, na którym
- * zakończyło się działanie.
- * @param[in] pfd_node - wskaźnik na korzeń drzewa przekierowań;
- * @param[in] num - napis określający węzeł do którego funkcja ma się dostać.
- * @return Wskaźnik na węzeł opisany przez napis @p num lub NULL w przypadku,
- * gdy ten węzeł nie występuje w drzewie.
+ * @brief Zapisuje drzewo odwróconych przekierowań w bloku zamrożonych drzew.
+ * Funkcja pomocnicza dla funkcji phfwdFreeze.
+ * @param[in] order - węzły drzewa odwróconych przekierowań w kolejności wszerz;
+ * @param[in,out] pff - wskaźnik na zamrożone drzewa z ustawionym układem bloku;
+ * @param[in,out] used - ilość zajętych bajtów puli napisów.
  */
-static PhoneFwd * go_to_prefix(PhoneFwd *pfd_node, char const *num) {
-    if (num == NULL)
-        return NULL;
-    if (!is_number(num[0]))
-        return NULL;
+static void freeze_backward_tree(PhoneBwd* const * order, PhoneForwardFrozen* pff,
+                                 size_t* used) {
+    FrozenBwdNode* nodes = (FrozenBwdNode*)pff->bwd_nodes;
+    uint32_t* entries = (uint32_t*)pff->entries;
+    char* strings = (char*)pff->strings;
+    size_t tail = 1, entry = 0;
 
-    size_t iterator = 0;
+    for (size_t head = 0; head < pff->header->bwd_node_count; head++) {
+        PhoneBwd* node = order[head];
+        FrozenBwdNode* frozen = &nodes[head];
+        frozen->first_child = (uint32_t)tail;
+        frozen->mask = node->children.mask;
+        tail += POPCOUNT(node->children.mask);
 
-    while (is_number(num[iterator])) {
-        int value = convert_to_number(num[iterator]);
-        if (pfd_node->children[value] == NULL) 
-            return NULL;
-        
-        pfd_node = pfd_node->children[value];
-        iterator++;
+        frozen->first_entry = (uint32_t)entry;
+        frozen->entry_count = (uint32_t)node->size;
+        for (size_t i = 0; i < node->size; i++) {
+            size_t depth = fwd_depth(node->forwarding[i]);
+            entries[entry++] = (uint32_t)*used;
+            fwd_write_path(node->forwarding[i], strings + *used, depth);
+            strings[*used + depth] = '\0';
+            *used += depth + 1;
+        }
     }
-    if (is_number(num[iterator]) != '\0')
-        return NULL;
-    return pfd_node;
 }
 
-/** @brief Usuwa przekierowania.
- * Usuwa wszystkie przekierowania, w których parametr @p num jest prefiksem
- * parametru @p num1 użytego przy dodawaniu. Jeśli nie ma takich przekierowań
- * lub napis nie reprezentuje numeru, nic nie robi.
- * @param[in,out] pf – wskaźnik na strukturę przechowującą przekierowania
- *                     numerów;
- * @param[in] num    – wskaźnik na napis reprezentujący prefiks numerów.
+/** @brief Tworzy niezmienną kopię przekierowań.
+ * Tworzy niezmienną kopię przekierowań przechowywanych w strukturze @p pf,
+ * zajmującą jeden ciągły blok pamięci bez wskaźników. Późniejsze zmiany
+ * @p pf nie wpływają na kopię. Z kopii można jednocześnie korzystać w wielu
+ * wątkach bez synchronizacji. Kopia musi być zwolniona za pomocą funkcji
+ * @ref phfwdFrozenDelete.
+ * @param[in] pf – wskaźnik na strukturę przechowującą przekierowania numerów.
+ * @return Wskaźnik na kopię lub NULL, gdy nie udało się alokować pamięci,
+ *         @p pf ma wartość NULL lub drzewo jest zbyt duże.
  */
-void phfwdRemove(PhoneForward *pf, char const *num) {
+PhoneForwardFrozen * phfwdFreeze(PhoneForward const *pf) {
     if (pf == NULL)
-        return;
-    PhoneFwd* pfd_node = go_to_prefix(pf->tree, num);
-    delete_tree(pfd_node, pf->backward_tree, num);
-}
-
-/**
- * @brief Zwraca strukturę PhoneNumbers zawierającą odpowiednie przekierowanie.
- * Funkcja pomocnicza dla funkcji phfwdGet. Zwraca strukturę PhoneNumbers 
- * zawierającą odpowiednie przekierowanie na podstawie odstatnio napotkanej 
- * wartości przekierowania w drzewie przekierowań.
- * W przypadku błędnych danych wejściowych zwraca NULL.
- * 
- * @param[in] num - napis zawierający numer który należy przekierować;
- * @param[in] last_depth - głębokość drzewa, na której napotkano ostatnie przekierowanie;
- * @param[in] last - ostatnio napotkane przekierowanie w drzewie przekierowań.
- * @return Wskaźnik na strukturę przechowującą odpowiednie przekierowanie na podstawie
- * ostatnio napotkanych wartości w drzewie przekierowań. 
- */
-static PhoneNumbers * get_last_number(const char* num, size_t last_depth, char* last) {
-    size_t num_len = last_depth, forwarded_len = 0;
-    while (is_number(num[num_len]))
-        num_len++;
-
-    if (last == NULL) {
-        num_len++; // miejsce na ostatni znak
-        char* forwarded = malloc(sizeof(char) * num_len);
-        if (forwarded == NULL)
-            return NULL;
-        strncpy(forwarded, num, num_len); // przekierowana część
-        PhoneNumbers* res = phn_create(&forwarded, 1);
-        free(forwarded);
-        return res;
-    }
-    while (is_number(last[forwarded_len]))
-        forwarded_len++;
-    
-    size_t size = num_len - last_depth + forwarded_len + 1;
-    char* forwarded = malloc(sizeof(char) * size);
-    if (forwarded == NULL)
         return NULL;
+    if (pf->concurrent != NULL) {
+        unsigned slot;
+        PhoneForwardFrozen* pff = phfwdFreeze(snapshot_acquire(pf, &slot));
+        snapshot_release(pf, slot);
+        return pff;
+    }
 
-    strncpy(forwarded, last, forwarded_len); // przekierowana część
-    // pozostała końcówka wraz z '\0'
-    strncpy(forwarded + forwarded_len, num + last_depth, num_len - last_depth + 1);
+    size_t node_count = 0, strings_size = 0;
+    for (PhoneFwd* node = pf->tree; node != NULL; node = fwd_next_preorder(node, pf->tree)) {
+        node_count++;
+        strings_size += node->label_len;
+        if (node->forwarded_prefix != NULL)
+            strings_size += prefix_length(node->forwarded_prefix) + 1;
+    }
+    size_t bwd_node_count = 0, entry_count = 0, bwd_strings_size = 0;
+    PhoneBwd** bwd = bwd_order(pf->backward_tree, &bwd_node_count, &entry_count,
+                               &bwd_strings_size);
+    if (bwd == NULL)
+        return NULL;
+    strings_size += bwd_strings_size;
+    if (node_count >= FROZEN_NONE || bwd_node_count >= FROZEN_NONE
+        || entry_count >= FROZEN_NONE || strings_size >= FROZEN_NONE) {
+        free(bwd);
+        return NULL;
+    }
 
-    PhoneNumbers * result = phn_create(&forwarded, 1);
-    free(forwarded);
-    return result;
+    FrozenHeader header;
+    memcpy(header.magic, "PHFZ", 4);
+    header.version = FROZEN_VERSION;
+    header.byte_order = FROZEN_BYTE_ORDER;
+    header.node_count = (uint32_t)node_count;
+    header.bwd_node_count = (uint32_t)bwd_node_count;
+    header.entry_count = (uint32_t)entry_count;
+    header.strings_size = (uint32_t)strings_size;
+
+    PhoneForwardFrozen* pff = malloc(sizeof(PhoneForwardFrozen));
+    uint64_t size = frozen_layout(NULL, &header);
+    // Zerowanie bloku, aby wyrównania struktur nie trafiały do pliku nieokreślone.
+    void* block = size <= SIZE_MAX ? calloc(1, (size_t)size) : NULL;
+    if (pff == NULL || block == NULL) {
+        free(pff);
+        free(block);
+        free(bwd);
+        return NULL;
+    }
+    memcpy(block, &header, sizeof(FrozenHeader));
+    pff->block = block;
+    pff->mapped_size = 0;
+    frozen_layout(pff, &header);
+
+    size_t used = 0;
+    if (!freeze_forward_tree(pf, pff, &used)) {
+        free(block);
+        free(pff);
+        free(bwd);
+        return NULL;
+    }
+    freeze_backward_tree(bwd, pff, &used);
+    free(bwd);
+    return pff;
 }
 
-/** @brief Wyznacza przekierowanie numeru.
- * Wyznacza przekierowanie podanego numeru. Szuka najdłuższego pasującego
- * prefiksu. Wynikiem jest ciąg zawierający co najwyżej jeden numer. Jeśli dany
- * numer nie został przekierowany, to wynikiem jest ciąg zawierający ten numer.
- * Jeśli podany napis nie reprezentuje numeru, wynikiem jest pusty ciąg.
- * Alokuje strukturę @p PhoneNumbers, która musi być zwolniona za pomocą
- * funkcji @ref phnumDelete. Zwraca wartość NULL dla @p pf o wartości NULL.
- * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
- * @param[in] num – wskaźnik na napis reprezentujący numer.
- * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
- *         udało się alokować pamięci bądź dane wejściowe były niepoprawne.
+/** @brief Usuwa niezmienną kopię przekierowań.
+ * Usuwa kopię wskazywaną przez @p pff, również odwzorowaną z pliku. Nic nie
+ * robi, jeśli wskaźnik ten ma wartość NULL.
+ * @param[in] pff – wskaźnik na usuwaną kopię.
  */
-PhoneNumbers * phfwdGet(PhoneForward const *pf, char const *num) {
-    if (pf == NULL)
-        return NULL;
-    if (num == NULL)
-        return phn_create(NULL, 0); 
+void phfwdFrozenDelete(PhoneForwardFrozen *pff) {
+    if (pff == NULL)
+        return;
+    if (pff->mapped_size != 0)
+        munmap(pff->block, pff->mapped_size);
+    else
+        free(pff->block);
+    free(pff);
+}
 
-    size_t iterator = 0, last_depth = 0;
-    PhoneFwd* probe = pf->tree;
-    char* last = NULL;
-    // Sprawdzenie czy num reprezentuje liczbe.
-    while (is_number(num[iterator]))
-        iterator++;
-    if (num[iterator] != '\0' || iterator == 0)
-        return phn_create(NULL, 0);
+/**
+ * @brief Sprawdza, czy napis zamrożonych drzew mieści się w puli napisów.
+ * Kopia odwzorowana z pliku może być uszkodzona, więc przesunięcia napisów
+ * zakończonych znakiem '\0' są sprawdzane przed ich użyciem.
+ * @param[in] pff - wskaźnik na zamrożone drzewa;
+ * @param[in] offset - przesunięcie napisu w puli napisów.
+ * @return true - jeśli napis kończy się w puli napisów.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool frozen_string_valid(const PhoneForwardFrozen* pff, uint32_t offset) {
+    uint32_t size = pff->header->strings_size;
+    return offset < size && memchr(pff->strings + offset, '\0', size - offset) != NULL;
+}
+
+/**
+ * @brief Wyszukuje najdłuższy prefiks numeru, dla którego dodano przekierowanie.
+ * Odpowiednik funkcji find_forwarding dla zamrożonego drzewa. Indeksy dzieci
+ * i przesunięcia etykiet są sprawdzane względem rozmiarów z nagłówka, a
+ * wyszukiwanie w uszkodzonej kopii kończy się tak, jakby nie było dalszych
+ * węzłów.
+ * @param[in] pff - wskaźnik na zamrożone drzewo;
+ * @param[in] num - numer który należy przekierować;
+ * @param[out] last_depth - długość prefiksu, dla którego znaleziono przekierowanie.
+ * @return Prefiks, na który przekierowywany jest znaleziony prefiks numeru lub
+ * NULL, jeśli żaden prefiks numeru nie jest przekierowany.
+ */
+static const char * frozen_find_forwarding(const PhoneForwardFrozen* pff,
+                                           const Number* num, size_t* last_depth) {
+    const FrozenHeader* header = pff->header;
+    const FrozenNode* probe = &pff->nodes[0];
+    size_t iterator = 0, depth = 0;
+    uint32_t last = FROZEN_NONE;
 
-    iterator = 0;
-    while (is_number(num[iterator])) {
-        int value = convert_to_number(num[iterator]);
-        if (probe->children[value] == NULL) 
+    while (iterator < num->length) {
+        unsigned bit = 1u << number_digit(num, iterator);
+        if (!(probe->mask & bit))
             break;
-        
-        probe = probe->children[value];
-        if (probe->forwarded_prefix != NULL) {
-            last = probe->forwarded_prefix;
-            last_depth = iterator + 1;
+        size_t index = (size_t)probe->first_child + POPCOUNT(probe->mask & (bit - 1));
+        if (index >= header->node_count)
+            break;
+        const FrozenNode* son = &pff->nodes[index];
+        // Etykieta dłuższa od reszty numeru nie pasuje, więc porównanie nie
+        // wychodzi poza numer, a pusta zapętliłaby wyszukiwanie.
+        if (son->label_len == 0 || son->label_len > num->length - iterator
+            || (uint64_t)son->label + son->label_len > header->strings_size)
+            break;
+        const char* label = pff->strings + son->label;
+        size_t matched = 0;
+        while (matched < son->label_len && label[matched] == num->str[iterator + matched])
+            matched++;
+        if (matched < son->label_len)
+            break;
+
+        probe = son;
+        iterator += son->label_len;
+        if (probe->forwarded != FROZEN_NONE) {
+            last = probe->forwarded;
+            depth = iterator;
         }
-        iterator++;
     }
-    
-    return get_last_number(num, last_depth, last);
-}
-
-/** @brief Komparator dla funkcji bibliotecznej qsort.
- * Komparator dla funkcji bibliotecznej qsort.
- * @param[in] first – wskaźnik na pierwszy porównywany napis;
- * @param[in] second – wskaźnik na drugi porównywany napis.
- * @return 1 jeżeli pierwsze słowo jest leksykograficznie późniejsze od drugiego;
- * -1 w przeciwnym przypadku; 0 w przypadku gdy są one równe.
- */
-static int string_comparator(const void* first, const void* second) {
-    const char* a = *(const char**)first;
-    const char* b = *(const char**)second;
-
-    for (size_t i = 0; a[i]; i++) {
-        if (convert_to_number(a[i]) > convert_to_number(b[i]))
-            return 1;
-        else if (convert_to_number(a[i]) < convert_to_number(b[i]))
-            return -1;
-    }
-    size_t end_index = strlen(a);
-    // Porównanie znaków końca napisu.
-    if (convert_to_number(b[end_index]) > convert_to_number(b[end_index]))
-        return 1;
-    if (convert_to_number(a[end_index]) < convert_to_number(b[end_index]))
-        return -1;
-    return 0;
-}
-
-/** @brief Umieszcza nowe odwrotne przekierowanie w strukturze PhoneNumbers.
- * Funkcja pomocnicza która mieszcza nowe odwrotne przekierowanie w strukturze 
- * PhoneNumbers. Przyjmuje przekierowywany prefiks, nieprzekierowany fragment 
- * słowa oraz jego długość i łączy je w pojedynczy napis. Zwraca prawdę
- * jeśli alokacja pamięci się uda i fałsz w przeciwnym przypadku.
- * @param[in, out] result  – wskaźnik na strukturę przechowującą odwrotne przekierowania numerów;
- * @param[in] to_add – wskaźnik na strukturę przechowującą dodawany numer;
- * @param[in] rest – nieprzekierowywana część słowa.
- */
-static bool insert_to_phnum(PhoneNumbers *result, PhoneNumbers *to_add,
-                            char* rest) {
-    int target_bonus_len = strlen(rest) + 1; // +1 na znak końca napisu
-    size_t result_current_size = result->size;
-    result->size += to_add->size;
-    result->number = realloc(result->number, sizeof(char*) * result->size);
-    if (result->number == NULL)
-        return false;
-    bool repeated = false;
-
-    for (size_t i = 0; i < to_add->size; i++) {
-        repeated = false;
-        // Nie dodajemy powtórzeń.
-        for (size_t j = 0; j < result_current_size; j++) {
-            if (strcmp(result->number[j], to_add->number[i]) == 0) {
-                result->size--;
-                result->number = realloc(result->number, sizeof(char*) * result->size);
-                if (result->number == NULL)
-                    return false;
-                repeated = true;
-                break;
-            }
-        }
-        if (repeated) 
-            continue;
+    if (last == FROZEN_NONE || !frozen_string_valid(pff, last)) {
+        *last_depth = 0;
+        return NULL;
+    }
+    *last_depth = depth;
+    return pff->strings + last;
+}
 
-        result_current_size++;
-        size_t new_num_len = strlen(to_add->number[i]);
-        result->number[result_current_size - 1] = 
-            malloc(sizeof(char) * (target_bonus_len + new_num_len));
-        if (result->number[result_current_size - 1] == NULL) {
-            
-            return false; 
-        }
+/**
+ * @brief Zapisuje przekierowanie numeru z zamrożonego drzewa do bufora.
+ * Odpowiednik funkcji splice_forwarding dla prefiksów zamrożonego drzewa,
+ * które są przechowywane jako napisy.
+ * @param[in] num - napis reprezentujący numer;
+ * @param[in] num_len - długość numeru;
+ * @param[in] last - prefiks, na który przekierowano numer lub NULL;
+ * @param[in] last_depth - długość przekierowanego prefiksu numeru;
+ * @param[out] out - wskaźnik na bufor na wynik;
+ * @param[in] cap - rozmiar bufora @p out w bajtach;
+ * @param[out] len - wskaźnik na długość wyniku lub NULL.
+ * @return true - jeśli wynik zmieścił się w buforze.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool frozen_splice_forwarding(const char* num, size_t num_len, const char* last,
+                                     size_t last_depth, char* out, size_t cap,
+                                     size_t* len) {
+    size_t forwarded_len = last == NULL ? 0 : strlen(last);
+    size_t result_len = forwarded_len + num_len - last_depth;
+    if (len != NULL)
+        *len = result_len;
+    if (out == NULL || cap <= result_len)
+        return false;
 
-        // Kopiowanie przekierowanego prefiksu.
-        strcpy(result->number[result_current_size - 1], to_add->number[i]);
-        // Kopiowanie sufiksu pozostałego słowa.
-        strcpy(result->number[result_current_size - 1] + new_num_len, rest);
-    }
+    if (last != NULL)
+        memcpy(out, last, forwarded_len);
+    // Pozostała końcówka wraz z '\0'.
+    memcpy(out + forwarded_len, num + last_depth, num_len - last_depth + 1);
     return true;
 }
 
-/** @brief Wyznacza przekierowania na dany numer.
- * Wyznacza następujący ciąg numerów: jeśli istnieje numer @p x, taki że jeśli
- * w drzewie przekierowań istnieje takie przekierowanie, które przekierowuje
- * numer @p x na @p num, to numer @p x należy do wyniku wywołania 
- * @ref phfwdReverse z numerem @p num. Dodatkowo ciągwynikowy zawsze zawiera
- * też numer @p num. Wynikowe numery są posortowane
- * leksykograficznie i nie mogą się powtarzać. Jeśli podany napis nie
- * reprezentuje numeru, wynikiem jest pusty ciąg. Alokuje strukturę
- * @p PhoneNumbers, która musi być zwolniona za pomocą funkcji @ref phnumDelete.
- * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+/** @brief Wyznacza przekierowanie numeru w niezmiennej kopii przekierowań.
+ * Działa tak jak funkcja @ref phfwdGet dla kopii utworzonej przez
+ * @ref phfwdFreeze.
+ * @param[in] pff – wskaźnik na niezmienną kopię przekierowań;
  * @param[in] num – wskaźnik na napis reprezentujący numer.
  * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
- *         udało się alokować pamięci.
+ *         udało się alokować pamięci bądź @p pff ma wartość NULL.
  */
-PhoneNumbers * phfwdReverse(PhoneForward const *pf, char const *num){
-    if (pf == NULL)
+PhoneNumbers * phfwdFrozenGet(PhoneForwardFrozen const *pff, char const *num) {
+    if (pff == NULL)
         return NULL;
-    if (num == NULL)
-        return phn_create(NULL, 0); 
-
-    size_t iterator = 0;
-    PhoneBwd* probe = pf->backward_tree;
-    // Sprawdzenie czy num reprezentuje liczbe.
-    while (is_number(num[iterator]))
-        iterator++;
-    if (num[iterator] != '\0' || iterator == 0)
+    Number number;
+    if (!number_parse(&number, num))
         return phn_create(NULL, 0);
 
-    iterator = 0;
-    PhoneNumbers *result = phn_create(NULL, 0);
-    if (result == NULL)
+    size_t last_depth;
+    const char* last = frozen_find_forwarding(pff, &number, &last_depth);
+    size_t size = (last == NULL ? 0 : strlen(last)) + number.length - last_depth + 1;
+    char* forwarded = malloc(sizeof(char) * size);
+    if (forwarded == NULL)
+        return NULL;
+    frozen_splice_forwarding(num, number.length, last, last_depth, forwarded, size, NULL);
+
+    PhoneNumbers* result = phn_create(&forwarded, 1);
+    free(forwarded);
+    return result;
+}
+
+/** @brief Wyznacza przekierowanie numeru w niezmiennej kopii do podanego bufora.
+ * Działa tak jak funkcja @ref phfwdGetInto dla kopii utworzonej przez
+ * @ref phfwdFreeze. Nie alokuje pamięci.
+ * @param[in] pff  – wskaźnik na niezmienną kopię przekierowań;
+ * @param[in] num  – wskaźnik na napis reprezentujący numer;
+ * @param[out] out – wskaźnik na bufor na wynik;
+ * @param[in] cap  – rozmiar bufora @p out w bajtach;
+ * @param[out] len – wskaźnik na długość wyniku bez znaku końca napisu lub NULL.
+ * @return Wartość @p true, jeśli wynik został zapisany w buforze.
+ *         Wartość @p false, jeśli @p pff ma wartość NULL, napis nie reprezentuje
+ *         numeru lub wynik nie mieści się w buforze.
+ */
+bool phfwdFrozenGetInto(PhoneForwardFrozen const *pff, char const *num,
+                        char *out, size_t cap, size_t *len) {
+    if (len != NULL)
+        *len = 0;
+    Number number;
+    if (pff == NULL || !number_parse(&number, num))
+        return false;
+
+    size_t last_depth;
+    const char* last = frozen_find_forwarding(pff, &number, &last_depth);
+    return frozen_splice_forwarding(num, number.length, last, last_depth, out, cap, len);
+}
+
+/**
+ * @brief Zwraca dziecko węzła zamrożonego drzewa odwróconych przekierowań.
+ * Indeks dziecka i zakres jego odwróconych przekierowań są sprawdzane
+ * względem rozmiarów z nagłówka.
+ * @param[in] pff - wskaźnik na zamrożone drzewa;
+ * @param[in] probe - wskaźnik na węzeł;
+ * @param[in] digit - kod cyfry.
+ * @return Wskaźnik na dziecko lub NULL, jeśli nie istnieje lub wykracza poza
+ * blok.
+ */
+static const FrozenBwdNode * frozen_bwd_child(const PhoneForwardFrozen* pff,
+                                              const FrozenBwdNode* probe, int digit) {
+    unsigned bit = 1u << digit;
+    if (!(probe->mask & bit))
+        return NULL;
+    size_t index = (size_t)probe->first_child + POPCOUNT(probe->mask & (bit - 1));
+    if (index >= pff->header->bwd_node_count)
+        return NULL;
+    const FrozenBwdNode* son = &pff->bwd_nodes[index];
+    if ((uint64_t)son->first_entry + son->entry_count > pff->header->entry_count)
+        return NULL;
+    return son;
+}
+
+/** @brief Wyznacza przekierowania na dany numer w niezmiennej kopii przekierowań.
+ * Działa tak jak funkcja @ref phfwdReverse dla kopii utworzonej przez
+ * @ref phfwdFreeze lub odwzorowanej z pliku przez @ref phfwdFrozenMap.
+ * @param[in] pff – wskaźnik na niezmienną kopię przekierowań;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci bądź @p pff ma wartość NULL.
+ */
+PhoneNumbers * phfwdFrozenReverse(PhoneForwardFrozen const *pff, char const *num) {
+    if (pff == NULL)
         return NULL;
+    Number number;
+    if (!number_parse(&number, num))
+        return phn_create(NULL, 0);
+    size_t num_len = number.length;
 
-    while (is_number(num[iterator])) {
-        int value = convert_to_number(num[iterator]);
-        if (probe->children[value] == NULL) 
+    // Zliczenie kandydatów, aby zaalokować ich tablicę jednorazowo.
+    size_t count = 1;
+    const FrozenBwdNode* probe = &pff->bwd_nodes[0];
+    for (size_t i = 0; i < num_len; i++) {
+        probe = frozen_bwd_child(pff, probe, number_digit(&number, i));
+        if (probe == NULL)
             break;
-        
-        probe = probe->children[value];
-        if (probe->forwarded_prefix->size != 0) 
-            if (!insert_to_phnum(result, probe->forwarded_prefix, (char*)(num + iterator + 1))) {
-                phnumDelete(result);
-                return NULL;
-            }
-        iterator++;
+        count += probe->entry_count;
     }
-    PhoneNumbers* itself = phn_create((char**)&num, 1);
-    if (itself == NULL) {
-        phnumDelete(result);
+
+    Candidate* candidates = malloc(sizeof(Candidate) * count);
+    size_t* ends = malloc(sizeof(size_t) * (num_len + 1));
+    if (candidates == NULL || ends == NULL) {
+        free(candidates);
+        free(ends);
         return NULL;
     }
-    if(!insert_to_phnum(result, itself, "")) {
-        phnumDelete(itself);
-        phnumDelete(result);
-        return NULL;
+    candidates[0] = (Candidate){num, num_len, "", 0};
+    ends[0] = count = 1;
+    size_t lists = 1;
+    probe = &pff->bwd_nodes[0];
+    for (size_t i = 0; i < num_len; i++) {
+        probe = frozen_bwd_child(pff, probe, number_digit(&number, i));
+        if (probe == NULL)
+            break;
+        size_t first = count;
+        for (uint32_t j = 0; j < probe->entry_count; j++) {
+            uint32_t offset = pff->entries[probe->first_entry + j];
+            if (!frozen_string_valid(pff, offset))
+                continue;
+            const char* prefix = pff->strings + offset;
+            candidates[count++] = (Candidate){prefix, strlen(prefix),
+                                              num + i + 1, num_len - i - 1};
+        }
+        if (count > first)
+            ends[lists++] = count;
     }
 
-    phnumDelete(itself);
-
-    qsort(result->number, result->size, sizeof(char*), string_comparator);
+    PhoneNumbers* result = phn_merge_candidates(candidates, ends, lists);
+    free(candidates);
+    free(ends);
     return result;
 }
 
-/** @brief Usuwa strukturę.
- * Usuwa strukturę wskazywaną przez @p pnum. Nic nie robi, jeśli wskaźnik ten ma
- * wartość NULL.
- * @param[in] pnum – wskaźnik na usuwaną strukturę.
+/**
+ * @brief Tworzy ścieżkę do pliku tymczasowego.
+ * @param[in] path - ścieżka do pliku docelowego.
+ * @return Ścieżka @p path z przyrostkiem ".tmp" lub NULL, gdy nie udało się
+ * alokować pamięci.
  */
-void phnumDelete(PhoneNumbers *pnum) {
-    if (pnum == NULL)
-        return;
+static char * temporary_path(const char* path) {
+    size_t path_len = strlen(path);
+    char* temporary = malloc(path_len + sizeof(".tmp"));
+    if (temporary == NULL)
+        return NULL;
+    memcpy(temporary, path, path_len);
+    memcpy(temporary + path_len, ".tmp", sizeof(".tmp"));
+    return temporary;
+}
 
-    for (size_t i = 0; i < pnum->size; i++)
-        free(pnum->number[i]);
+/**
+ * @brief Kończy zapis pliku tymczasowego i podmienia nim plik docelowy.
+ * Utrwala zawartość pliku na dysku przed podmianą, więc po awarii plik
+ * docelowy ma poprzednią albo nową zawartość. W przypadku błędu usuwa plik
+ * tymczasowy.
+ * @param[in] file - plik otwarty do zapisu pod ścieżką @p temporary;
+ * @param[in] written - czy dotychczasowy zapis do pliku się powiódł;
+ * @param[in] temporary - ścieżka do pliku tymczasowego, zwalniana przez
+ *                        funkcję;
+ * @param[in] path - ścieżka do pliku docelowego.
+ * @return true - jeśli plik docelowy został podmieniony.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool replace_file(FILE* file, bool written, char* temporary, const char* path) {
+    written = fflush(file) == 0 && written;
+    written = fsync(fileno(file)) == 0 && written;
+    written = fclose(file) == 0 && written;
+    if (written)
+        written = rename(temporary, path) == 0;
+    if (!written)
+        remove(temporary);
+    free(temporary);
+    return written;
+}
 
-    free(pnum->number);
-    free(pnum);
+/** @brief Zapisuje przekierowania do pliku.
+ * Zapisuje wszystkie przekierowania struktury @p pf do pliku @p path w
+ * formacie funkcji @ref phfwdLoadFile, po jednej parze w wierszu, w kolejności
+ * przechodzenia drzewa przekierowań. Poddrzewa bez przekierowań są pomijane,
+ * a napis węzła powstaje z napisu rodzica, więc etykieta każdego węzła jest
+ * odczytywana raz. Plik jest zapisywany pod ścieżką z przyrostkiem ".tmp",
+ * utrwalany na dysku i dopiero wtedy podmieniany, więc po awarii ma
+ * poprzednią albo nową zawartość. W trybie współbieżnym zapisywana jest
+ * opublikowana kopia przekierowań, bez czekania na piszących.
+ * @param[in] pf   – wskaźnik na strukturę przechowującą przekierowania
+ *                   numerów;
+ * @param[in] path – ścieżka do zapisywanego pliku.
+ * @return Wartość @p true, jeśli plik został zapisany.
+ *         Wartość @p false, jeśli któryś ze wskaźników ma wartość NULL, nie
+ *         udało się zapisać pliku lub alokować pamięci. Plik @p path pozostaje
+ *         wtedy niezmieniony.
+ */
+bool phfwdSaveFile(PhoneForward const *pf, char const *path) {
+    if (pf == NULL || path == NULL)
+        return false;
+    if (pf->concurrent != NULL) {
+        unsigned slot;
+        bool result = phfwdSaveFile(snapshot_acquire(pf, &slot), path);
+        snapshot_release(pf, slot);
+        return result;
+    }
+    char* temporary = temporary_path(path);
+    FILE* file = temporary == NULL ? NULL : fopen(temporary, "wb");
+    if (file == NULL) {
+        free(temporary);
+        return false;
+    }
+
+    // Bufor mieści napis węzła i, za nim, prefiks jego przekierowania.
+    char* line = NULL;
+    size_t line_cap = 0;
+    bool written = true;
+    PhoneFwd* node = pf->tree;
+    while (node != NULL && written) {
+        size_t length = node->forwarded_prefix == NULL ? 0
+                        : prefix_length(node->forwarded_prefix);
+        written = scratch_reserve((void**)&line, &line_cap, node->depth + length + 2,
+                                  sizeof(char));
+        if (!written)
+            break;
+        packed_to_ascii(fwd_label(node), node->label_len, line + node->depth - node->label_len);
+        if (node->forwarded_prefix != NULL) {
+            line[node->depth] = ' ';
+            prefix_write(node->forwarded_prefix, line + node->depth + 1);
+            line[node->depth + length + 1] = '\n';
+            written = fwrite(line, 1, node->depth + length + 2, file)
+                      == node->depth + length + 2;
+        }
+        node = node->rules_below > 0 ? fwd_next_preorder(node, pf->tree)
+                                     : fwd_next_outside(node, pf->tree);
+    }
+    free(line);
+    return replace_file(file, written, temporary, path);
 }
 
-/** @brief Udostępnia numer.
- * Udostępnia wskaźnik na napis reprezentujący numer. Napisy są indeksowane
- * kolejno od zera.
- * @param[in] pnum – wskaźnik na strukturę przechowującą ciąg numerów telefonów;
- * @param[in] idx  – indeks numeru telefonu.
- * @return Wskaźnik na napis reprezentujący numer telefonu. Wartość NULL, jeśli
- *         wskaźnik @p pnum ma wartość NULL lub indeks ma za dużą wartość.
+/** @brief Zapisuje niezmienną kopię przekierowań do pliku.
+ * Zapisuje blok pamięci kopii @p pff do pliku @p path, który może zostać
+ * później odwzorowany w pamięci przez @ref phfwdFrozenMap. Plik nie zawiera
+ * wskaźników, więc nie zależy od adresu, pod którym zostanie odwzorowany.
+ * Plik jest zapisywany pod nazwą tymczasową i dopiero po zapisaniu całości
+ * zastępuje plik @p path.
+ * @param[in] pff  – wskaźnik na niezmienną kopię przekierowań;
+ * @param[in] path – ścieżka do pliku.
+ * @return Wartość @p true, jeśli plik został zapisany.
+ *         Wartość @p false, jeśli wystąpił błąd zapisu lub alokacji pamięci.
  */
-char const * phnumGet(PhoneNumbers const *pnum, size_t idx) {
-    if (pnum == NULL)
-        return NULL;
-        
-    if (idx >= pnum->size)
-        return NULL;
+bool phfwdFrozenSave(PhoneForwardFrozen const *pff, char const *path) {
+    if (pff == NULL || path == NULL)
+        return false;
 
-    return pnum->number[idx];
+    char* temporary = temporary_path(path);
+    FILE* file = temporary == NULL ? NULL : fopen(temporary, "wb");
+    if (file == NULL) {
+        free(temporary);
+        return false;
+    }
+    size_t size = (size_t)frozen_layout(NULL, pff->header);
+    return replace_file(file, fwrite(pff->block, 1, size, file) == size, temporary, path);
 }
 
-/** @brief Wyznacza przekierowania na dany numer.
- * Wyznacza następujący ciąg numerów: jeśli istnieje numer @p x, taki że jeśli
- * wywołamy funkcję @ref phfwdGet na numerze @p x i w wyniku otrzymamy numer
- * @p num, to numer @p x należy do wyniku wywołania @ref phfwdGetReverse 
- * z numerem @p num. Dodatkowo ciągwynikowy zawsze zawiera
- * też numer @p num. Wynikowe numery są posortowane
- * leksykograficznie i nie mogą się powtarzać. Jeśli podany napis nie
- * reprezentuje numeru, wynikiem jest pusty ciąg. Alokuje strukturę
- * @p PhoneNumbers, która musi być zwolniona za pomocą funkcji @ref phnumDelete.
- * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
- * @param[in] num – wskaźnik na napis reprezentujący numer.
- * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
- *         udało się alokować pamięci.
+/** @brief Odwzorowuje w pamięci niezmienną kopię przekierowań zapisaną w pliku.
+ * Odwzorowuje plik zapisany przez @ref phfwdFrozenSave w pamięci tylko do
+ * odczytu i udostępnia go bez odtwarzania struktur, więc czas wczytania nie
+ * zależy od ilości przekierowań. Strony pliku są wczytywane przy pierwszym
+ * dostępie. Sprawdzana jest sygnatura, wersja, kolejność bajtów i rozmiar
+ * pliku. Zawartość nie jest sprawdzana w całości, ale wyszukiwanie sprawdza
+ * każdy odczytany indeks i przesunięcie, więc uszkodzony plik daje co
+ * najwyżej błędne wyniki, a nie odczyt poza odwzorowaniem. Kopia musi być
+ * zwolniona za pomocą funkcji @ref phfwdFrozenDelete.
+ * @param[in] path – ścieżka do pliku.
+ * @return Wskaźnik na kopię lub NULL, gdy pliku nie udało się odczytać, nie
+ *         jest on poprawną kopią lub nie udało się alokować pamięci.
  */
-PhoneNumbers * phfwdGetReverse(PhoneForward const *pf, char const *num) {
-    if (pf == NULL)
+PhoneForwardFrozen * phfwdFrozenMap(char const *path) {
+    if (path == NULL)
         return NULL;
-    if (num == NULL)
-        return phn_create(NULL, 0);
 
-    int iterator = 0;
-    // Sprawdzenie czy numer reprezentuje liczbe
-    while (is_number(num[iterator]))
-        iterator++;
-    if (num[iterator] != '\0' || iterator == 0)
-        return phn_create(NULL, 0);
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0)
+        return NULL;
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || (uint64_t)status.st_size < sizeof(FrozenHeader)
+        || (uint64_t)status.st_size > SIZE_MAX) {
+        close(descriptor);
+        return NULL;
+    }
+    size_t size = (size_t)status.st_size;
+    void* block = mmap(NULL, size, PROT_READ, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if (block == MAP_FAILED)
+        return NULL;
 
-    PhoneNumbers* reversed = phfwdReverse(pf, num);
-    PhoneNumbers* res = phn_create(NULL, 0); 
-    if (res == NULL)
-        return NULL;
-    // Sprawdzenie czy wyniki reverse należą do przeciwobrazu funkcji phfwdGet.
-    for (size_t i = 0; i < reversed->size; i++) {
-        const char* current_number = phnumGet(reversed, i);
-        PhoneNumbers* forward_current_number_phn = phfwdGet(pf, current_number);
-        const char* forward_current_number = phnumGet(forward_current_number_phn, 0);
-        if (strcmp(forward_current_number, num) == 0)
-            add_to_phnum(res, current_number);
-        phnumDelete(forward_current_number_phn);
-    }
-    phnumDelete(reversed);
-    return res;
-}
\ No newline at end of file
+    const FrozenHeader* header = block;
+    PhoneForwardFrozen* pff = malloc(sizeof(PhoneForwardFrozen));
+    if (pff == NULL || memcmp(header->magic, "PHFZ", 4) != 0
+        || header->version != FROZEN_VERSION || header->byte_order != FROZEN_BYTE_ORDER
+        || header->node_count == 0 || header->bwd_node_count == 0
+        || frozen_layout(NULL, header) != size) {
+        free(pff);
+        munmap(block, size);
+        return NULL;
+    }
+    pff->block = block;
+    pff->mapped_size = size;
+    frozen_layout(pff, header);
+    return pff;
+}
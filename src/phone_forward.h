@@ -21,6 +21,15 @@ struct PhoneForward;
  */
 typedef struct PhoneForward PhoneForward;
 
+/**
+ * To jest struktura przechowująca niezmienną kopię przekierowań.
+ */
+struct PhoneForwardFrozen;
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct PhoneForwardFrozen PhoneForwardFrozen;
+
 /**
  * To jest struktura przechowująca ciąg numerów telefonów.
  */
@@ -30,6 +39,49 @@ struct PhoneNumbers;
  */
 typedef struct PhoneNumbers PhoneNumbers;
 
+/**
+ * To jest struktura przechowująca stan iteratora po ciągu numerów telefonów.
+ */
+struct PhoneNumbersIter;
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct PhoneNumbersIter PhoneNumbersIter;
+
+/**
+ * To jest struktura przechowująca zmiany przekierowań czekające na
+ * zatwierdzenie.
+ */
+struct PhoneForwardTxn;
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct PhoneForwardTxn PhoneForwardTxn;
+
+#define PHFWD_STATS_DEPTHS 32 ///< Ilość przedziałów histogramu długości prefiksów.
+
+/**
+ * To jest struktura opisująca rozmiar struktury przechowującej przekierowania.
+ */
+struct PhoneForwardStats {
+    size_t forward_nodes;           ///< Ilość węzłów drzewa przekierowań.
+    size_t backward_nodes;          ///< Ilość węzłów drzewa odwróconych przekierowań.
+    size_t rules;                   ///< Ilość przekierowań.
+    size_t prefix_bytes;            ///< Ilość bajtów napisów prefiksów docelowych.
+    size_t backward_bytes;          ///< Ilość bajtów tablic odwróconych przekierowań.
+    size_t node_bytes;              ///< Ilość bajtów węzłów obu drzew.
+    size_t pool_bytes;              ///< Ilość bajtów pamięci zajmowanej przez strukturę.
+    /// Ilość przekierowań według długości prefiksu przekierowywanego. Ostatni
+    /// przedział obejmuje również wszystkie dłuższe prefiksy.
+    size_t depth_histogram[PHFWD_STATS_DEPTHS];
+    /// Średnia ilość dzieci węzłów drzewa przekierowań, które mają dzieci.
+    double average_fan_out;
+};
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct PhoneForwardStats PhoneForwardStats;
+
 /** @brief Tworzy nową strukturę.
  * Tworzy nową strukturę niezawierającą żadnych przekierowań.
  * @return Wskaźnik na utworzoną strukturę lub NULL, gdy nie udało się
@@ -37,6 +89,27 @@ typedef struct PhoneNumbers PhoneNumbers;
  */
 PhoneForward * phfwdNew(void);
 
+/** @brief Tworzy nową strukturę w trybie współbieżnym.
+ * Tworzy nową strukturę niezawierającą żadnych przekierowań, której funkcje
+ * @ref phfwdGet, @ref phfwdGetInto, @ref phfwdGetBatch, @ref phfwdReverse i
+ * @ref phfwdGetReverse mogą być wywoływane jednocześnie z wielu wątków i nigdy
+ * nie czekają na blokadę. Odczytują one opublikowaną kopię przekierowań,
+ * której nikt w tym czasie nie modyfikuje. Funkcje @ref phfwdAdd i
+ * @ref phfwdRemove mogą być wywoływane jednocześnie z odczytami i między sobą.
+ * Są wzajemnie wykluczane i wykonują zmianę w drugiej kopii, publikują ją,
+ * czekają na zakończenie odczytów poprzedniej kopii i powtarzają w niej tę
+ * samą zmianę. Koszt modyfikacji jest więc około dwukrotnie większy niż poza
+ * trybem współbieżnym i nie zależy od rozmiaru struktury, a struktura zajmuje
+ * dwukrotnie więcej pamięci. Jeśli w poprzedniej kopii zabraknie pamięci,
+ * zmiana jest zapamiętywana i wykonywana w niej przed następną zmianą. Jeśli
+ * to też się nie powiedzie, następna zmiana nie jest wykonywana, a funkcja
+ * zwraca @p false. Funkcja @ref phfwdDelete nie może być wywołana
+ * jednocześnie z innymi funkcjami.
+ * @return Wskaźnik na utworzoną strukturę lub NULL, gdy nie udało się
+ *         alokować pamięci.
+ */
+PhoneForward * phfwdNewConcurrent(void);
+
 /** @brief Usuwa strukturę.
  * Usuwa strukturę wskazywaną przez @p pf. Nic nie robi, jeśli wskaźnik ten ma
  * wartość NULL.
@@ -49,7 +122,9 @@ void phfwdDelete(PhoneForward *pf);
  * w których ten prefiks zamieniono odpowiednio na prefiks @p num2. Każdy numer
  * jest swoim własnym prefiksem. Jeśli wcześniej zostało dodane przekierowanie
  * z takim samym parametrem @p num1, to jest ono zastępowane.
- * Relacja przekierowania numerów nie jest przechodnia.
+ * Relacja przekierowania numerów nie jest przechodnia. W trybie współbieżnym
+ * przekierowanie jest widoczne dla czytelników od chwili zwrócenia wartości
+ * @p true, a wartość @p false oznacza, że czytelnicy go nie zobaczą.
  * @param[in,out] pf – wskaźnik na strukturę przechowującą przekierowania
  *                     numerów;
  * @param[in] num1   – wskaźnik na napis reprezentujący prefiks numerów
@@ -63,15 +138,84 @@ void phfwdDelete(PhoneForward *pf);
  */
 bool phfwdAdd(PhoneForward *pf, char const *num1, char const *num2);
 
+/** @brief Dodaje wiele przekierowań naraz.
+ * Dodaje przekierowania z @p num1[i] na @p num2[i] dla kolejnych @p i,
+ * tak jakby zostały dodane kolejnymi wywołaniami funkcji @ref phfwdAdd.
+ * Przekierowania nie muszą być posortowane. Jeśli struktura nie zawiera
+ * żadnych przekierowań, są one porządkowane podziałem według kolejnych cyfr,
+ * bez porównywania całych napisów, chyba że już są posortowane. Drzewo
+ * przekierowań jest budowane w jednym przebiegu po uporządkowanych
+ * przekierowaniach, bez wyszukiwania każdego z nich od korzenia, a drzewo
+ * odwróconych przekierowań powstaje w trakcie takiego samego podziału według
+ * prefiksów docelowych, z tablicami o dokładnym rozmiarze. W przeciwnym
+ * przypadku przekierowania są dodawane pojedynczo. W trybie współbieżnym
+ * przekierowania są dodawane jak w transakcji zatwierdzanej funkcją
+ * @ref phfwdTxnCommit, w całości albo wcale, i publikowane razem.
+ * @param[in,out] pf – wskaźnik na strukturę przechowującą przekierowania
+ *                     numerów;
+ * @param[in] num1   – tablica napisów reprezentujących prefiksy numerów
+ *                     przekierowywanych;
+ * @param[in] num2   – tablica napisów reprezentujących prefiksy numerów,
+ *                     na które są wykonywane przekierowania;
+ * @param[in] count  – ilość przekierowań.
+ * @return Wartość @p true, jeśli wszystkie przekierowania zostały dodane.
+ *         Wartość @p false, jeśli któraś para napisów nie jest poprawnym
+ *         przekierowaniem lub nie udało się alokować pamięci. Wtedy struktura
+ *         pozostaje niezmieniona, chyba że zawierała już przekierowania,
+ *         nie jest w trybie współbieżnym i zabrakło pamięci w trakcie
+ *         dodawania.
+ */
+bool phfwdBulkLoad(PhoneForward *pf, char const * const *num1,
+                   char const * const *num2, size_t count);
+
+/** @brief Ładuje przekierowania z pliku.
+ * Wczytuje plik @p path, zawierający pary numerów @p num1 @p num2 rozdzielone
+ * białymi znakami, np. po jednej parze w wierszu, i dodaje je funkcją
+ * @ref phfwdBulkLoad. Cały plik jest wczytywany do jednego bufora, a numery
+ * nie są kopiowane przed zbudowaniem drzew.
+ * @param[in,out] pf – wskaźnik na strukturę przechowującą przekierowania
+ *                     numerów;
+ * @param[in] path   – ścieżka do pliku z przekierowaniami.
+ * @return Wartość @p true, jeśli wszystkie przekierowania zostały dodane.
+ *         Wartość @p false, jeśli nie udało się odczytać pliku, zawiera on
+ *         nieparzystą ilość napisów lub niepoprawne przekierowanie, bądź nie
+ *         udało się alokować pamięci.
+ */
+bool phfwdLoadFile(PhoneForward *pf, char const *path);
+
+/** @brief Zapisuje przekierowania do pliku.
+ * Zapisuje wszystkie przekierowania struktury @p pf do pliku @p path w
+ * formacie funkcji @ref phfwdLoadFile, po jednej parze w wierszu, w kolejności
+ * przechodzenia drzewa przekierowań. Poddrzewa bez przekierowań są pomijane,
+ * a napis węzła powstaje z napisu rodzica, więc etykieta każdego węzła jest
+ * odczytywana raz. Plik jest zapisywany pod ścieżką z przyrostkiem ".tmp",
+ * utrwalany na dysku i dopiero wtedy podmieniany, więc po awarii ma
+ * poprzednią albo nową zawartość. W trybie współbieżnym zapisywana jest
+ * opublikowana kopia przekierowań, bez czekania na piszących.
+ * @param[in] pf   – wskaźnik na strukturę przechowującą przekierowania
+ *                   numerów;
+ * @param[in] path – ścieżka do zapisywanego pliku.
+ * @return Wartość @p true, jeśli plik został zapisany.
+ *         Wartość @p false, jeśli któryś ze wskaźników ma wartość NULL, nie
+ *         udało się zapisać pliku lub alokować pamięci. Plik @p path pozostaje
+ *         wtedy niezmieniony.
+ */
+bool phfwdSaveFile(PhoneForward const *pf, char const *path);
+
 /** @brief Usuwa przekierowania.
  * Usuwa wszystkie przekierowania, w których parametr @p num jest prefiksem
  * parametru @p num1 użytego przy dodawaniu. Jeśli nie ma takich przekierowań
- * lub napis nie reprezentuje numeru, nic nie robi.
+ * lub napis nie reprezentuje numeru, nic nie robi. Usuwanie nie alokuje
+ * pamięci, ale w trybie współbieżnym przed nim wykonywane są zmiany, które
+ * wcześniej nie powiodły się w drugiej kopii przekierowań.
  * @param[in,out] pf – wskaźnik na strukturę przechowującą przekierowania
  *                     numerów;
  * @param[in] num    – wskaźnik na napis reprezentujący prefiks numerów.
+ * @return Wartość @p false, jeśli @p pf ma wartość NULL lub w trybie
+ *         współbieżnym nie udało się alokować pamięci. Struktura pozostaje
+ *         wtedy niezmieniona. Wartość @p true w przeciwnym przypadku.
  */
-void phfwdRemove(PhoneForward *pf, char const *num);
+bool phfwdRemove(PhoneForward *pf, char const *num);
 
 /** @brief Wyznacza przekierowanie numeru.
  * Wyznacza przekierowanie podanego numeru. Szuka najdłuższego pasującego
@@ -87,6 +231,45 @@ void phfwdRemove(PhoneForward *pf, char const *num);
  */
 PhoneNumbers * phfwdGet(PhoneForward const *pf, char const *num);
 
+/** @brief Wyznacza przekierowanie numeru do podanego bufora.
+ * Wyznacza przekierowanie podanego numeru tak jak funkcja @ref phfwdGet, ale
+ * zamiast alokować strukturę @p PhoneNumbers zapisuje wynik wraz ze znakiem
+ * końca napisu w buforze @p out. Nie alokuje pamięci.
+ * @param[in] pf   – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num  – wskaźnik na napis reprezentujący numer;
+ * @param[out] out – wskaźnik na bufor na wynik;
+ * @param[in] cap  – rozmiar bufora @p out w bajtach;
+ * @param[out] len – wskaźnik na długość wyniku bez znaku końca napisu lub NULL.
+ *                   Ustawiana również wtedy, gdy wynik nie mieści się w
+ *                   buforze, a na 0, gdy napis nie reprezentuje numeru.
+ * @return Wartość @p true, jeśli wynik został zapisany w buforze.
+ *         Wartość @p false, jeśli @p pf ma wartość NULL, napis nie reprezentuje
+ *         numeru lub wynik nie mieści się w buforze.
+ */
+bool phfwdGetInto(PhoneForward const *pf, char const *num, char *out,
+                  size_t cap, size_t *len);
+
+/** @brief Wyznacza przekierowania wielu numerów do podanego bufora.
+ * Wyznacza przekierowania numerów @p nums[0], ..., @p nums[n - 1] tak jak
+ * funkcja @ref phfwdGetInto i zapisuje je kolejno w buforze @p out, każdy
+ * zakończony znakiem końca napisu. Dla napisu, który nie reprezentuje numeru,
+ * zapisywany jest pusty napis. Numery są wyszukiwane w drzewie jednocześnie,
+ * co pozwala ukryć opóźnienia dostępu do pamięci. Nie alokuje pamięci.
+ * @param[in] pf       – wskaźnik na strukturę przechowującą przekierowania
+ *                       numerów;
+ * @param[in] nums     – tablica wskaźników na napisy reprezentujące numery;
+ * @param[in] n        – ilość numerów;
+ * @param[out] out     – wskaźnik na bufor na wyniki;
+ * @param[in] cap      – rozmiar bufora @p out w bajtach;
+ * @param[out] offsets – tablica co najmniej @p n pozycji, na której zapisywane
+ *                       są przesunięcia kolejnych wyników w buforze @p out.
+ * @return Ilość numerów, których przekierowania zmieściły się w buforze. Jeśli
+ *         jest mniejsza od @p n, to wywołanie można powtórzyć dla pozostałych
+ *         numerów. Wartość 0, jeśli @p pf ma wartość NULL.
+ */
+size_t phfwdGetBatch(PhoneForward const *pf, char const * const *nums, size_t n,
+                     char *out, size_t cap, size_t *offsets);
+
 /** @brief Wyznacza przekierowania na dany numer.
  * Wyznacza następujący ciąg numerów: jeśli istnieje numer @p x, taki że jeśli
  * w drzewie przekierowań istnieje takie przekierowanie, które przekierowuje
@@ -120,6 +303,19 @@ void phnumDelete(PhoneNumbers *pnum);
  */
 char const * phnumGet(PhoneNumbers const *pnum, size_t idx);
 
+/** @brief Scala posortowane ciągi numerów.
+ * Tworzy ciąg zawierający numery ze wszystkich ciągów @p lists[0], ...,
+ * @p lists[count - 1], posortowane leksykograficznie tak jak wyniki funkcji
+ * @ref phfwdReverse i bez powtórzeń. Ciągi wejściowe pozostają niezmienione.
+ * Alokuje strukturę @p PhoneNumbers, która musi być zwolniona za pomocą
+ * funkcji @ref phnumDelete.
+ * @param[in] lists – tablica wskaźników na scalane ciągi;
+ * @param[in] count – ilość ciągów.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci bądź któryś ze wskaźników ma wartość NULL.
+ */
+PhoneNumbers * phnumMerge(PhoneNumbers const * const *lists, size_t count);
+
 /** @brief Wyznacza przekierowania na dany numer.
  * Wyznacza następujący ciąg numerów: jeśli istnieje numer @p x, taki że jeśli
  * wywołamy funkcję @ref phfwdGet na numerze @p x i w wyniku otrzymamy numer
@@ -136,6 +332,266 @@ char const * phnumGet(PhoneNumbers const *pnum, size_t idx);
  */
 PhoneNumbers * phfwdGetReverse(PhoneForward const *pf, char const *num);
 
+/** @brief Wyznacza przeciwobrazy wielu numerów równolegle.
+ * Wyznacza dla numerów @p nums[0], ..., @p nums[n - 1] wyniki takie jak
+ * funkcja @ref phfwdGetReverse i zapisuje je w @p results[0], ...,
+ * @p results[n - 1]. Zapytania są rozdzielane między wątki, a wątek, który
+ * wyczerpie swoje zapytania, przejmuje część zapytań innego wątku. Każdy wątek
+ * używa własnych buforów pomocniczych. Struktura @p pf nie może być w tym
+ * czasie modyfikowana, chyba że została utworzona przez
+ * @ref phfwdNewConcurrent. Każdy wynik musi być zwolniony za pomocą funkcji
+ * @ref phnumDelete.
+ * @param[in] pf       – wskaźnik na strukturę przechowującą przekierowania
+ *                       numerów;
+ * @param[in] nums     – tablica wskaźników na napisy reprezentujące numery;
+ * @param[in] n        – ilość numerów;
+ * @param[out] results – tablica co najmniej @p n pozycji na wyniki;
+ * @param[in] threads  – ilość wątków lub 0, aby użyć tylu wątków, ile jest
+ *                       dostępnych procesorów.
+ * @return Wartość @p true, jeśli wszystkie wyniki zostały wyznaczone.
+ *         Wartość @p false, jeśli któryś ze wskaźników ma wartość NULL lub nie
+ *         udało się alokować pamięci. Wszystkie pozycje @p results mają wtedy
+ *         wartość NULL.
+ */
+bool phfwdGetReverseBatch(PhoneForward const *pf, char const * const *nums, size_t n,
+                          PhoneNumbers **results, unsigned threads);
+
+/** @brief Zlicza przekierowania na dany numer.
+ * Wyznacza ilość numerów w wyniku funkcji @ref phfwdReverse bez tworzenia go.
+ * Każdy węzeł drzewa odwróconych przekierowań pamięta, ile jego przekierowań
+ * powtarza numery krótszych przekierowań, a liczniki te są uaktualniane przy
+ * każdej modyfikacji. Działa w czasie proporcjonalnym do długości numeru i nie
+ * alokuje pamięci. W trybie współbieżnym odczytuje opublikowaną kopię
+ * przekierowań bez czekania na piszących.
+ * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Ilość numerów lub 0, jeśli napis nie reprezentuje numeru bądź @p pf
+ *         ma wartość NULL.
+ */
+size_t phfwdReverseCount(PhoneForward const *pf, char const *num);
+
+/** @brief Zlicza numery przekierowywane na dany numer.
+ * Wyznacza ilość numerów w wyniku funkcji @ref phfwdGetReverse bez tworzenia
+ * go i bez alokowania pamięci. Przekierowanie jest sprawdzane w drzewie
+ * przekierowań tylko wtedy, gdy jego poddrzewo zawiera dłuższe
+ * przekierowania. W trybie współbieżnym odczytuje opublikowaną kopię
+ * przekierowań bez czekania na piszących.
+ * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Ilość numerów lub 0, jeśli napis nie reprezentuje numeru bądź @p pf
+ *         ma wartość NULL.
+ */
+size_t phfwdGetReverseCount(PhoneForward const *pf, char const *num);
+
+/** @brief Tworzy iterator po przekierowaniach na dany numer.
+ * Tworzy iterator zwracający kolejno te same numery co funkcja
+ * @ref phfwdReverse, w tym samym porządku. Numery nie są wyznaczane z góry:
+ * iterator przechowuje tylko kandydatów zebranych z drzewa odwróconych
+ * przekierowań i wyznacza kolejny numer dopiero przy wywołaniu
+ * @ref phnumIterNext, więc przerwanie iteracji oszczędza sortowanie i
+ * kopiowanie pozostałych numerów. Późniejsze zmiany @p pf nie wpływają na
+ * iterator. Iterator musi być zwolniony za pomocą funkcji
+ * @ref phnumIterDelete.
+ * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na iterator lub NULL, gdy nie udało się alokować pamięci
+ *         bądź @p pf ma wartość NULL.
+ */
+PhoneNumbersIter * phfwdReverseIter(PhoneForward const *pf, char const *num);
+
+/** @brief Tworzy iterator po przeciwobrazie numeru.
+ * Działa tak jak funkcja @ref phfwdReverseIter, ale zwraca numery takie jak
+ * funkcja @ref phfwdGetReverse.
+ * @param[in] pf  – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na iterator lub NULL, gdy nie udało się alokować pamięci
+ *         bądź @p pf ma wartość NULL.
+ */
+PhoneNumbersIter * phfwdGetReverseIter(PhoneForward const *pf, char const *num);
+
+/** @brief Udostępnia kolejny numer iteratora.
+ * Wyznacza kolejny numer w porządku leksykograficznym, pomijając powtórzenia.
+ * @param[in,out] iter – wskaźnik na iterator.
+ * @return Wskaźnik na napis reprezentujący numer, ważny do następnego
+ *         wywołania funkcji dla tego iteratora lub do jego usunięcia.
+ *         Wartość NULL, jeśli numery się skończyły lub @p iter ma wartość
+ *         NULL.
+ */
+char const * phnumIterNext(PhoneNumbersIter *iter);
+
+/** @brief Usuwa iterator.
+ * Usuwa iterator wskazywany przez @p iter. Nic nie robi, jeśli wskaźnik ten
+ * ma wartość NULL.
+ * @param[in] iter – wskaźnik na usuwany iterator.
+ */
+void phnumIterDelete(PhoneNumbersIter *iter);
+
+/** @brief Rozpoczyna transakcję.
+ * Tworzy pustą transakcję, w której można zapamiętać zmiany przekierowań
+ * struktury @p pf funkcjami @ref phfwdTxnAdd i @ref phfwdTxnRemove. Zmiany nie
+ * są widoczne w strukturze aż do wywołania funkcji @ref phfwdTxnCommit.
+ * Zapamiętywanie zmian nie korzysta ze struktury @p pf, która musi jednak
+ * istnieć aż do zatwierdzenia lub porzucenia transakcji.
+ * @param[in] pf – wskaźnik na strukturę przechowującą przekierowania numerów.
+ * @return Wskaźnik na utworzoną transakcję lub NULL, gdy nie udało się
+ *         alokować pamięci bądź @p pf ma wartość NULL.
+ */
+PhoneForwardTxn * phfwdTxnBegin(PhoneForward *pf);
+
+/** @brief Zapamiętuje w transakcji dodanie przekierowania.
+ * Sprawdza parametry tak jak funkcja @ref phfwdAdd i zapamiętuje dodanie
+ * przekierowania z @p num1 na @p num2, wykonywane przy zatwierdzeniu
+ * transakcji. Napisy są kopiowane.
+ * @param[in,out] txn – wskaźnik na transakcję;
+ * @param[in] num1    – wskaźnik na napis reprezentujący prefiks numerów
+ *                      przekierowywanych;
+ * @param[in] num2    – wskaźnik na napis reprezentujący prefiks numerów,
+ *                      na które jest wykonywane przekierowanie.
+ * @return Wartość @p true, jeśli dodanie zostało zapamiętane.
+ *         Wartość @p false, jeśli podany napis nie reprezentuje numeru, oba
+ *         podane numery są identyczne, @p txn ma wartość NULL lub nie udało
+ *         się alokować pamięci. Transakcja pozostaje wtedy niezmieniona.
+ */
+bool phfwdTxnAdd(PhoneForwardTxn *txn, char const *num1, char const *num2);
+
+/** @brief Zapamiętuje w transakcji usunięcie przekierowań.
+ * Zapamiętuje usunięcie wszystkich przekierowań, w których parametr @p num
+ * jest prefiksem parametru @p num1 użytego przy dodawaniu, wykonywane przy
+ * zatwierdzeniu transakcji. Obejmuje ono również przekierowania dodane
+ * wcześniej w tej samej transakcji. Jeśli napis nie reprezentuje numeru,
+ * nic nie robi.
+ * @param[in,out] txn – wskaźnik na transakcję;
+ * @param[in] num     – wskaźnik na napis reprezentujący prefiks numerów.
+ * @return Wartość @p true, jeśli usunięcie zostało zapamiętane lub napis nie
+ *         reprezentuje numeru. Wartość @p false, jeśli @p txn ma wartość NULL
+ *         lub nie udało się alokować pamięci.
+ */
+bool phfwdTxnRemove(PhoneForwardTxn *txn, char const *num);
+
+/** @brief Zatwierdza transakcję.
+ * Wykonuje zmiany zapamiętane w transakcji @p txn tak, jakby zostały
+ * wykonane kolejnymi wywołaniami funkcji @ref phfwdAdd i @ref phfwdRemove w
+ * kolejności zapamiętania, i usuwa transakcję. Zmiany są wykonywane w całości
+ * albo wcale. Najpierw wyznaczany jest ich wypadkowy skutek: zmiany są
+ * sortowane według prefiksów, a dodania anulowane późniejszymi usunięciami
+ * pomijane. Następnie wszystkie potrzebne alokacje są wykonywane przed
+ * pierwszą zmianą przekierowań, a w przypadku błędu wycofywane. Posortowane
+ * dodania są wstawiane do drzewa przekierowań od miejsca rozejścia z
+ * poprzednim prefiksem, a poddrzewo usuwanego prefiksu, pod którym są
+ * dodawane przekierowania, jest zastępowane w całości nowym drzewem. W drzewie
+ * odwróconych przekierowań każdy prefiks docelowy jest wyszukiwany raz. W
+ * trybie współbieżnym blokada piszących jest zakładana raz, a zmiany są
+ * publikowane razem, po wykonaniu wszystkich.
+ * @param[in] txn – wskaźnik na zatwierdzaną transakcję.
+ * @return Wartość @p true, jeśli zmiany zostały wykonane.
+ *         Wartość @p false, jeśli @p txn ma wartość NULL lub nie udało się
+ *         alokować pamięci. Struktura pozostaje wtedy niezmieniona.
+ */
+bool phfwdTxnCommit(PhoneForwardTxn *txn);
+
+/** @brief Porzuca transakcję.
+ * Usuwa transakcję wskazywaną przez @p txn bez wykonywania zapamiętanych w
+ * niej zmian. Nic nie robi, jeśli wskaźnik ten ma wartość NULL.
+ * @param[in] txn – wskaźnik na usuwaną transakcję.
+ */
+void phfwdTxnAbort(PhoneForwardTxn *txn);
+
+/** @brief Wyznacza statystyki rozmiaru struktury.
+ * Zapisuje do @p stats ilości węzłów obu drzew i przekierowań, rozmiary
+ * napisów, tablic i węzłów, histogram długości prefiksów przekierowywanych
+ * oraz średnią ilość dzieci węzła. Wartości są aktualizowane przy każdej
+ * modyfikacji struktury, więc wywołanie nie przechodzi po drzewach i działa w
+ * czasie stałym.
+ * @param[in] pf     – wskaźnik na strukturę przechowującą przekierowania
+ *                     numerów;
+ * @param[out] stats – wskaźnik na strukturę na statystyki.
+ * @return Wartość @p true, jeśli statystyki zostały wyznaczone.
+ *         Wartość @p false, jeśli któryś ze wskaźników ma wartość NULL.
+ */
+bool phfwdStats(PhoneForward const *pf, PhoneForwardStats *stats);
+
+/** @brief Tworzy niezmienną kopię przekierowań.
+ * Tworzy niezmienną kopię przekierowań przechowywanych w strukturze @p pf,
+ * zajmującą jeden ciągły blok pamięci bez wskaźników. Późniejsze zmiany
+ * @p pf nie wpływają na kopię. Z kopii można jednocześnie korzystać w wielu
+ * wątkach bez synchronizacji. Kopia musi być zwolniona za pomocą funkcji
+ * @ref phfwdFrozenDelete.
+ * @param[in] pf – wskaźnik na strukturę przechowującą przekierowania numerów.
+ * @return Wskaźnik na kopię lub NULL, gdy nie udało się alokować pamięci,
+ *         @p pf ma wartość NULL lub drzewo jest zbyt duże.
+ */
+PhoneForwardFrozen * phfwdFreeze(PhoneForward const *pf);
+
+/** @brief Usuwa niezmienną kopię przekierowań.
+ * Usuwa kopię wskazywaną przez @p pff, również odwzorowaną z pliku. Nic nie
+ * robi, jeśli wskaźnik ten ma wartość NULL.
+ * @param[in] pff – wskaźnik na usuwaną kopię.
+ */
+void phfwdFrozenDelete(PhoneForwardFrozen *pff);
+
+/** @brief Wyznacza przekierowanie numeru w niezmiennej kopii przekierowań.
+ * Działa tak jak funkcja @ref phfwdGet dla kopii utworzonej przez
+ * @ref phfwdFreeze.
+ * @param[in] pff – wskaźnik na niezmienną kopię przekierowań;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci bądź @p pff ma wartość NULL.
+ */
+PhoneNumbers * phfwdFrozenGet(PhoneForwardFrozen const *pff, char const *num);
+
+/** @brief Wyznacza przekierowanie numeru w niezmiennej kopii do podanego bufora.
+ * Działa tak jak funkcja @ref phfwdGetInto dla kopii utworzonej przez
+ * @ref phfwdFreeze. Nie alokuje pamięci.
+ * @param[in] pff  – wskaźnik na niezmienną kopię przekierowań;
+ * @param[in] num  – wskaźnik na napis reprezentujący numer;
+ * @param[out] out – wskaźnik na bufor na wynik;
+ * @param[in] cap  – rozmiar bufora @p out w bajtach;
+ * @param[out] len – wskaźnik na długość wyniku bez znaku końca napisu lub NULL.
+ * @return Wartość @p true, jeśli wynik został zapisany w buforze.
+ *         Wartość @p false, jeśli @p pff ma wartość NULL, napis nie reprezentuje
+ *         numeru lub wynik nie mieści się w buforze.
+ */
+bool phfwdFrozenGetInto(PhoneForwardFrozen const *pff, char const *num,
+                        char *out, size_t cap, size_t *len);
+
+/** @brief Wyznacza przekierowania na dany numer w niezmiennej kopii przekierowań.
+ * Działa tak jak funkcja @ref phfwdReverse dla kopii utworzonej przez
+ * @ref phfwdFreeze lub odwzorowanej z pliku przez @ref phfwdFrozenMap.
+ * @param[in] pff – wskaźnik na niezmienną kopię przekierowań;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci bądź @p pff ma wartość NULL.
+ */
+PhoneNumbers * phfwdFrozenReverse(PhoneForwardFrozen const *pff, char const *num);
+
+/** @brief Zapisuje niezmienną kopię przekierowań do pliku.
+ * Zapisuje blok pamięci kopii @p pff do pliku @p path, który może zostać
+ * później odwzorowany w pamięci przez @ref phfwdFrozenMap. Plik nie zawiera
+ * wskaźników, więc nie zależy od adresu, pod którym zostanie odwzorowany.
+ * Plik jest zapisywany pod nazwą tymczasową i dopiero po zapisaniu całości
+ * zastępuje plik @p path.
+ * @param[in] pff  – wskaźnik na niezmienną kopię przekierowań;
+ * @param[in] path – ścieżka do pliku.
+ * @return Wartość @p true, jeśli plik został zapisany.
+ *         Wartość @p false, jeśli wystąpił błąd zapisu lub alokacji pamięci.
+ */
+bool phfwdFrozenSave(PhoneForwardFrozen const *pff, char const *path);
+
+/** @brief Odwzorowuje w pamięci niezmienną kopię przekierowań zapisaną w pliku.
+ * Odwzorowuje plik zapisany przez @ref phfwdFrozenSave w pamięci tylko do
+ * odczytu i udostępnia go bez odtwarzania struktur, więc czas wczytania nie
+ * zależy od ilości przekierowań. Strony pliku są wczytywane przy pierwszym
+ * dostępie. Sprawdzana jest sygnatura, wersja, kolejność bajtów i rozmiar
+ * pliku. Zawartość nie jest sprawdzana w całości, ale wyszukiwanie sprawdza
+ * każdy odczytany indeks i przesunięcie, więc uszkodzony plik daje co
+ * najwyżej błędne wyniki, a nie odczyt poza odwzorowaniem. Kopia musi być
+ * zwolniona za pomocą funkcji @ref phfwdFrozenDelete.
+ * @param[in] path – ścieżka do pliku.
+ * @return Wskaźnik na kopię lub NULL, gdy pliku nie udało się odczytać, nie
+ *         jest on poprawną kopią lub nie udało się alokować pamięci.
+ */
+PhoneForwardFrozen * phfwdFrozenMap(char const *path);
+
 #endif /* __PHONE_FORWARD_H__ */
 
 
@@ -0,0 +1,392 @@
+/** @file
+ * Program mierzący wydajność operacji na przekierowaniach numerów telefonów.
+ *
+ * Program generuje syntetyczny zbiór przekierowań i mierzy czas działania
+ * funkcji @ref phfwdAdd, @ref phfwdGet, @ref phfwdReverse,
+ * @ref phfwdGetReverse, @ref phfwdRemove, @ref phfwdDelete oraz
+ * @ref phfwdBulkLoad, która ładuje te same przekierowania co kolejne
+ * wywołania @ref phfwdAdd mierzone jako add. Dla każdej
+ * operacji wypisuje na standardowe wyjście jeden wiersz w formacie JSON
+ * z ilością wywołań, przepustowością, percentylami czasu pojedynczego
+ * wywołania w nanosekundach i maksymalnym zużyciem pamięci procesu.
+ *
+ * Opcje:
+ * - `-n LICZBA` – ilość przekierowań (domyślnie 100000);
+ * - `-q LICZBA` – ilość zapytań każdego rodzaju (domyślnie 100000);
+ * - `-m DŁUGOŚĆ` – najmniejsza długość prefiksu (domyślnie 3);
+ * - `-M DŁUGOŚĆ` – największa długość prefiksu (domyślnie 12);
+ * - `-d uniform|geometric` – rozkład długości prefiksów: jednostajny lub
+ *   geometryczny z połową prefiksów o najmniejszej długości (domyślnie
+ *   uniform);
+ * - `-f UŁAMEK` – część przekierowań na jeden wspólny prefiks (domyślnie 0);
+ * - `-S` – przekierowania dodawane w kolejności rosnących prefiksów
+ *   przekierowywanych zamiast w kolejności losowania;
+ * - `-s ZIARNO` – ziarno generatora liczb losowych (domyślnie 1).
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "phone_forward.h"
+
+#define MAX_PREFIX 64                   ///< Największa długość prefiksu.
+#define MAX_NUMBER (2 * MAX_PREFIX + 1) ///< Rozmiar bufora na numer.
+
+/**
+ * To jest struktura przechowująca parametry generowanych danych.
+ */
+struct BenchConfig {
+    size_t rules;           ///< Ilość przekierowań.
+    size_t queries;         ///< Ilość zapytań każdego rodzaju.
+    size_t min_len;         ///< Najmniejsza długość prefiksu.
+    size_t max_len;         ///< Największa długość prefiksu.
+    bool geometric;         ///< Czy długości mają rozkład geometryczny.
+    double fan_in;          ///< Część przekierowań na wspólny prefiks.
+    bool sorted;            ///< Czy przekierowania są posortowane.
+    uint64_t seed;          ///< Ziarno generatora liczb losowych.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct BenchConfig BenchConfig;
+
+/**
+ * Stan generatora liczb losowych.
+ */
+static uint64_t random_state;
+
+/**
+ * @brief Losuje liczbę.
+ * Generator xorshift64*, niezależny od implementacji funkcji rand, aby
+ * wyniki na różnych systemach były porównywalne.
+ * @return Losowa liczba 64-bitowa.
+ */
+static uint64_t next_random(void) {
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Losuje długość prefiksu.
+ * @param[in] config - parametry generowanych danych.
+ * @return Długość z przedziału od @p min_len do @p max_len.
+ */
+static size_t random_length(const BenchConfig* config) {
+    size_t span = config->max_len - config->min_len;
+    if (!config->geometric)
+        return config->min_len + next_random() % (span + 1);
+    size_t length = config->min_len;
+    while (length < config->max_len && next_random() % 2 == 0)
+        length++;
+    return length;
+}
+
+/**
+ * @brief Zapisuje losowe cyfry do bufora.
+ * @param[out] buffer - bufor na cyfry;
+ * @param[in] length - ilość cyfr.
+ */
+static void random_digits(char* buffer, size_t length) {
+    for (size_t i = 0; i < length; i++)
+        buffer[i] = (char)('0' + next_random() % 10);
+    buffer[length] = '\0';
+}
+
+/**
+ * @brief Zwraca bieżący czas w nanosekundach.
+ * @return Czas zegara monotonicznego.
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Porównuje czasy.
+ * @param[in] a - wskaźnik na pierwszy czas;
+ * @param[in] b - wskaźnik na drugi czas.
+ * @return Liczba ujemna, zero lub dodatnia, jak w funkcji strcmp.
+ */
+static int compare_ns(const void* a, const void* b) {
+    uint64_t first = *(const uint64_t*)a;
+    uint64_t second = *(const uint64_t*)b;
+    return (first > second) - (first < second);
+}
+
+/**
+ * @brief Wypisuje wyniki pomiaru operacji.
+ * Sortuje czasy pojedynczych wywołań i wypisuje wiersz w formacie JSON.
+ * @param[in] operation - nazwa operacji;
+ * @param[in,out] samples - czasy kolejnych wywołań;
+ * @param[in] count - ilość wywołań;
+ * @param[in] total - łączny czas wywołań w nanosekundach.
+ */
+static void report(const char* operation, uint64_t* samples, size_t count,
+                   uint64_t total) {
+    qsort(samples, count, sizeof(uint64_t), compare_ns);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double seconds = (double)total / 1e9;
+    printf("{\"op\":\"%s\",\"count\":%zu,\"total_ns\":%llu,\"ops_per_sec\":%.0f,"
+           "\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,"
+           "\"peak_rss_kb\":%ld}\n",
+           operation, count, (unsigned long long)total,
+           seconds > 0 ? (double)count / seconds : 0.0,
+           (unsigned long long)(count ? samples[count / 2] : 0),
+           (unsigned long long)(count ? samples[count * 9 / 10] : 0),
+           (unsigned long long)(count ? samples[count * 99 / 100] : 0),
+           (unsigned long long)(count ? samples[count - 1] : 0),
+           usage.ru_maxrss);
+}
+
+/**
+ * @brief Generuje przekierowania.
+ * Prefiks docelowy jest losowany ponownie, jeśli jest równy prefiksowi
+ * przekierowywanemu, aby wszystkie przekierowania były poprawne.
+ * @param[in] config - parametry generowanych danych;
+ * @param[out] num1 - tablica na prefiksy przekierowywane;
+ * @param[out] num2 - tablica na prefiksy docelowe.
+ */
+static void generate_rules(const BenchConfig* config, char (*num1)[MAX_PREFIX + 1],
+                           char (*num2)[MAX_PREFIX + 1]) {
+    char hot[MAX_PREFIX + 1];
+    random_digits(hot, config->min_len);
+    for (size_t i = 0; i < config->rules; i++) {
+        random_digits(num1[i], random_length(config));
+        do {
+            if ((double)(next_random() % 1000000) < config->fan_in * 1000000)
+                strcpy(num2[i], hot);
+            else
+                random_digits(num2[i], random_length(config));
+        } while (strcmp(num1[i], num2[i]) == 0);
+    }
+}
+
+/**
+ * Prefiksy, według których porządkowane są przekierowania.
+ */
+static char (*sort_keys)[MAX_PREFIX + 1];
+
+/**
+ * @brief Porównuje przekierowania według prefiksów przekierowywanych.
+ * @param[in] a - wskaźnik na pozycję pierwszego przekierowania;
+ * @param[in] b - wskaźnik na pozycję drugiego przekierowania.
+ * @return Liczba ujemna, zero lub dodatnia, jak w funkcji strcmp.
+ */
+static int compare_rules(const void* a, const void* b) {
+    return strcmp(sort_keys[*(const size_t*)a], sort_keys[*(const size_t*)b]);
+}
+
+/**
+ * @brief Porządkuje przekierowania według prefiksów przekierowywanych.
+ * @param[in] config - parametry generowanych danych;
+ * @param[in,out] num1 - tablica prefiksów przekierowywanych;
+ * @param[in,out] num2 - tablica prefiksów docelowych.
+ * @return true - jeśli przekierowania zostały posortowane.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool sort_rules(const BenchConfig* config, char (*num1)[MAX_PREFIX + 1],
+                       char (*num2)[MAX_PREFIX + 1]) {
+    size_t* order = malloc(sizeof(size_t) * (config->rules + 1));
+    char (*copy)[MAX_PREFIX + 1] = malloc(sizeof(*copy) * (config->rules + 1));
+    bool result = order != NULL && copy != NULL;
+    if (result) {
+        for (size_t i = 0; i < config->rules; i++)
+            order[i] = i;
+        sort_keys = num1;
+        qsort(order, config->rules, sizeof(size_t), compare_rules);
+        memcpy(copy, num1, sizeof(*copy) * config->rules);
+        for (size_t i = 0; i < config->rules; i++)
+            strcpy(num1[i], copy[order[i]]);
+        memcpy(copy, num2, sizeof(*copy) * config->rules);
+        for (size_t i = 0; i < config->rules; i++)
+            strcpy(num2[i], copy[order[i]]);
+    }
+    free(order);
+    free(copy);
+    return result;
+}
+
+/**
+ * @brief Tworzy numer zapytania o podanym prefiksie.
+ * @param[out] buffer - bufor na numer;
+ * @param[in] prefix - prefiks numeru lub NULL dla całkowicie losowego numeru;
+ * @param[in] config - parametry generowanych danych.
+ */
+static void query_number(char* buffer, const char* prefix, const BenchConfig* config) {
+    size_t length = 0;
+    if (prefix != NULL) {
+        length = strlen(prefix);
+        memcpy(buffer, prefix, length);
+    }
+    random_digits(buffer + length, random_length(config));
+}
+
+/**
+ * @brief Mierzy czas zapytań zwracających ciąg numerów.
+ * Połowa zapytań dotyczy numerów o prefiksie z losowego przekierowania
+ * (@p num1 dla get, @p num2 dla pozostałych), a połowa numerów losowych.
+ * @param[in] operation - nazwa operacji;
+ * @param[in] query - mierzona funkcja;
+ * @param[in] pf - wskaźnik na strukturę przechowującą przekierowania;
+ * @param[in] prefixes - prefiksy numerów zapytań;
+ * @param[in] config - parametry generowanych danych;
+ * @param[out] samples - tablica na czasy wywołań.
+ */
+static void bench_query(const char* operation,
+                        PhoneNumbers * (*query)(PhoneForward const*, char const*),
+                        PhoneForward* pf, char (*prefixes)[MAX_PREFIX + 1],
+                        const BenchConfig* config, uint64_t* samples) {
+    char number[MAX_NUMBER];
+    uint64_t total = 0;
+    for (size_t i = 0; i < config->queries; i++) {
+        bool hit = config->rules > 0 && i % 2 == 0;
+        query_number(number, hit ? prefixes[next_random() % config->rules] : NULL, config);
+        uint64_t start = now_ns();
+        PhoneNumbers* pnum = query(pf, number);
+        samples[i] = now_ns() - start;
+        total += samples[i];
+        phnumDelete(pnum);
+    }
+    report(operation, samples, config->queries, total);
+}
+
+/**
+ * @brief Wypisuje sposób użycia programu.
+ * @param[in] name - nazwa programu.
+ * @return Kod zakończenia programu.
+ */
+static int usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-n RULES] [-q QUERIES] [-m MIN_LEN] [-M MAX_LEN]"
+                    " [-d uniform|geometric] [-f FAN_IN] [-S] [-s SEED]\n", name);
+    return 2;
+}
+
+/**
+ * @brief Wykonuje pomiary.
+ * @param[in] argc - ilość argumentów;
+ * @param[in] argv - argumenty programu.
+ * @return 0 w przypadku powodzenia, 2 w przypadku błędu argumentów lub pamięci.
+ */
+int main(int argc, char* argv[]) {
+    BenchConfig config = {100000, 100000, 3, 12, false, 0.0, false, 1};
+    int option;
+    while ((option = getopt(argc, argv, "n:q:m:M:d:f:Ss:")) != -1) {
+        switch (option) {
+            case 'n': config.rules = strtoull(optarg, NULL, 10); break;
+            case 'q': config.queries = strtoull(optarg, NULL, 10); break;
+            case 'm': config.min_len = strtoull(optarg, NULL, 10); break;
+            case 'M': config.max_len = strtoull(optarg, NULL, 10); break;
+            case 'd':
+                if (strcmp(optarg, "geometric") == 0)
+                    config.geometric = true;
+                else if (strcmp(optarg, "uniform") != 0)
+                    return usage(argv[0]);
+                break;
+            case 'f': config.fan_in = strtod(optarg, NULL); break;
+            case 'S': config.sorted = true; break;
+            case 's': config.seed = strtoull(optarg, NULL, 10); break;
+            default: return usage(argv[0]);
+        }
+    }
+    if (optind != argc || config.min_len == 0 || config.min_len > config.max_len
+        || config.max_len > MAX_PREFIX)
+        return usage(argv[0]);
+    random_state = config.seed == 0 ? 1 : config.seed;
+
+    size_t samples_count = config.rules > config.queries ? config.rules : config.queries;
+    char (*num1)[MAX_PREFIX + 1] = malloc(sizeof(*num1) * (config.rules + 1));
+    char (*num2)[MAX_PREFIX + 1] = malloc(sizeof(*num2) * (config.rules + 1));
+    uint64_t* samples = malloc(sizeof(uint64_t) * (samples_count + 1));
+    PhoneForward* pf = phfwdNew();
+    if (num1 == NULL || num2 == NULL || samples == NULL || pf == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 2;
+    }
+    generate_rules(&config, num1, num2);
+    if (config.sorted && !sort_rules(&config, num1, num2)) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 2;
+    }
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < config.rules; i++) {
+        uint64_t start = now_ns();
+        phfwdAdd(pf, num1[i], num2[i]);
+        samples[i] = now_ns() - start;
+        total += samples[i];
+    }
+    report("add", samples, config.rules, total);
+
+    bench_query("get", phfwdGet, pf, num1, &config, samples);
+    bench_query("reverse", phfwdReverse, pf, num2, &config, samples);
+    bench_query("getreverse", phfwdGetReverse, pf, num2, &config, samples);
+
+    total = 0;
+    for (size_t i = 0; i < config.rules; i++) {
+        uint64_t start = now_ns();
+        phfwdRemove(pf, num1[i]);
+        samples[i] = now_ns() - start;
+        total += samples[i];
+    }
+    report("remove", samples, config.rules, total);
+    phfwdDelete(pf);
+
+    // Usuwanie całej struktury jest mierzone na ponownie zbudowanej strukturze.
+    pf = phfwdNew();
+    if (pf == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 2;
+    }
+    for (size_t i = 0; i < config.rules; i++)
+        phfwdAdd(pf, num1[i], num2[i]);
+    uint64_t start = now_ns();
+    phfwdDelete(pf);
+    samples[0] = now_ns() - start;
+    report("delete", samples, 1, samples[0]);
+
+    // Ładowanie hurtowe tych samych przekierowań do nowej struktury.
+    const char** first = malloc(sizeof(char*) * (config.rules + 1));
+    const char** second = malloc(sizeof(char*) * (config.rules + 1));
+    pf = phfwdNew();
+    if (first == NULL || second == NULL || pf == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 2;
+    }
+    for (size_t i = 0; i < config.rules; i++) {
+        first[i] = num1[i];
+        second[i] = num2[i];
+    }
+    start = now_ns();
+    bool loaded = phfwdBulkLoad(pf, first, second, config.rules);
+    samples[0] = now_ns() - start;
+    if (!loaded) {
+        fprintf(stderr, "%s: bulk load failed\n", argv[0]);
+        return 2;
+    }
+    report("bulk", samples, 1, samples[0]);
+    phfwdDelete(pf);
+    free(first);
+    free(second);
+
+    free(num1);
+    free(num2);
+    free(samples);
+    return 0;
+}
@@ -3,11 +3,25 @@
 #endif
 
 #include "phone_forward.h"
+#include "phone_forward_sharded.h"
+#include "phone_forward_journal.h"
 #include <assert.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdio.h>
 
 #define MAX_LEN 23
+#define RACE_ROUNDS 2000
+
+static PhoneForwardSharded *race_pfs;
+
+static void *race_add(void *num2) {
+  if (strcmp(num2, "") == 0)
+    phfwdShardedRemove(race_pfs, "1");
+  else
+    assert(phfwdShardedAdd(race_pfs, "1", num2) == true);
+  return NULL;
+}
 
 int main() {
   char num1[MAX_LEN + 1], num2[MAX_LEN + 1];
@@ -57,7 +71,7 @@ int main() {
   pnum = phfwdGet(pf, "432");
   assert(strcmp(phnumGet(pnum, 0), "433") == 0);
   phnumDelete(pnum);
-/*
+
   pnum = phfwdReverse(pf, "432");
   assert(strcmp(phnumGet(pnum, 0), "431") == 0);
   assert(strcmp(phnumGet(pnum, 1), "432") == 0);
@@ -75,27 +89,27 @@ int main() {
   assert(strcmp(phnumGet(pnum, 1), "987654321") == 0);
   assert(phnumGet(pnum, 2) == NULL);
   phnumDelete(pnum);
-*/
+
   phfwdRemove(pf, "12");
 
   pnum = phfwdGet(pf, "123456");
   assert(strcmp(phnumGet(pnum, 0), "123456") == 0);
   phnumDelete(pnum);
-/*
+
   pnum = phfwdReverse(pf, "987654321");
   assert(strcmp(phnumGet(pnum, 0), "987654321") == 0);
   assert(phnumGet(pnum, 1) == NULL);
   phnumDelete(pnum);
-*/
+
   assert(phfwdAdd(pf, "567", "0") == true);
   assert(phfwdAdd(pf, "5678", "08") == true);
-/*
+
   pnum = phfwdReverse(pf, "08");
   assert(strcmp(phnumGet(pnum, 0), "08") == 0);
   assert(strcmp(phnumGet(pnum, 1), "5678") == 0);
   assert(phnumGet(pnum, 2) == NULL);
   phnumDelete(pnum);
-*/
+
   assert(phfwdAdd(pf, "A", "1") == false);
   assert(phfwdAdd(pf, "1", "A") == false);
 
@@ -105,11 +119,11 @@ int main() {
   pnum = phfwdGet(pf, "A");
   assert(phnumGet(pnum, 0) == NULL);
   phnumDelete(pnum);
-/*
+
   pnum = phfwdReverse(pf, "A");
   assert(phnumGet(pnum, 0) == NULL);
   phnumDelete(pnum);
-*/
+
   phfwdAdd(pf, "12", "123");
   pnum = phfwdGet(pf, "123");
   assert(strcmp(phnumGet(pnum, 0), "1233") == 0);
@@ -117,13 +131,13 @@ int main() {
 
   phfwdAdd(pf, "2", "4");
   phfwdAdd(pf, "23", "4");
-/*  pnum = phfwdReverse(pf, "434");
+  pnum = phfwdReverse(pf, "434");
   assert(strcmp(phnumGet(pnum, 0), "2334") == 0);
   assert(strcmp(phnumGet(pnum, 1), "234") == 0);
   assert(strcmp(phnumGet(pnum, 2), "434") == 0);
   assert(phnumGet(pnum, 3) == NULL);
   phnumDelete(pnum);
-*/
+
   phfwdDelete(pf);
   pnum = NULL;
   phnumDelete(pnum);
@@ -138,9 +152,349 @@ int main() {
   pnum = phfwdGet(pf, "7581");
   assert(strcmp(phnumGet(pnum, 0), "7581") == 0);
   phnumDelete(pnum);
-  /*pnum = phfwdReverse(pf, "7581");
+  char buf[MAX_LEN + 1];
+  size_t len;
+  assert(phfwdGetInto(pf, "1234581", buf, sizeof buf, &len) == true);
+  assert(strcmp(buf, "76581") == 0 && len == 5);
+  assert(phfwdGetInto(pf, "1234581", buf, 5, &len) == false && len == 5);
+  assert(phfwdGetInto(pf, "12a", buf, sizeof buf, &len) == false && len == 0);
+  char const *batch[] = {"1234581", "12a", "7581"};
+  size_t offsets[3];
+  assert(phfwdGetBatch(pf, batch, 3, buf, sizeof buf, offsets) == 3);
+  assert(strcmp(buf + offsets[0], "76581") == 0);
+  assert(strcmp(buf + offsets[1], "") == 0);
+  assert(strcmp(buf + offsets[2], "7581") == 0);
+  PhoneForwardFrozen *pff = phfwdFreeze(pf);
+  phfwdAdd(pf, "7", "1");
+  pnum = phfwdFrozenGet(pff, "1234581");
+  assert(strcmp(phnumGet(pnum, 0), "76581") == 0);
+  phnumDelete(pnum);
+  assert(phfwdFrozenGetInto(pff, "7581", buf, sizeof buf, &len) == true);
+  assert(strcmp(buf, "7581") == 0);
+  pnum = phfwdFrozenReverse(pff, "76581");
+  assert(strcmp(phnumGet(pnum, 0), "1234581") == 0);
+  assert(strcmp(phnumGet(pnum, 1), "76581") == 0);
+  assert(phnumGet(pnum, 2) == NULL);
+  phnumDelete(pnum);
+  assert(phfwdFrozenSave(pff, "phone_forward_example.img") == true);
+  phfwdFrozenDelete(pff);
+  pff = phfwdFrozenMap("phone_forward_example.img");
+  assert(pff != NULL);
+  pnum = phfwdFrozenGet(pff, "1234581");
+  assert(strcmp(phnumGet(pnum, 0), "76581") == 0);
+  phnumDelete(pnum);
+  phfwdFrozenDelete(pff);
+  remove("phone_forward_example.img");
+  pnum = phfwdReverse(pf, "7581");
   assert(strcmp(phnumGet(pnum, 0), "7581") == 0);
   assert(phnumGet(pnum, 1) == NULL);
   phnumDelete(pnum);
-  */phfwdDelete(pf);
+  phfwdDelete(pf);
+
+  pf = phfwdNewConcurrent();
+  assert(phfwdAdd(pf, "12", "34") == true);
+  pnum = phfwdGet(pf, "129");
+  assert(strcmp(phnumGet(pnum, 0), "349") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdReverse(pf, "349");
+  assert(strcmp(phnumGet(pnum, 0), "129") == 0);
+  assert(strcmp(phnumGet(pnum, 1), "349") == 0);
+  phnumDelete(pnum);
+  phfwdRemove(pf, "1");
+  pnum = phfwdGet(pf, "129");
+  assert(strcmp(phnumGet(pnum, 0), "129") == 0);
+  phnumDelete(pnum);
+  phfwdDelete(pf);
+
+  pf = phfwdNew();
+  char const *from[] = {"5", "12", "123", "12", "4"};
+  char const *to[] = {"7", "9", "8", "3", "3"};
+  assert(phfwdBulkLoad(pf, from, to, 5) == true);
+  pnum = phfwdGet(pf, "1245");
+  assert(strcmp(phnumGet(pnum, 0), "345") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdGet(pf, "1234");
+  assert(strcmp(phnumGet(pnum, 0), "84") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdReverse(pf, "34");
+  assert(strcmp(phnumGet(pnum, 0), "124") == 0);
+  assert(strcmp(phnumGet(pnum, 1), "34") == 0);
+  assert(strcmp(phnumGet(pnum, 2), "44") == 0);
+  assert(phnumGet(pnum, 3) == NULL);
+  phnumDelete(pnum);
+  char const *invalid[] = {"6", "1a"};
+  assert(phfwdBulkLoad(pf, invalid, to, 2) == false);
+  pnum = phfwdGet(pf, "6");
+  assert(strcmp(phnumGet(pnum, 0), "6") == 0);
+  phnumDelete(pnum);
+  phfwdDelete(pf);
+
+  FILE *rules = fopen("phone_forward_example.txt", "w");
+  assert(rules != NULL);
+  fputs("12 9\n123 8\r\n5 7\n", rules);
+  fclose(rules);
+  pf = phfwdNew();
+  assert(phfwdLoadFile(pf, "phone_forward_example.txt") == true);
+  remove("phone_forward_example.txt");
+  pnum = phfwdGet(pf, "1235");
+  assert(strcmp(phnumGet(pnum, 0), "85") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdGet(pf, "555");
+  assert(strcmp(phnumGet(pnum, 0), "755") == 0);
+  phnumDelete(pnum);
+  phfwdDelete(pf);
+
+  PhoneForwardStats stats;
+  pf = phfwdNew();
+  assert(phfwdAdd(pf, "12", "3") == true);
+  assert(phfwdAdd(pf, "123", "4") == true);
+  assert(phfwdStats(pf, &stats) == true);
+  assert(stats.rules == 2 && stats.forward_nodes == 3 && stats.backward_nodes == 3);
+  assert(stats.depth_histogram[2] == 1 && stats.depth_histogram[3] == 1);
+  assert(stats.prefix_bytes == 4 && stats.average_fan_out == 1.0);
+  phfwdRemove(pf, "12");
+  assert(phfwdStats(pf, &stats) == true);
+  assert(stats.rules == 0 && stats.forward_nodes == 1 && stats.prefix_bytes == 0);
+  phfwdDelete(pf);
+  PhoneNumbers const *lists[2];
+  pf = phfwdNew();
+  assert(phfwdAdd(pf, "12", "3") == true);
+  assert(phfwdAdd(pf, "4", "3") == true);
+  lists[0] = phfwdReverse(pf, "3");
+  lists[1] = phfwdReverse(pf, "31");
+  pnum = phnumMerge(lists, 2);
+  assert(strcmp(phnumGet(pnum, 0), "12") == 0);
+  assert(strcmp(phnumGet(pnum, 1), "121") == 0);
+  assert(strcmp(phnumGet(pnum, 2), "3") == 0);
+  assert(strcmp(phnumGet(pnum, 3), "31") == 0);
+  assert(strcmp(phnumGet(pnum, 4), "4") == 0);
+  assert(strcmp(phnumGet(pnum, 5), "41") == 0);
+  assert(phnumGet(pnum, 6) == NULL);
+  phnumDelete(pnum);
+  phnumDelete((PhoneNumbers *)lists[0]);
+  phnumDelete((PhoneNumbers *)lists[1]);
+  phfwdDelete(pf);
+
+  char const *queries[] = {"3", "31", "x", "9"};
+  PhoneNumbers *reverse[4];
+  pf = phfwdNew();
+  assert(phfwdAdd(pf, "12", "3") == true);
+  assert(phfwdAdd(pf, "121", "5") == true);
+  assert(phfwdGetReverseBatch(pf, queries, 4, reverse, 2) == true);
+  assert(strcmp(phnumGet(reverse[0], 0), "12") == 0);
+  assert(strcmp(phnumGet(reverse[0], 1), "3") == 0);
+  assert(phnumGet(reverse[0], 2) == NULL);
+  assert(strcmp(phnumGet(reverse[1], 0), "31") == 0);
+  assert(phnumGet(reverse[1], 1) == NULL);
+  assert(phnumGet(reverse[2], 0) == NULL);
+  assert(strcmp(phnumGet(reverse[3], 0), "9") == 0);
+  for (size_t i = 0; i < 4; i++)
+    phnumDelete(reverse[i]);
+  assert(phfwdGetReverseBatch(NULL, queries, 4, reverse, 2) == false);
+  phfwdDelete(pf);
+
+  char number[] = "31";
+  pf = phfwdNew();
+  assert(phfwdAdd(pf, "12", "3") == true);
+  assert(phfwdAdd(pf, "4", "3") == true);
+  assert(phfwdAdd(pf, "121", "5") == true);
+  PhoneNumbersIter *iter = phfwdReverseIter(pf, number);
+  number[0] = '9';
+  phfwdRemove(pf, "4");
+  assert(strcmp(phnumIterNext(iter), "121") == 0);
+  assert(strcmp(phnumIterNext(iter), "31") == 0);
+  assert(strcmp(phnumIterNext(iter), "41") == 0);
+  assert(phnumIterNext(iter) == NULL);
+  assert(phnumIterNext(iter) == NULL);
+  phnumIterDelete(iter);
+  iter = phfwdGetReverseIter(pf, "31");
+  assert(strcmp(phnumIterNext(iter), "31") == 0);
+  phnumIterDelete(iter);
+  iter = phfwdReverseIter(pf, "3x");
+  assert(phnumIterNext(iter) == NULL);
+  phnumIterDelete(iter);
+  assert(phfwdReverseIter(NULL, "3") == NULL);
+  phfwdDelete(pf);
+
+  pf = phfwdNew();
+  assert(phfwdAdd(pf, "1", "2") == true);
+  assert(phfwdAdd(pf, "13", "23") == true);
+  assert(phfwdAdd(pf, "5", "234") == true);
+  assert(phfwdReverseCount(pf, "234") == 3);
+  assert(phfwdGetReverseCount(pf, "234") == 3);
+  assert(phfwdReverseCount(pf, "24") == 2);
+  assert(phfwdGetReverseCount(pf, "24") == 2);
+  assert(phfwdReverseCount(pf, "2x") == 0);
+  assert(phfwdAdd(pf, "13", "4") == true);
+  assert(phfwdReverseCount(pf, "234") == 3);
+  assert(phfwdGetReverseCount(pf, "234") == 2);
+  phfwdRemove(pf, "1");
+  assert(phfwdReverseCount(pf, "234") == 2);
+  assert(phfwdReverseCount(NULL, "234") == 0);
+  phfwdDelete(pf);
+
+  pf = phfwdNew();
+  assert(phfwdAdd(pf, "12", "3") == true);
+  assert(phfwdAdd(pf, "19", "4") == true);
+  assert(phfwdAdd(pf, "2", "5") == true);
+  PhoneForwardTxn *txn = phfwdTxnBegin(pf);
+  assert(phfwdTxnAdd(txn, "123", "7") == true);
+  assert(phfwdTxnRemove(txn, "1") == true);
+  assert(phfwdTxnAdd(txn, "15", "8") == true);
+  assert(phfwdTxnAdd(txn, "2", "2") == false);
+  assert(phfwdTxnRemove(txn, "1x") == true);
+  pnum = phfwdGet(pf, "1234");
+  assert(strcmp(phnumGet(pnum, 0), "334") == 0);
+  phnumDelete(pnum);
+  assert(phfwdTxnCommit(txn) == true);
+  pnum = phfwdGet(pf, "1234");
+  assert(strcmp(phnumGet(pnum, 0), "1234") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdGet(pf, "159");
+  assert(strcmp(phnumGet(pnum, 0), "89") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdGet(pf, "199");
+  assert(strcmp(phnumGet(pnum, 0), "199") == 0);
+  phnumDelete(pnum);
+  txn = phfwdTxnBegin(pf);
+  assert(phfwdTxnRemove(txn, "2") == true);
+  phfwdTxnAbort(txn);
+  pnum = phfwdGet(pf, "21");
+  assert(strcmp(phnumGet(pnum, 0), "51") == 0);
+  phnumDelete(pnum);
+  assert(phfwdTxnCommit(NULL) == false);
+  phfwdDelete(pf);
+
+  remove("phone_forward_example.ckpt");
+  remove("phone_forward_example.wal");
+  pf = phfwdNew();
+  PhoneForwardJournal *pfj = phfwdJournalOpen(pf, "phone_forward_example.ckpt",
+                                              "phone_forward_example.wal", 2, 0);
+  assert(phfwdJournalOpen(pf, "phone_forward_example.ckpt",
+                          "phone_forward_example.wal", 0, 0) == NULL);
+  assert(phfwdJournalAdd(pfj, "12", "3") == true);
+  assert(phfwdJournalAdd(pfj, "1#", "4*") == true);
+  assert(phfwdJournalCheckpoint(pfj) == true);
+  assert(phfwdJournalAdd(pfj, "12", "12") == false);
+  assert(phfwdJournalRemove(pfj, "1#") == true);
+  assert(phfwdJournalRemove(pfj, "1a") == true);
+  assert(phfwdJournalAdd(pfj, "567", "8") == true);
+  assert(phfwdJournalClose(pfj) == true);
+  phfwdDelete(pf);
+  pf = phfwdNew();
+  pfj = phfwdJournalOpen(pf, "phone_forward_example.ckpt",
+                         "phone_forward_example.wal", 2, 0);
+  assert(pfj != NULL);
+  pnum = phfwdGet(pf, "129");
+  assert(strcmp(phnumGet(pnum, 0), "39") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdGet(pf, "1#9");
+  assert(strcmp(phnumGet(pnum, 0), "1#9") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdGet(pf, "5678");
+  assert(strcmp(phnumGet(pnum, 0), "88") == 0);
+  phnumDelete(pnum);
+  assert(phfwdJournalAdd(pfj, "7", "71") == true);
+  assert(phfwdJournalCheckpointDue(pfj) == false);
+  assert(phfwdJournalCheckpointDue(NULL) == false);
+  assert(phfwdJournalSync(pfj) == true);
+  assert(phfwdJournalAdd(pfj, "8", "81") == true);
+  assert(phfwdJournalClose(pfj) == true);
+  assert(phfwdJournalClose(NULL) == true);
+  phfwdDelete(pf);
+  // Uszkodzenie grupy, za którą są dalsze grupy, nie jest niepełną końcówką.
+  FILE *wal = fopen("phone_forward_example.wal", "r+b");
+  assert(wal != NULL && fseek(wal, 20, SEEK_SET) == 0);
+  int byte = fgetc(wal);
+  assert(fseek(wal, 20, SEEK_SET) == 0 && fputc(byte ^ 0x40, wal) != EOF);
+  assert(fseek(wal, 0, SEEK_END) == 0);
+  long wal_size = ftell(wal);
+  assert(fclose(wal) == 0);
+  pf = phfwdNew();
+  assert(phfwdJournalOpen(pf, "phone_forward_example.ckpt",
+                          "phone_forward_example.wal", 2, 0) == NULL);
+  wal = fopen("phone_forward_example.wal", "r+b");
+  assert(wal != NULL && fseek(wal, 0, SEEK_END) == 0 && ftell(wal) == wal_size);
+  assert(fseek(wal, 20, SEEK_SET) == 0 && fputc(byte, wal) != EOF);
+  // Niepełna ostatnia grupa jest pomijana.
+  assert(fseek(wal, 0, SEEK_END) == 0 && fwrite("\x10\0\0\0\1", 1, 5, wal) == 5);
+  assert(fclose(wal) == 0);
+  pfj = phfwdJournalOpen(pf, "phone_forward_example.ckpt",
+                         "phone_forward_example.wal", 2, 0);
+  assert(pfj != NULL);
+  pnum = phfwdGet(pf, "89");
+  assert(strcmp(phnumGet(pnum, 0), "819") == 0);
+  phnumDelete(pnum);
+  assert(phfwdJournalClose(pfj) == true);
+  phfwdDelete(pf);
+  // Przekroczenie rozmiaru dziennika tylko zaznacza potrzebę punktu kontrolnego.
+  pf = phfwdNew();
+  pfj = phfwdJournalOpen(pf, "phone_forward_example.ckpt",
+                         "phone_forward_example.wal", 1, 1);
+  assert(phfwdJournalAdd(pfj, "9", "91") == true);
+  assert(phfwdJournalCheckpointDue(pfj) == true);
+  assert(phfwdJournalCheckpoint(pfj) == true);
+  assert(phfwdJournalCheckpointDue(pfj) == false);
+  assert(phfwdJournalClose(pfj) == true);
+  phfwdDelete(pf);
+  remove("phone_forward_example.ckpt");
+  remove("phone_forward_example.wal");
+
+  PhoneForwardSharded *pfs = phfwdShardedNew(2);
+  assert(phfwdShardedNew(3) == NULL);
+  assert(phfwdShardedAdd(pfs, "1", "9") == true);
+  assert(phfwdShardedAdd(pfs, "123", "4") == true);
+  assert(phfwdShardedAdd(pfs, "52", "4") == true);
+  assert(phfwdShardedAdd(pfs, "52", "52") == false);
+  assert(phfwdShardedAdd(pfs, "5a", "4") == false);
+  pnum = phfwdShardedGet(pfs, "1234");
+  assert(strcmp(phnumGet(pnum, 0), "44") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdShardedGet(pfs, "1");
+  assert(strcmp(phnumGet(pnum, 0), "9") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdShardedGet(pfs, "15");
+  assert(strcmp(phnumGet(pnum, 0), "95") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdShardedReverse(pfs, "45");
+  assert(strcmp(phnumGet(pnum, 0), "1235") == 0);
+  assert(strcmp(phnumGet(pnum, 1), "45") == 0);
+  assert(strcmp(phnumGet(pnum, 2), "525") == 0);
+  assert(phnumGet(pnum, 3) == NULL);
+  phnumDelete(pnum);
+  pnum = phfwdShardedReverse(pfs, "9");
+  assert(strcmp(phnumGet(pnum, 0), "1") == 0);
+  assert(strcmp(phnumGet(pnum, 1), "9") == 0);
+  assert(phnumGet(pnum, 2) == NULL);
+  phnumDelete(pnum);
+  phfwdShardedRemove(pfs, "1");
+  pnum = phfwdShardedGet(pfs, "1234");
+  assert(strcmp(phnumGet(pnum, 0), "1234") == 0);
+  phnumDelete(pnum);
+  pnum = phfwdShardedReverse(pfs, "x");
+  assert(phnumGet(pnum, 0) == NULL);
+  phnumDelete(pnum);
+  phfwdShardedDelete(pfs);
+
+  // Współbieżne zmiany prefiksu powielonego w wielu częściach muszą dać we
+  // wszystkich częściach ten sam wynik.
+  race_pfs = phfwdShardedNew(2);
+  char *race_targets[] = {"5", "6", ""};
+  for (int round = 0; round < RACE_ROUNDS; round++) {
+    pthread_t threads[3];
+    for (int i = 0; i < 3; i++)
+      assert(pthread_create(&threads[i], NULL, race_add, race_targets[i]) == 0);
+    for (int i = 0; i < 3; i++)
+      pthread_join(threads[i], NULL);
+    char first = 0;
+    for (const char *digit = "0123456789*#"; *digit != '\0'; digit++) {
+      char num[3] = {'1', *digit, '\0'};
+      pnum = phfwdShardedGet(race_pfs, num);
+      if (first == 0)
+        first = phnumGet(pnum, 0)[0];
+      assert(phnumGet(pnum, 0)[0] == first);
+      phnumDelete(pnum);
+    }
+  }
+  phfwdShardedDelete(race_pfs);
 }
@@ -0,0 +1,719 @@
+/** @file
+ * Implementacja dziennika zmian przekierowań z punktami kontrolnymi.
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L ///< Udostępnienie funkcji POSIX: pwrite, fdatasync.
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "digits.h"
+#include "phone_forward_journal.h"
+
+#define JOURNAL_VERSION 1               ///< Wersja formatu dziennika.
+#define JOURNAL_BYTE_ORDER 0x01020304u  ///< Znacznik kolejności bajtów w pliku.
+#define JOURNAL_ADD 1                   ///< Rodzaj zapisu dodania przekierowania.
+#define JOURNAL_REMOVE 2                ///< Rodzaj zapisu usunięcia przekierowań.
+#define JOURNAL_VARINT_MAX 10           ///< Największa długość zapisu liczby.
+#define JOURNAL_FRAME_BYTES (1u << 20)  ///< Rozmiar grupy, po którym jest ona utrwalana.
+#define JOURNAL_PENDING_INITIAL 4096    ///< Początkowy rozmiar bufora grupy.
+
+/**
+ * To jest struktura nagłówka pliku dziennika.
+ */
+struct JournalHeader {
+    char magic[4];              ///< Znacznik formatu "PHWL".
+    uint32_t version;           ///< Wersja formatu.
+    uint32_t byte_order;        ///< Znacznik @ref JOURNAL_BYTE_ORDER.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct JournalHeader JournalHeader;
+
+/**
+ * To jest struktura nagłówka grupy zmian. Grupa jest zapisywana jednym
+ * wywołaniem pwrite, a suma kontrolna pozwala przy odtwarzaniu rozpoznać
+ * grupę zapisaną tylko częściowo.
+ */
+struct JournalFrame {
+    uint32_t size;              ///< Ilość bajtów zapisów grupy.
+    uint32_t checksum;          ///< Suma kontrolna FNV-1a zapisów grupy.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct JournalFrame JournalFrame;
+
+/**
+ * To jest struktura bufora grupy zmian. Bufor zaczyna się miejscem na
+ * nagłówek grupy, uzupełniany przy zapisie.
+ */
+struct JournalBuffer {
+    uint8_t* data;              ///< Nagłówek i zapisy grupy.
+    size_t size;                ///< Ilość zajętych bajtów bufora.
+    size_t cap;                 ///< Pojemność bufora.
+    size_t ops;                 ///< Ilość zmian w grupie.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct JournalBuffer JournalBuffer;
+
+/**
+ * To jest struktura dziennika. Zapis zmiany składa się z bajtu rodzaju,
+ * długości numerów zapisanych po 7 bitów w bajcie i cyfr numerów po dwie w
+ * bajcie. Pełna grupa jest przekazywana wątkowi utrwalającemu, a kolejne
+ * zmiany trafiają w tym czasie do drugiego bufora, więc wołający nie czeka
+ * na fdatasync. Dopóki wątek utrwala grupę, pola @p size i @p flushing należą
+ * do niego.
+ */
+struct PhoneForwardJournal {
+    PhoneForward* pf;           ///< Struktura, której zmiany są zapisywane.
+    char* checkpoint;           ///< Ścieżka do pliku punktu kontrolnego.
+    int fd;                     ///< Deskryptor pliku dziennika.
+    off_t size;                 ///< Długość pliku bez nieutrwalonych grup.
+    JournalBuffer pending;      ///< Bieżąca grupa.
+    JournalBuffer flushing;     ///< Grupa przekazana wątkowi utrwalającemu.
+    size_t group;               ///< Ilość zmian utrwalanych razem.
+    size_t checkpoint_bytes;    ///< Rozmiar dziennika wyzwalający punkt kontrolny lub 0.
+    pthread_mutex_t lock;       ///< Blokada stanu wątku utrwalającego.
+    pthread_cond_t changed;     ///< Zmiana stanu wątku utrwalającego.
+    pthread_t flusher;          ///< Wątek utrwalający.
+    bool due;                   ///< Czy dziennik przekroczył rozmiar @p checkpoint_bytes.
+    bool busy;                  ///< Czy wątek utrwala grupę @p flushing.
+    bool failed;                ///< Czy nie udało się utrwalić grupy @p flushing.
+    bool stop;                  ///< Czy wątek ma się zakończyć.
+};
+
+/**
+ * @brief Wyznacza sumę kontrolną FNV-1a.
+ * @param[in] data - wskaźnik na dane;
+ * @param[in] size - ilość bajtów danych.
+ * @return Suma kontrolna.
+ */
+static uint32_t journal_checksum(const uint8_t* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+/**
+ * @brief Zapisuje liczbę po 7 bitów w bajcie, od najmłodszych.
+ * @param[out] out - bufor na co najmniej @ref JOURNAL_VARINT_MAX bajtów;
+ * @param[in] value - zapisywana liczba.
+ * @return Wskaźnik na bajt za zapisem.
+ */
+static uint8_t * varint_put(uint8_t* out, size_t value) {
+    for (; value >= 0x80; value >>= 7)
+        *out++ = (uint8_t)(value | 0x80);
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+/**
+ * @brief Odczytuje liczbę zapisaną funkcją varint_put.
+ * @param[in] in - wskaźnik na zapis;
+ * @param[in] end - wskaźnik na koniec danych;
+ * @param[out] value - wskaźnik na odczytaną liczbę.
+ * @return Wskaźnik na bajt za zapisem lub NULL, jeśli zapis jest niepoprawny.
+ */
+static const uint8_t * varint_get(const uint8_t* in, const uint8_t* end, size_t* value) {
+    *value = 0;
+    for (unsigned shift = 0; in < end && shift < 7 * JOURNAL_VARINT_MAX; shift += 7) {
+        *value |= (size_t)(*in & 0x7f) << shift;
+        if (!(*in++ & 0x80))
+            return in;
+    }
+    return NULL;
+}
+
+/**
+ * Kody cyfr numeru: cyfrom '0'–'9' odpowiadają kody od 0 do 9, znakowi '*'
+ * kod 10, a znakowi '#' kod 11.
+ */
+static const uint8_t digit_codes[128] = {
+    ['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
+    ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+    ['*'] = 10, ['#'] = 11,
+};
+
+/**
+ * @brief Zapisuje cyfry numeru po dwie w bajcie.
+ * @param[out] out - bufor na (@p length + 1) / 2 bajtów;
+ * @param[in] num - numer;
+ * @param[in] length - długość numeru.
+ * @return Wskaźnik na bajt za zapisem.
+ */
+static uint8_t * pack_number(uint8_t* out, const char* num, size_t length) {
+    const unsigned char* digits = (const unsigned char*)num;
+    size_t i = 0;
+    for (; i + 1 < length; i += 2)
+        *out++ = (uint8_t)(digit_codes[digits[i]] << 4 | digit_codes[digits[i + 1]]);
+    if (i < length)
+        *out++ = (uint8_t)(digit_codes[digits[i]] << 4);
+    return out;
+}
+
+/**
+ * @brief Odczytuje numer zapisany funkcją pack_number.
+ * @param[in] in - wskaźnik na zapis o długości (@p length + 1) / 2 bajtów;
+ * @param[in] length - długość numeru;
+ * @param[out] out - bufor na @p length + 1 znaków.
+ * @return true - jeśli zapis zawiera tylko kody cyfr.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool unpack_number(const uint8_t* in, size_t length, char* out) {
+    static const char digits[] = "0123456789*#";
+    for (size_t i = 0; i < length; i++) {
+        uint8_t code = i % 2 == 0 ? in[i / 2] >> 4 : in[i / 2] & 0x0f;
+        if (code > 11)
+            return false;
+        out[i] = digits[code];
+    }
+    out[length] = '\0';
+    return true;
+}
+
+/**
+ * @brief Tworzy pusty bufor grupy.
+ * @param[out] buffer - wskaźnik na bufor.
+ * @return true - jeśli bufor został utworzony.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool buffer_init(JournalBuffer* buffer) {
+    buffer->data = malloc(JOURNAL_PENDING_INITIAL);
+    buffer->size = sizeof(JournalFrame);
+    buffer->cap = JOURNAL_PENDING_INITIAL;
+    buffer->ops = 0;
+    return buffer->data != NULL;
+}
+
+/**
+ * @brief Zapewnia w buforze bieżącej grupy miejsce na zapis zmiany.
+ * @param[in,out] pfj - wskaźnik na dziennik;
+ * @param[in] digits - łączna długość numerów zmiany.
+ * @return true - jeśli miejsce zostało zapewnione.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool journal_reserve(PhoneForwardJournal* pfj, size_t digits) {
+    JournalBuffer* pending = &pfj->pending;
+    size_t needed = pending->size + 1 + 2 * JOURNAL_VARINT_MAX + digits / 2 + 2;
+    if (needed <= pending->cap)
+        return true;
+    size_t cap = 2 * pending->cap > needed ? 2 * pending->cap : needed;
+    uint8_t* data = realloc(pending->data, cap);
+    if (data == NULL)
+        return false;
+    pending->data = data;
+    pending->cap = cap;
+    return true;
+}
+
+/**
+ * @brief Dopisuje zapis zmiany do bieżącej grupy.
+ * Miejsce musi zostać wcześniej zapewnione funkcją journal_reserve.
+ * @param[in,out] pfj - wskaźnik na dziennik;
+ * @param[in] kind - rodzaj zmiany;
+ * @param[in] num1 - prefiks numerów;
+ * @param[in] len1 - długość prefiksu @p num1;
+ * @param[in] num2 - prefiks docelowy dodania;
+ * @param[in] len2 - długość prefiksu @p num2 lub 0 przy usuwaniu.
+ */
+static void journal_record(PhoneForwardJournal* pfj, uint8_t kind, const char* num1,
+                           size_t len1, const char* num2, size_t len2) {
+    uint8_t* out = pfj->pending.data + pfj->pending.size;
+    *out++ = kind;
+    out = varint_put(out, len1);
+    if (kind == JOURNAL_ADD)
+        out = varint_put(out, len2);
+    out = pack_number(out, num1, len1);
+    if (kind == JOURNAL_ADD)
+        out = pack_number(out, num2, len2);
+    pfj->pending.size = (size_t)(out - pfj->pending.data);
+    pfj->pending.ops++;
+}
+
+/**
+ * @brief Zapisuje i utrwala grupę.
+ * Grupa jest zapisywana za ostatnią utrwaloną grupą, więc po błędzie może
+ * zostać zapisana ponownie w tym samym miejscu. Grupa zapisywana ponownie
+ * jest co najmniej tak długa jak poprzednio, więc nie zostają za nią resztki
+ * nieudanego zapisu.
+ * @param[in,out] pfj - wskaźnik na dziennik;
+ * @param[in,out] buffer - wskaźnik na bufor grupy, opróżniany po utrwaleniu.
+ * @return true - jeśli grupa została utrwalona lub była pusta.
+ * @return false - jeśli nie udało się zapisać dziennika.
+ */
+static bool journal_write(PhoneForwardJournal* pfj, JournalBuffer* buffer) {
+    if (buffer->ops == 0)
+        return true;
+    JournalFrame frame;
+    frame.size = (uint32_t)(buffer->size - sizeof(JournalFrame));
+    frame.checksum = journal_checksum(buffer->data + sizeof(JournalFrame), frame.size);
+    memcpy(buffer->data, &frame, sizeof(JournalFrame));
+
+    for (size_t written = 0; written < buffer->size;) {
+        ssize_t result = pwrite(pfj->fd, buffer->data + written, buffer->size - written,
+                                pfj->size + (off_t)written);
+        if (result <= 0)
+            return false;
+        written += (size_t)result;
+    }
+    if (fdatasync(pfj->fd) != 0)
+        return false;
+    pfj->size += (off_t)buffer->size;
+    buffer->size = sizeof(JournalFrame);
+    buffer->ops = 0;
+    return true;
+}
+
+/**
+ * @brief Utrwala przekazywane grupy.
+ * Funkcja wątku utrwalającego. Czeka na grupę przekazaną funkcją
+ * journal_commit, zapisuje ją i utrwala, a wynik zapamiętuje w polu
+ * @p failed.
+ * @param[in,out] arg - wskaźnik na dziennik.
+ * @return NULL.
+ */
+static void * journal_flusher(void* arg) {
+    PhoneForwardJournal* pfj = arg;
+    pthread_mutex_lock(&pfj->lock);
+    for (;;) {
+        while (!pfj->busy && !pfj->stop)
+            pthread_cond_wait(&pfj->changed, &pfj->lock);
+        if (!pfj->busy)
+            break;
+        pthread_mutex_unlock(&pfj->lock);
+        bool written = journal_write(pfj, &pfj->flushing);
+        pthread_mutex_lock(&pfj->lock);
+        pfj->failed = !written;
+        pfj->busy = false;
+        pthread_cond_broadcast(&pfj->changed);
+    }
+    pthread_mutex_unlock(&pfj->lock);
+    return NULL;
+}
+
+/**
+ * @brief Czeka na utrwalenie przekazanej grupy.
+ * Jeśli wątek utrwalający nie zdołał utrwalić grupy, zapisuje ją ponownie.
+ * Po powrocie wątek utrwalający nie korzysta z dziennika.
+ * @param[in,out] pfj - wskaźnik na dziennik.
+ * @return true - jeśli wszystkie przekazane grupy są utrwalone.
+ * @return false - jeśli nie udało się zapisać dziennika.
+ */
+static bool journal_wait(PhoneForwardJournal* pfj) {
+    pthread_mutex_lock(&pfj->lock);
+    while (pfj->busy)
+        pthread_cond_wait(&pfj->changed, &pfj->lock);
+    bool failed = pfj->failed;
+    pthread_mutex_unlock(&pfj->lock);
+    if (failed)
+        pfj->failed = !journal_write(pfj, &pfj->flushing);
+    return !pfj->failed;
+}
+
+/**
+ * @brief Kończy zmianę zapisaną w bieżącej grupie.
+ * Przekazuje pełną grupę wątkowi utrwalającemu, gdy ten utrwali poprzednią,
+ * i zaznacza, czy dziennik przekroczył zadany rozmiar. Punkt kontrolny nie
+ * jest tu zapisywany, bo zapis wszystkich przekierowań trwałby proporcjonalnie
+ * do rozmiaru struktury.
+ * @param[in,out] pfj - wskaźnik na dziennik.
+ * @return true - jeśli nie wystąpił błąd zapisu.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool journal_commit(PhoneForwardJournal* pfj) {
+    if (pfj->pending.ops < pfj->group && pfj->pending.size < JOURNAL_FRAME_BYTES)
+        return true;
+    if (!journal_wait(pfj))
+        return false;
+    pfj->due = pfj->checkpoint_bytes > 0 && (size_t)pfj->size > pfj->checkpoint_bytes;
+
+    JournalBuffer filled = pfj->pending;
+    pfj->pending = pfj->flushing;
+    pthread_mutex_lock(&pfj->lock);
+    pfj->flushing = filled;
+    pfj->busy = true;
+    pthread_cond_broadcast(&pfj->changed);
+    pthread_mutex_unlock(&pfj->lock);
+    return true;
+}
+
+/**
+ * @brief Odczytuje zmiany z bufora grupy do transakcji.
+ * @param[in,out] txn - wskaźnik na transakcję;
+ * @param[in] in - wskaźnik na zapisy grupy;
+ * @param[in] end - wskaźnik na koniec zapisów grupy;
+ * @param[in,out] number - wskaźnik na bufor na numery;
+ * @param[in,out] number_cap - wskaźnik na rozmiar bufora na numery.
+ * @return true - jeśli wszystkie zapisy są poprawne i zostały zapamiętane.
+ * @return false - jeśli zapis jest niepoprawny lub nie udało się alokować
+ * pamięci.
+ */
+static bool journal_replay_frame(PhoneForwardTxn* txn, const uint8_t* in, const uint8_t* end,
+                                 char** number, size_t* number_cap) {
+    while (in < end) {
+        uint8_t kind = *in++;
+        size_t len1, len2 = 0;
+        if ((kind != JOURNAL_ADD && kind != JOURNAL_REMOVE)
+            || (in = varint_get(in, end, &len1)) == NULL
+            || (kind == JOURNAL_ADD && (in = varint_get(in, end, &len2)) == NULL)
+            || len1 / 2 > (size_t)(end - in) || len2 / 2 > (size_t)(end - in)
+            || (len1 + 1) / 2 + (len2 + 1) / 2 > (size_t)(end - in))
+            return false;
+
+        if (len1 + len2 + 2 > *number_cap) {
+            char* grown = realloc(*number, len1 + len2 + 2);
+            if (grown == NULL)
+                return false;
+            *number = grown;
+            *number_cap = len1 + len2 + 2;
+        }
+        char* num1 = *number;
+        char* num2 = *number + len1 + 1;
+        if (!unpack_number(in, len1, num1))
+            return false;
+        in += (len1 + 1) / 2;
+        if (kind == JOURNAL_REMOVE) {
+            if (!phfwdTxnRemove(txn, num1))
+                return false;
+            continue;
+        }
+        if (!unpack_number(in, len2, num2) || !phfwdTxnAdd(txn, num1, num2))
+            return false;
+        in += (len2 + 1) / 2;
+    }
+    return true;
+}
+
+/**
+ * @brief Sprawdza, czy niepoprawna grupa jest niepełną końcówką dziennika.
+ * Każda grupa jest utrwalana przed zapisem następnej, więc po awarii
+ * niepoprawna może być tylko ostatnia grupa. Sięga ona wtedy do końca pliku
+ * lub za niego, albo pozostała po niej część pliku zawiera same zera, gdy
+ * system plików utrwalił już długość pliku, ale nie jego zawartość.
+ * @param[in] data - zawartość pliku;
+ * @param[in] offset - pozycja niepoprawnej grupy;
+ * @param[in] size - długość pliku.
+ * @return true - jeśli za grupą nie ma w pliku dalszych zapisów.
+ * @return false - jeśli grupa jest uszkodzona w środku dziennika.
+ */
+static bool journal_torn(const uint8_t* data, size_t offset, size_t size) {
+    JournalFrame frame;
+    if (size - offset < sizeof(JournalFrame))
+        return true;
+    memcpy(&frame, data + offset, sizeof(JournalFrame));
+    if (frame.size >= size - offset - sizeof(JournalFrame))
+        return true;
+    while (offset < size && data[offset] == 0)
+        offset++;
+    return offset == size;
+}
+
+/**
+ * @brief Odtwarza zmiany zapisane w dzienniku.
+ * Tworzy nagłówek pustego dziennika, a w pozostałym przypadku wykonuje
+ * zmiany kolejnych poprawnych grup jedną transakcją i obcina niepełną
+ * końcówkę za ostatnią z nich. Wykonanie dziennika na punkcie kontrolnym
+ * zapisanym już po części jego zmian daje ten sam wynik, bo przekierowanie
+ * każdego prefiksu zależy tylko od ostatniej dotyczącej go zmiany.
+ * @param[in,out] pfj - wskaźnik na dziennik z otwartym plikiem.
+ * @return true - jeśli zmiany zostały odtworzone.
+ * @return false - jeśli plik ma inny format, jest uszkodzony przed końcówką,
+ * nie udało się go odczytać lub zapisać, bądź nie udało się alokować pamięci.
+ * Plik pozostaje wtedy niezmieniony.
+ */
+static bool journal_replay(PhoneForwardJournal* pfj) {
+    JournalHeader header;
+    memcpy(header.magic, "PHWL", 4);
+    header.version = JOURNAL_VERSION;
+    header.byte_order = JOURNAL_BYTE_ORDER;
+
+    struct stat st;
+    if (fstat(pfj->fd, &st) != 0)
+        return false;
+    // Nagłówek zapisany tylko częściowo oznacza dziennik bez zmian.
+    if ((size_t)st.st_size < sizeof(JournalHeader)) {
+        pfj->size = sizeof(JournalHeader);
+        return ftruncate(pfj->fd, 0) == 0
+               && pwrite(pfj->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)
+               && fdatasync(pfj->fd) == 0;
+    }
+
+    size_t size = (size_t)st.st_size;
+    uint8_t* data = malloc(size);
+    bool result = data != NULL;
+    for (size_t done = 0; result && done < size;) {
+        ssize_t got = pread(pfj->fd, data + done, size - done, (off_t)done);
+        result = got > 0;
+        done += result ? (size_t)got : 0;
+    }
+    result = result && memcmp(data, &header, sizeof(header)) == 0;
+
+    PhoneForwardTxn* txn = result ? phfwdTxnBegin(pfj->pf) : NULL;
+    result = txn != NULL;
+    char* number = NULL;
+    size_t number_cap = 0, offset = sizeof(JournalHeader);
+    while (result && offset < size) {
+        JournalFrame frame;
+        const uint8_t* payload = data + offset + sizeof(JournalFrame);
+        if (size - offset >= sizeof(JournalFrame))
+            memcpy(&frame, data + offset, sizeof(JournalFrame));
+        if (size - offset < sizeof(JournalFrame)
+            || frame.size > size - offset - sizeof(JournalFrame)
+            || journal_checksum(payload, frame.size) != frame.checksum) {
+            result = journal_torn(data, offset, size);
+            break;
+        }
+        result = journal_replay_frame(txn, payload, payload + frame.size, &number, &number_cap);
+        offset += sizeof(JournalFrame) + frame.size;
+    }
+    free(number);
+    free(data);
+    result = result && phfwdTxnCommit(txn);
+    if (!result)
+        phfwdTxnAbort(txn);
+    if (result && offset < size)
+        result = ftruncate(pfj->fd, (off_t)offset) == 0 && fdatasync(pfj->fd) == 0;
+    pfj->size = (off_t)offset;
+    return result;
+}
+
+/** @brief Odtwarza przekierowania i otwiera dziennik.
+ * Ładuje do struktury @p pf przekierowania z punktu kontrolnego
+ * @p checkpoint, jeśli taki plik istnieje, a następnie wykonuje zmiany
+ * zapisane w dzienniku @p journal jedną transakcją. Niepełna końcówka
+ * dziennika, pozostała po awarii w trakcie zapisu ostatniej grupy, jest
+ * pomijana i obcinana. Uszkodzona grupa, za którą w pliku są dalsze zapisy,
+ * jest błędem, a plik pozostaje wtedy niezmieniony. Nieistniejący dziennik
+ * jest tworzony. Kolejne zmiany wykonywane funkcjami @ref phfwdJournalAdd i
+ * @ref phfwdJournalRemove są dopisywane do dziennika grupami po @p group
+ * zmian. Pełną grupę zapisuje i utrwala jednym wywołaniem fdatasync wątek
+ * działający w tle, a zmiany trafiają w tym czasie do następnej grupy, więc
+ * po awarii mogą zostać utracone zmiany co najwyżej dwóch ostatnich grup.
+ * Gdy dziennik przekroczy @p checkpoint_bytes bajtów, funkcja
+ * @ref phfwdJournalCheckpointDue zwraca @p true, a punkt kontrolny zapisuje
+ * wołający funkcją @ref phfwdJournalCheckpoint.
+ * @param[in,out] pf           – wskaźnik na strukturę, zwykle pustą, która
+ *                               musi istnieć aż do zamknięcia dziennika;
+ * @param[in] checkpoint       – ścieżka do pliku punktu kontrolnego;
+ * @param[in] journal          – ścieżka do pliku dziennika;
+ * @param[in] group            – ilość zmian utrwalanych razem, co najmniej 1;
+ * @param[in] checkpoint_bytes – rozmiar dziennika, po którego przekroczeniu
+ *                               należy zapisać punkt kontrolny, lub 0.
+ * @return Wskaźnik na otwarty dziennik lub NULL, gdy któryś ze wskaźników ma
+ *         wartość NULL, @p group ma wartość 0, nie udało się odczytać punktu
+ *         kontrolnego, plik dziennika ma inny format lub jest uszkodzony
+ *         przed końcówką, bądź nie udało się alokować pamięci. Jeśli punkt
+ *         kontrolny został już wczytany, jego przekierowania pozostają wtedy
+ *         w strukturze @p pf, a zmiany z dziennika nie są wykonywane.
+ */
+PhoneForwardJournal * phfwdJournalOpen(PhoneForward *pf, char const *checkpoint,
+                                       char const *journal, size_t group,
+                                       size_t checkpoint_bytes) {
+    if (pf == NULL || checkpoint == NULL || journal == NULL || group == 0)
+        return NULL;
+    if (access(checkpoint, F_OK) == 0 && !phfwdLoadFile(pf, checkpoint))
+        return NULL;
+    PhoneForwardJournal* pfj = malloc(sizeof(PhoneForwardJournal));
+    if (pfj == NULL)
+        return NULL;
+    pfj->pf = pf;
+    pfj->checkpoint = malloc(strlen(checkpoint) + 1);
+    bool buffers = buffer_init(&pfj->pending);
+    buffers = buffer_init(&pfj->flushing) && buffers;
+    pfj->group = group;
+    pfj->checkpoint_bytes = checkpoint_bytes;
+    pfj->due = pfj->busy = pfj->failed = pfj->stop = false;
+    pfj->fd = open(journal, O_RDWR | O_CREAT, 0644);
+    bool locks = pthread_mutex_init(&pfj->lock, NULL) == 0;
+    bool conds = pthread_cond_init(&pfj->changed, NULL) == 0;
+    if (pfj->checkpoint == NULL || !buffers || pfj->fd < 0 || !locks || !conds
+        || !journal_replay(pfj)
+        || pthread_create(&pfj->flusher, NULL, journal_flusher, pfj) != 0) {
+        if (pfj->fd >= 0)
+            close(pfj->fd);
+        if (locks)
+            pthread_mutex_destroy(&pfj->lock);
+        if (conds)
+            pthread_cond_destroy(&pfj->changed);
+        free(pfj->checkpoint);
+        free(pfj->pending.data);
+        free(pfj->flushing.data);
+        free(pfj);
+        return NULL;
+    }
+    strcpy(pfj->checkpoint, checkpoint);
+    return pfj;
+}
+
+/** @brief Zamyka dziennik.
+ * Utrwala zmiany czekających grup, kończy wątek utrwalający i zamyka
+ * dziennik. Nie usuwa struktury przekierowań. Nic nie robi, jeśli wskaźnik
+ * ma wartość NULL.
+ * @param[in] pfj – wskaźnik na zamykany dziennik.
+ * @return Wartość @p true, jeśli wszystkie zmiany zostały utrwalone lub
+ *         @p pfj ma wartość NULL. Wartość @p false, jeśli nie udało się
+ *         zapisać dziennika.
+ */
+bool phfwdJournalClose(PhoneForwardJournal *pfj) {
+    if (pfj == NULL)
+        return true;
+    bool result = phfwdJournalSync(pfj);
+    pthread_mutex_lock(&pfj->lock);
+    pfj->stop = true;
+    pthread_cond_broadcast(&pfj->changed);
+    pthread_mutex_unlock(&pfj->lock);
+    pthread_join(pfj->flusher, NULL);
+    pthread_mutex_destroy(&pfj->lock);
+    pthread_cond_destroy(&pfj->changed);
+    result = close(pfj->fd) == 0 && result;
+    free(pfj->checkpoint);
+    free(pfj->pending.data);
+    free(pfj->flushing.data);
+    free(pfj);
+    return result;
+}
+
+/** @brief Dodaje przekierowanie i zapisuje je w dzienniku.
+ * Działa tak jak funkcja @ref phfwdAdd. Dodane przekierowanie jest dopisywane
+ * do bieżącej grupy zmian, a pełna grupa jest przekazywana do utrwalenia w
+ * tle, gdy zostanie utrwalona poprzednia. Do dziennika trafiają tylko udane
+ * zmiany.
+ * @param[in,out] pfj – wskaźnik na dziennik;
+ * @param[in] num1    – wskaźnik na napis reprezentujący prefiks numerów
+ *                      przekierowywanych;
+ * @param[in] num2    – wskaźnik na napis reprezentujący prefiks numerów,
+ *                      na które jest wykonywane przekierowanie.
+ * @return Wartość @p true, jeśli przekierowanie zostało dodane i zapisane.
+ *         Wartość @p false, jeśli przekierowanie nie zostało dodane, tak jak
+ *         w funkcji @ref phfwdAdd, lub nie udało się alokować pamięci na jego
+ *         zapis. Wartość @p false jest też zwracana, gdy przekierowanie
+ *         zostało dodane, ale nie udało się utrwalić poprzedniej grupy;
+ *         grupa jest wtedy zapisywana ponownie przy następnej zmianie lub
+ *         synchronizacji.
+ */
+bool phfwdJournalAdd(PhoneForwardJournal *pfj, char const *num1, char const *num2) {
+    if (pfj == NULL || num1 == NULL || num2 == NULL)
+        return false;
+    size_t len1 = digits_scan(num1, NULL, 0), len2 = digits_scan(num2, NULL, 0);
+    // Miejsce na zapis jest zapewniane przed zmianą, której nie można cofnąć.
+    if (!journal_reserve(pfj, len1 + len2) || !phfwdAdd(pfj->pf, num1, num2))
+        return false;
+    journal_record(pfj, JOURNAL_ADD, num1, len1, num2, len2);
+    return journal_commit(pfj);
+}
+
+/** @brief Usuwa przekierowania i zapisuje zmianę w dzienniku.
+ * Działa tak jak funkcja @ref phfwdRemove. Jeśli napis nie reprezentuje
+ * numeru, nic nie robi i niczego nie zapisuje.
+ * @param[in,out] pfj – wskaźnik na dziennik;
+ * @param[in] num     – wskaźnik na napis reprezentujący prefiks numerów.
+ * @return Wartość @p true, jeśli zmiana została wykonana i zapisana lub napis
+ *         nie reprezentuje numeru. Wartość @p false, jeśli @p pfj ma wartość
+ *         NULL, zmiana nie została wykonana, tak jak w funkcji
+ *         @ref phfwdRemove, nie udało się alokować pamięci na jej zapis, lub
+ *         nie udało się utrwalić grupy, tak jak w funkcji
+ *         @ref phfwdJournalAdd.
+ */
+bool phfwdJournalRemove(PhoneForwardJournal *pfj, char const *num) {
+    if (pfj == NULL)
+        return false;
+    size_t length = num == NULL ? 0 : digits_scan(num, NULL, 0);
+    if (length == 0 || num[length] != '\0')
+        return true;
+    if (!journal_reserve(pfj, length) || !phfwdRemove(pfj->pf, num))
+        return false;
+    journal_record(pfj, JOURNAL_REMOVE, num, length, NULL, 0);
+    return journal_commit(pfj);
+}
+
+/** @brief Utrwala zmiany czekających grup.
+ * Czeka na utrwalenie grupy przekazanej do utrwalenia w tle, a następnie
+ * zapisuje i utrwala zmiany bieżącej grupy, niezależnie od jej rozmiaru. Po
+ * udanym wywołaniu wszystkie wcześniejsze zmiany zostaną odtworzone po
+ * awarii.
+ * @param[in,out] pfj – wskaźnik na dziennik.
+ * @return Wartość @p true, jeśli zmiany zostały utrwalone.
+ *         Wartość @p false, jeśli @p pfj ma wartość NULL lub nie udało się
+ *         zapisać dziennika.
+ */
+bool phfwdJournalSync(PhoneForwardJournal *pfj) {
+    return pfj != NULL && journal_wait(pfj) && journal_write(pfj, &pfj->pending);
+}
+
+/**
+ * @brief Utrwala zmianę zawartości katalogu zawierającego plik.
+ * @param[in] path - ścieżka do pliku.
+ * @return true - jeśli katalog został utrwalony.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool sync_directory(const char* path) {
+    const char* slash = strrchr(path, '/');
+    size_t length = slash == NULL ? 1 : slash == path ? 1 : (size_t)(slash - path);
+    char* directory = malloc(length + 1);
+    if (directory == NULL)
+        return false;
+    memcpy(directory, slash == NULL ? "." : path, length);
+    directory[length] = '\0';
+    int fd = open(directory, O_RDONLY);
+    free(directory);
+    if (fd < 0)
+        return false;
+    bool result = fsync(fd) == 0;
+    return close(fd) == 0 && result;
+}
+
+/** @brief Zapisuje punkt kontrolny.
+ * Utrwala zmiany czekających grup, zapisuje wszystkie przekierowania struktury
+ * funkcją @ref phfwdSaveFile do pliku punktu kontrolnego i skraca dziennik.
+ * Dziennik jest skracany dopiero po utrwaleniu punktu kontrolnego, więc po
+ * awarii w trakcie zapisu punktu kontrolnego przekierowania są odtwarzane z
+ * poprzedniego punktu kontrolnego i pełnego dziennika. Zapis trwa
+ * proporcjonalnie do rozmiaru struktury, a struktura nie może być w tym
+ * czasie zmieniana.
+ * @param[in,out] pfj – wskaźnik na dziennik.
+ * @return Wartość @p true, jeśli punkt kontrolny został zapisany.
+ *         Wartość @p false, jeśli @p pfj ma wartość NULL lub nie udało się
+ *         zapisać punktu kontrolnego bądź dziennika.
+ */
+bool phfwdJournalCheckpoint(PhoneForwardJournal *pfj) {
+    if (!phfwdJournalSync(pfj)
+        || !phfwdSaveFile(pfj->pf, pfj->checkpoint) || !sync_directory(pfj->checkpoint))
+        return false;
+    if (ftruncate(pfj->fd, sizeof(JournalHeader)) != 0 || fdatasync(pfj->fd) != 0)
+        return false;
+    pfj->size = sizeof(JournalHeader);
+    pfj->due = false;
+    return true;
+}
+
+/** @brief Sprawdza, czy należy zapisać punkt kontrolny.
+ * Dziennik nie zapisuje punktów kontrolnych sam, bo zapis wszystkich
+ * przekierowań wstrzymałby zmianę, która przekroczyła zadany rozmiar, na czas
+ * proporcjonalny do rozmiaru struktury. Wołający wywołuje wtedy funkcję
+ * @ref phfwdJournalCheckpoint w wybranej przez siebie chwili.
+ * @param[in] pfj – wskaźnik na dziennik.
+ * @return Wartość @p true, jeśli dziennik przekroczył rozmiar
+ *         @p checkpoint_bytes podany przy otwarciu. Wartość @p false, jeśli
+ *         nie przekroczył, rozmiar ten ma wartość 0 lub @p pfj ma wartość
+ *         NULL.
+ */
+bool phfwdJournalCheckpointDue(PhoneForwardJournal const *pfj) {
+    return pfj != NULL && pfj->due;
+}
@@ -0,0 +1,145 @@
+/** @file
+ * Interfejs dziennika zmian przekierowań z punktami kontrolnymi.
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef __PHONE_FORWARD_JOURNAL_H__
+#define __PHONE_FORWARD_JOURNAL_H__
+
+#include <stddef.h>
+
+#include "phone_forward.h"
+
+/**
+ * To jest struktura zapisująca zmiany przekierowań w dzienniku, z którego
+ * można odtworzyć przekierowania po awarii.
+ */
+struct PhoneForwardJournal;
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct PhoneForwardJournal PhoneForwardJournal;
+
+/** @brief Odtwarza przekierowania i otwiera dziennik.
+ * Ładuje do struktury @p pf przekierowania z punktu kontrolnego
+ * @p checkpoint, jeśli taki plik istnieje, a następnie wykonuje zmiany
+ * zapisane w dzienniku @p journal jedną transakcją. Niepełna końcówka
+ * dziennika, pozostała po awarii w trakcie zapisu ostatniej grupy, jest
+ * pomijana i obcinana. Uszkodzona grupa, za którą w pliku są dalsze zapisy,
+ * jest błędem, a plik pozostaje wtedy niezmieniony. Nieistniejący dziennik
+ * jest tworzony. Kolejne zmiany wykonywane funkcjami @ref phfwdJournalAdd i
+ * @ref phfwdJournalRemove są dopisywane do dziennika grupami po @p group
+ * zmian. Pełną grupę zapisuje i utrwala jednym wywołaniem fdatasync wątek
+ * działający w tle, a zmiany trafiają w tym czasie do następnej grupy, więc
+ * po awarii mogą zostać utracone zmiany co najwyżej dwóch ostatnich grup.
+ * Gdy dziennik przekroczy @p checkpoint_bytes bajtów, funkcja
+ * @ref phfwdJournalCheckpointDue zwraca @p true, a punkt kontrolny zapisuje
+ * wołający funkcją @ref phfwdJournalCheckpoint.
+ * @param[in,out] pf           – wskaźnik na strukturę, zwykle pustą, która
+ *                               musi istnieć aż do zamknięcia dziennika;
+ * @param[in] checkpoint       – ścieżka do pliku punktu kontrolnego;
+ * @param[in] journal          – ścieżka do pliku dziennika;
+ * @param[in] group            – ilość zmian utrwalanych razem, co najmniej 1;
+ * @param[in] checkpoint_bytes – rozmiar dziennika, po którego przekroczeniu
+ *                               należy zapisać punkt kontrolny, lub 0.
+ * @return Wskaźnik na otwarty dziennik lub NULL, gdy któryś ze wskaźników ma
+ *         wartość NULL, @p group ma wartość 0, nie udało się odczytać punktu
+ *         kontrolnego, plik dziennika ma inny format lub jest uszkodzony
+ *         przed końcówką, bądź nie udało się alokować pamięci. Jeśli punkt
+ *         kontrolny został już wczytany, jego przekierowania pozostają wtedy
+ *         w strukturze @p pf, a zmiany z dziennika nie są wykonywane.
+ */
+PhoneForwardJournal * phfwdJournalOpen(PhoneForward *pf, char const *checkpoint,
+                                       char const *journal, size_t group,
+                                       size_t checkpoint_bytes);
+
+/** @brief Zamyka dziennik.
+ * Utrwala zmiany czekających grup, kończy wątek utrwalający i zamyka
+ * dziennik. Nie usuwa struktury przekierowań. Nic nie robi, jeśli wskaźnik
+ * ma wartość NULL.
+ * @param[in] pfj – wskaźnik na zamykany dziennik.
+ * @return Wartość @p true, jeśli wszystkie zmiany zostały utrwalone lub
+ *         @p pfj ma wartość NULL. Wartość @p false, jeśli nie udało się
+ *         zapisać dziennika.
+ */
+bool phfwdJournalClose(PhoneForwardJournal *pfj);
+
+/** @brief Dodaje przekierowanie i zapisuje je w dzienniku.
+ * Działa tak jak funkcja @ref phfwdAdd. Dodane przekierowanie jest dopisywane
+ * do bieżącej grupy zmian, a pełna grupa jest przekazywana do utrwalenia w
+ * tle, gdy zostanie utrwalona poprzednia. Do dziennika trafiają tylko udane
+ * zmiany.
+ * @param[in,out] pfj – wskaźnik na dziennik;
+ * @param[in] num1    – wskaźnik na napis reprezentujący prefiks numerów
+ *                      przekierowywanych;
+ * @param[in] num2    – wskaźnik na napis reprezentujący prefiks numerów,
+ *                      na które jest wykonywane przekierowanie.
+ * @return Wartość @p true, jeśli przekierowanie zostało dodane i zapisane.
+ *         Wartość @p false, jeśli przekierowanie nie zostało dodane, tak jak
+ *         w funkcji @ref phfwdAdd, lub nie udało się alokować pamięci na jego
+ *         zapis. Wartość @p false jest też zwracana, gdy przekierowanie
+ *         zostało dodane, ale nie udało się utrwalić poprzedniej grupy;
+ *         grupa jest wtedy zapisywana ponownie przy następnej zmianie lub
+ *         synchronizacji.
+ */
+bool phfwdJournalAdd(PhoneForwardJournal *pfj, char const *num1, char const *num2);
+
+/** @brief Usuwa przekierowania i zapisuje zmianę w dzienniku.
+ * Działa tak jak funkcja @ref phfwdRemove. Jeśli napis nie reprezentuje
+ * numeru, nic nie robi i niczego nie zapisuje.
+ * @param[in,out] pfj – wskaźnik na dziennik;
+ * @param[in] num     – wskaźnik na napis reprezentujący prefiks numerów.
+ * @return Wartość @p true, jeśli zmiana została wykonana i zapisana lub napis
+ *         nie reprezentuje numeru. Wartość @p false, jeśli @p pfj ma wartość
+ *         NULL, zmiana nie została wykonana, tak jak w funkcji
+ *         @ref phfwdRemove, nie udało się alokować pamięci na jej zapis, lub
+ *         nie udało się utrwalić grupy, tak jak w funkcji
+ *         @ref phfwdJournalAdd.
+ */
+bool phfwdJournalRemove(PhoneForwardJournal *pfj, char const *num);
+
+/** @brief Utrwala zmiany czekających grup.
+ * Czeka na utrwalenie grupy przekazanej do utrwalenia w tle, a następnie
+ * zapisuje i utrwala zmiany bieżącej grupy, niezależnie od jej rozmiaru. Po
+ * udanym wywołaniu wszystkie wcześniejsze zmiany zostaną odtworzone po
+ * awarii.
+ * @param[in,out] pfj – wskaźnik na dziennik.
+ * @return Wartość @p true, jeśli zmiany zostały utrwalone.
+ *         Wartość @p false, jeśli @p pfj ma wartość NULL lub nie udało się
+ *         zapisać dziennika.
+ */
+bool phfwdJournalSync(PhoneForwardJournal *pfj);
+
+/** @brief Zapisuje punkt kontrolny.
+ * Utrwala zmiany czekających grup, zapisuje wszystkie przekierowania struktury
+ * funkcją @ref phfwdSaveFile do pliku punktu kontrolnego i skraca dziennik.
+ * Dziennik jest skracany dopiero po utrwaleniu punktu kontrolnego, więc po
+ * awarii w trakcie zapisu punktu kontrolnego przekierowania są odtwarzane z
+ * poprzedniego punktu kontrolnego i pełnego dziennika. Zapis trwa
+ * proporcjonalnie do rozmiaru struktury, a struktura nie może być w tym
+ * czasie zmieniana.
+ * @param[in,out] pfj – wskaźnik na dziennik.
+ * @return Wartość @p true, jeśli punkt kontrolny został zapisany.
+ *         Wartość @p false, jeśli @p pfj ma wartość NULL lub nie udało się
+ *         zapisać punktu kontrolnego bądź dziennika.
+ */
+bool phfwdJournalCheckpoint(PhoneForwardJournal *pfj);
+
+/** @brief Sprawdza, czy należy zapisać punkt kontrolny.
+ * Dziennik nie zapisuje punktów kontrolnych sam, bo zapis wszystkich
+ * przekierowań wstrzymałby zmianę, która przekroczyła zadany rozmiar, na czas
+ * proporcjonalny do rozmiaru struktury. Wołający wywołuje wtedy funkcję
+ * @ref phfwdJournalCheckpoint w wybranej przez siebie chwili.
+ * @param[in] pfj – wskaźnik na dziennik.
+ * @return Wartość @p true, jeśli dziennik przekroczył rozmiar
+ *         @p checkpoint_bytes podany przy otwarciu. Wartość @p false, jeśli
+ *         nie przekroczył, rozmiar ten ma wartość 0 lub @p pfj ma wartość
+ *         NULL.
+ */
+bool phfwdJournalCheckpointDue(PhoneForwardJournal const *pfj);
+
+#endif /* __PHONE_FORWARD_JOURNAL_H__ */
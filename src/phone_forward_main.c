@@ -0,0 +1,396 @@
+/** @file
+ * Program obsługujący przekierowania numerów telefonów poleceniami ze
+ * strumienia wejściowego.
+ *
+ * Program wczytuje polecenia ze standardowego wejścia lub z pliku podanego
+ * jako argument, po jednym w wierszu:
+ * - `add NUM1 NUM2` – dodaje przekierowanie;
+ * - `remove NUM` – usuwa przekierowania o prefiksie @p NUM;
+ * - `get NUM` – wypisuje przekierowanie numeru;
+ * - `reverse NUM` – wypisuje numery, które mogą być przekierowane na @p NUM;
+ * - `getreverse NUM` – wypisuje numery przekierowywane na @p NUM.
+ *
+ * Wyniki poleceń `get`, `reverse` i `getreverse` są wypisywane na standardowe
+ * wyjście w jednym wierszu, rozdzielone spacjami. Puste wiersze są pomijane.
+ * Dla niepoprawnego polecenia na standardowe wyjście błędów wypisywany jest
+ * komunikat z numerem wiersza, a program kontynuuje działanie i kończy się
+ * kodem 1. Opcja `-l PLIK` ładuje przed wykonaniem poleceń przekierowania z
+ * pliku w formacie funkcji @ref phfwdLoadFile. Opcja `-j PLIK` odtwarza
+ * przekierowania z dziennika i jego punktu kontrolnego `PLIK.ckpt`, a zmiany
+ * poleceń `add` i `remove` zapisuje w dzienniku, utrwalając je grupami.
+ *
+ * Wejście jest czytane dużymi blokami do jednego bufora, a wiersze są
+ * przetwarzane w miejscu, bez alokowania pamięci dla każdego z nich. Wyjście
+ * jest gromadzone w buforze i wypisywane dużymi blokami.
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "phone_forward.h"
+#include "phone_forward_journal.h"
+
+#define INPUT_BUFFER_SIZE (1 << 20)     ///< Początkowy rozmiar bufora wejścia.
+#define OUTPUT_BUFFER_SIZE (1 << 20)    ///< Rozmiar bufora wyjścia.
+#define NUMBER_BUFFER_SIZE 256          ///< Rozmiar bufora na wynik polecenia get.
+#define MAX_WORDS 3                     ///< Największa ilość słów polecenia.
+#define JOURNAL_GROUP 4096              ///< Ilość zmian utrwalanych razem w dzienniku.
+#define JOURNAL_CHECKPOINT (64 << 20)   ///< Rozmiar dziennika, po którym jest zapisywany punkt kontrolny.
+#define CHECKPOINT_SUFFIX ".ckpt"       ///< Przyrostek ścieżki punktu kontrolnego.
+
+/**
+ * To jest struktura czytająca wiersze ze strumienia.
+ */
+struct LineReader {
+    FILE* file;             ///< Czytany strumień.
+    char* buffer;           ///< Bufor z wczytaną częścią strumienia.
+    size_t capacity;        ///< Rozmiar bufora.
+    size_t start;           ///< Początek nieprzetworzonej części bufora.
+    size_t end;             ///< Koniec wczytanej części bufora.
+    bool eof;               ///< Czy strumień został przeczytany do końca.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct LineReader LineReader;
+
+/**
+ * To jest struktura gromadząca wyjście programu.
+ */
+struct OutputBuffer {
+    char buffer[OUTPUT_BUFFER_SIZE];    ///< Bufor z niewypisanymi danymi.
+    size_t size;                        ///< Ilość niewypisanych bajtów.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct OutputBuffer OutputBuffer;
+
+/**
+ * @brief Wypisuje zawartość bufora wyjścia.
+ * @param[in,out] out - wskaźnik na bufor wyjścia.
+ */
+static void output_flush(OutputBuffer* out) {
+    fwrite(out->buffer, 1, out->size, stdout);
+    out->size = 0;
+}
+
+/**
+ * @brief Dopisuje napis do bufora wyjścia.
+ * Wypisuje bufor, gdy brakuje w nim miejsca. Napisy dłuższe od bufora są
+ * wypisywane bezpośrednio.
+ * @param[in,out] out - wskaźnik na bufor wyjścia;
+ * @param[in] str - dopisywany napis;
+ * @param[in] length - długość napisu.
+ */
+static void output_write(OutputBuffer* out, const char* str, size_t length) {
+    if (out->size + length > OUTPUT_BUFFER_SIZE) {
+        output_flush(out);
+        if (length > OUTPUT_BUFFER_SIZE) {
+            fwrite(str, 1, length, stdout);
+            return;
+        }
+    }
+    memcpy(out->buffer + out->size, str, length);
+    out->size += length;
+}
+
+/**
+ * @brief Dopisuje znak do bufora wyjścia.
+ * @param[in,out] out - wskaźnik na bufor wyjścia;
+ * @param[in] c - dopisywany znak.
+ */
+static void output_char(OutputBuffer* out, char c) {
+    if (out->size == OUTPUT_BUFFER_SIZE)
+        output_flush(out);
+    out->buffer[out->size++] = c;
+}
+
+/**
+ * @brief Inicjalizuje czytanie wierszy ze strumienia.
+ * @param[out] reader - wskaźnik na inicjalizowaną strukturę;
+ * @param[in] file - czytany strumień.
+ * @return true - jeśli udało się alokować bufor.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool reader_init(LineReader* reader, FILE* file) {
+    reader->file = file;
+    reader->buffer = malloc(INPUT_BUFFER_SIZE);
+    reader->capacity = INPUT_BUFFER_SIZE;
+    reader->start = 0;
+    reader->end = 0;
+    reader->eof = false;
+    return reader->buffer != NULL;
+}
+
+/**
+ * @brief Wczytuje kolejną część strumienia.
+ * Przesuwa nieprzetworzoną część na początek bufora i dopełnia bufor danymi
+ * ze strumienia. Jeśli cały bufor zajmuje jeden wiersz, bufor jest
+ * powiększany dwukrotnie.
+ * @param[in,out] reader - wskaźnik na strukturę czytającą wiersze.
+ * @return true - jeśli udało się wczytać dane lub strumień się skończył.
+ * @return false - jeśli nie udało się alokować pamięci.
+ */
+static bool reader_fill(LineReader* reader) {
+    size_t pending = reader->end - reader->start;
+    memmove(reader->buffer, reader->buffer + reader->start, pending);
+    reader->start = 0;
+    reader->end = pending;
+    // Miejsce na znak '\0' kończący ostatni wiersz bez znaku nowej linii.
+    if (reader->end + 1 >= reader->capacity) {
+        char* resized = realloc(reader->buffer, reader->capacity * 2);
+        if (resized == NULL)
+            return false;
+        reader->buffer = resized;
+        reader->capacity *= 2;
+    }
+    size_t read = fread(reader->buffer + reader->end, 1,
+                        reader->capacity - reader->end - 1, reader->file);
+    reader->end += read;
+    if (read == 0)
+        reader->eof = true;
+    return true;
+}
+
+/**
+ * @brief Zwraca kolejny wiersz strumienia.
+ * Zamienia znak nowej linii kończący wiersz na znak '\0'. Wiersz pozostaje
+ * ważny do następnego wywołania.
+ * @param[in,out] reader - wskaźnik na strukturę czytającą wiersze;
+ * @param[out] failed - ustawiane na true, gdy nie udało się alokować pamięci.
+ * @return Wskaźnik na wiersz lub NULL, gdy strumień się skończył.
+ */
+static char * reader_next(LineReader* reader, bool* failed) {
+    for (;;) {
+        char* line = reader->buffer + reader->start;
+        char* newline = memchr(line, '\n', reader->end - reader->start);
+        if (newline != NULL) {
+            *newline = '\0';
+            reader->start = (size_t)(newline - reader->buffer) + 1;
+            return line;
+        }
+        if (reader->eof) {
+            if (reader->start == reader->end)
+                return NULL;
+            reader->buffer[reader->end] = '\0';
+            reader->start = reader->end;
+            return line;
+        }
+        if (!reader_fill(reader)) {
+            *failed = true;
+            return NULL;
+        }
+    }
+}
+
+/**
+ * @brief Dzieli wiersz na słowa w miejscu.
+ * @param[in,out] line - dzielony wiersz;
+ * @param[out] words - tablica na wskaźniki na @ref MAX_WORDS słów.
+ * @return Ilość słów lub @ref MAX_WORDS + 1, gdy wiersz zawiera ich więcej.
+ */
+static size_t split_words(char* line, char** words) {
+    size_t count = 0;
+    while (*line != '\0') {
+        if (*line == ' ' || *line == '\t' || *line == '\r') {
+            *line++ = '\0';
+            continue;
+        }
+        if (count == MAX_WORDS)
+            return MAX_WORDS + 1;
+        words[count++] = line;
+        while (*line != '\0' && *line != ' ' && *line != '\t' && *line != '\r')
+            line++;
+    }
+    return count;
+}
+
+/**
+ * @brief Wypisuje ciąg numerów w jednym wierszu i usuwa go.
+ * @param[in,out] out - wskaźnik na bufor wyjścia;
+ * @param[in] pnum - wskaźnik na ciąg numerów.
+ */
+static void print_numbers(OutputBuffer* out, PhoneNumbers* pnum) {
+    char const* number;
+    for (size_t idx = 0; (number = phnumGet(pnum, idx)) != NULL; idx++) {
+        if (idx > 0)
+            output_char(out, ' ');
+        output_write(out, number, strlen(number));
+    }
+    output_char(out, '\n');
+    phnumDelete(pnum);
+}
+
+/**
+ * @brief Wykonuje polecenie get.
+ * Wynik jest wyznaczany do bufora na stosie, a tylko dla bardzo długich
+ * numerów do ciągu numerów.
+ * @param[in,out] out - wskaźnik na bufor wyjścia;
+ * @param[in] pf - wskaźnik na strukturę przechowującą przekierowania;
+ * @param[in] num - napis reprezentujący numer.
+ * @return true - jeśli numer jest poprawny.
+ * @return false - w przeciwnym przypadku lub gdy nie udało się alokować pamięci.
+ */
+static bool execute_get(OutputBuffer* out, PhoneForward* pf, const char* num) {
+    char result[NUMBER_BUFFER_SIZE];
+    size_t length;
+    if (phfwdGetInto(pf, num, result, sizeof result, &length)) {
+        output_write(out, result, length);
+        output_char(out, '\n');
+        return true;
+    }
+    if (length == 0)
+        return false;
+    PhoneNumbers* pnum = phfwdGet(pf, num);
+    if (pnum == NULL)
+        return false;
+    print_numbers(out, pnum);
+    return true;
+}
+
+/**
+ * @brief Wykonuje pojedyncze polecenie.
+ * @param[in,out] out - wskaźnik na bufor wyjścia;
+ * @param[in,out] pf - wskaźnik na strukturę przechowującą przekierowania;
+ * @param[in,out] pfj - wskaźnik na dziennik zmian struktury @p pf lub NULL;
+ * @param[in] words - słowa polecenia;
+ * @param[in] count - ilość słów.
+ * @return true - jeśli polecenie zostało wykonane.
+ * @return false - jeśli polecenie jest niepoprawne, nie udało się alokować
+ * pamięci lub zapisać dziennika.
+ */
+static bool execute(OutputBuffer* out, PhoneForward* pf, PhoneForwardJournal* pfj,
+                    char** words, size_t count) {
+    if (count == 3 && strcmp(words[0], "add") == 0)
+        return pfj == NULL ? phfwdAdd(pf, words[1], words[2])
+                           : phfwdJournalAdd(pfj, words[1], words[2]);
+    if (count != 2)
+        return false;
+    if (strcmp(words[0], "get") == 0)
+        return execute_get(out, pf, words[1]);
+    if (strcmp(words[0], "remove") == 0) {
+        if (pfj != NULL)
+            return phfwdJournalRemove(pfj, words[1]);
+        return phfwdRemove(pf, words[1]);
+    }
+
+    PhoneNumbers* pnum;
+    if (strcmp(words[0], "reverse") == 0)
+        pnum = phfwdReverse(pf, words[1]);
+    else if (strcmp(words[0], "getreverse") == 0)
+        pnum = phfwdGetReverse(pf, words[1]);
+    else
+        return false;
+    if (pnum == NULL)
+        return false;
+    print_numbers(out, pnum);
+    return true;
+}
+
+/**
+ * @brief Wypisuje sposób użycia programu.
+ * @param[in] name - nazwa programu.
+ * @return Kod zakończenia programu.
+ */
+static int usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-l RULES_FILE] [-j JOURNAL_FILE] [COMMANDS_FILE]\n", name);
+    return 2;
+}
+
+/**
+ * @brief Wykonuje polecenia ze standardowego wejścia lub z pliku.
+ * @param[in] argc - ilość argumentów;
+ * @param[in] argv - argumenty programu.
+ * @return 0, jeśli wszystkie polecenia zostały wykonane, 1, jeśli któreś
+ * było niepoprawne, lub 2 w przypadku błędu argumentów, plików lub pamięci.
+ */
+int main(int argc, char* argv[]) {
+    const char* rules = NULL;
+    const char* commands = NULL;
+    const char* journal = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc && rules == NULL)
+            rules = argv[++i];
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc && journal == NULL)
+            journal = argv[++i];
+        else if (commands == NULL && argv[i][0] != '-')
+            commands = argv[i];
+        else
+            return usage(argv[0]);
+    }
+
+    FILE* input = commands == NULL ? stdin : fopen(commands, "rb");
+    if (input == NULL) {
+        fprintf(stderr, "%s: cannot open %s\n", argv[0], commands);
+        return 2;
+    }
+    PhoneForward* pf = phfwdNew();
+    static OutputBuffer out;
+    LineReader reader;
+    if (pf == NULL || !reader_init(&reader, input)) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 2;
+    }
+    if (rules != NULL && !phfwdLoadFile(pf, rules)) {
+        fprintf(stderr, "%s: cannot load %s\n", argv[0], rules);
+        return 2;
+    }
+    PhoneForwardJournal* pfj = NULL;
+    if (journal != NULL) {
+        char* checkpoint = malloc(strlen(journal) + sizeof(CHECKPOINT_SUFFIX));
+        if (checkpoint != NULL) {
+            strcpy(checkpoint, journal);
+            strcat(checkpoint, CHECKPOINT_SUFFIX);
+            pfj = phfwdJournalOpen(pf, checkpoint, journal, JOURNAL_GROUP,
+                                   JOURNAL_CHECKPOINT);
+        }
+        free(checkpoint);
+        if (pfj == NULL) {
+            fprintf(stderr, "%s: cannot open journal %s\n", argv[0], journal);
+            return 2;
+        }
+    }
+
+    int status = 0;
+    bool failed = false;
+    char* line;
+    char* words[MAX_WORDS];
+    for (size_t line_number = 1; (line = reader_next(&reader, &failed)) != NULL;
+         line_number++) {
+        size_t count = split_words(line, words);
+        if (count > 0 && !execute(&out, pf, pfj, words, count)) {
+            output_flush(&out);
+            fflush(stdout);
+            fprintf(stderr, "ERROR %zu\n", line_number);
+            status = 1;
+        }
+        if (phfwdJournalCheckpointDue(pfj) && !phfwdJournalCheckpoint(pfj)) {
+            fprintf(stderr, "%s: cannot write checkpoint for %s\n", argv[0], journal);
+            status = 2;
+        }
+    }
+    output_flush(&out);
+    if (!phfwdJournalClose(pfj)) {
+        fprintf(stderr, "%s: cannot write journal %s\n", argv[0], journal);
+        status = 2;
+    }
+    if (failed) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        status = 2;
+    }
+
+    free(reader.buffer);
+    if (input != stdin)
+        fclose(input);
+    phfwdDelete(pf);
+    return status;
+}
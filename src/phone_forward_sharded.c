@@ -0,0 +1,280 @@
+/** @file
+ * Implementacja kontenera przekierowań podzielonego na niezależne części.
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#define _POSIX_C_SOURCE 200809L ///< Udostępnienie blokad pthread_rwlock_t.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "digits.h"
+#include "phone_forward_sharded.h"
+
+#define SHARD_BASE 12       ///< Ilość cyfr wraz z dodatkowymi znakami.
+
+/**
+ * To jest struktura przechowująca jedną część przekierowań.
+ */
+struct Shard {
+    PhoneForward* pf;               ///< Przekierowania należące do części.
+    pthread_rwlock_t lock;          ///< Blokada odczytów i modyfikacji części.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct Shard Shard;
+
+/**
+ * To jest struktura przechowująca przekierowania podzielone na części.
+ * Część o numerze k przechowuje przekierowania prefiksów, których pierwsze
+ * @p digits cyfr zapisanych w systemie o podstawie @ref SHARD_BASE daje k.
+ */
+struct PhoneForwardSharded {
+    unsigned digits;                ///< Ilość cyfr wyznaczających część.
+    size_t count;                   ///< Ilość części.
+    Shard* shards;                  ///< Tablica części.
+};
+
+/**
+ * @brief Wyznacza części, do których należą numery o danym prefiksie.
+ * Prefiks o co najmniej @p digits cyfrach wyznacza jedną część. Krótszy
+ * prefiks wyznacza przedział kolejnych części, których cyfry zaczynają się od
+ * niego.
+ * @param[in] pfs - wskaźnik na strukturę;
+ * @param[in] num - napis lub NULL;
+ * @param[out] first - numer pierwszej części przedziału;
+ * @param[out] end - numer części następującej po ostatniej części przedziału.
+ * @return true - jeśli napis @p num reprezentuje numer.
+ * @return false - w przeciwnym przypadku.
+ */
+static bool shard_range(const PhoneForwardSharded* pfs, const char* num,
+                        size_t* first, size_t* end) {
+    uint8_t codes[PHFWD_SHARD_DIGITS_MAX];
+    size_t length = num == NULL ? 0 : digits_scan(num, codes, pfs->digits);
+    if (length == 0 || num[length] != '\0')
+        return false;
+
+    size_t key = 0, span = 1;
+    for (unsigned i = 0; i < pfs->digits; i++) {
+        key = key * SHARD_BASE + (i < length ? codes[i] : 0);
+        if (i >= length)
+            span *= SHARD_BASE;
+    }
+    *first = key;
+    *end = key + span;
+    return true;
+}
+
+/**
+ * @brief Blokuje przedział kolejnych części.
+ * Części są blokowane w rosnącej kolejności numerów, więc wątki blokujące
+ * nachodzące na siebie przedziały nie zakleszczają się.
+ * @param[in] pfs - wskaźnik na strukturę;
+ * @param[in] first - numer pierwszej części przedziału;
+ * @param[in] end - numer części następującej po ostatniej części przedziału;
+ * @param[in] write - czy części są blokowane do modyfikacji.
+ */
+static void shard_lock(const PhoneForwardSharded* pfs, size_t first, size_t end, bool write) {
+    for (size_t i = first; i < end; i++) {
+        if (write)
+            pthread_rwlock_wrlock(&pfs->shards[i].lock);
+        else
+            pthread_rwlock_rdlock(&pfs->shards[i].lock);
+    }
+}
+
+/**
+ * @brief Odblokowuje przedział kolejnych części.
+ * @param[in] pfs - wskaźnik na strukturę;
+ * @param[in] first - numer pierwszej części przedziału;
+ * @param[in] end - numer części następującej po ostatniej części przedziału.
+ */
+static void shard_unlock(const PhoneForwardSharded* pfs, size_t first, size_t end) {
+    for (size_t i = first; i < end; i++)
+        pthread_rwlock_unlock(&pfs->shards[i].lock);
+}
+
+/** @brief Tworzy nową strukturę podzieloną na części.
+ * Tworzy strukturę złożoną z 12^@p digits niezależnych struktur
+ * @ref PhoneForward, z których każda ma własną blokadę. Przekierowanie trafia
+ * do części wyznaczonej przez pierwsze @p digits cyfr prefiksu @p num1, a
+ * przekierowanie krótszego prefiksu jest powielane we wszystkich częściach,
+ * których cyfry zaczynają się od tego prefiksu. Modyfikacje różnych części
+ * mogą być wykonywane jednocześnie przez różne wątki.
+ * @param[in] digits – ilość cyfr wyznaczających część, od 1 do
+ *                     @ref PHFWD_SHARD_DIGITS_MAX.
+ * @return Wskaźnik na utworzoną strukturę lub NULL, gdy nie udało się
+ *         alokować pamięci bądź @p digits ma niepoprawną wartość.
+ */
+PhoneForwardSharded * phfwdShardedNew(unsigned digits) {
+    if (digits == 0 || digits > PHFWD_SHARD_DIGITS_MAX)
+        return NULL;
+    PhoneForwardSharded* pfs = malloc(sizeof(PhoneForwardSharded));
+    if (pfs == NULL)
+        return NULL;
+    pfs->digits = digits;
+    pfs->count = 1;
+    for (unsigned i = 0; i < digits; i++)
+        pfs->count *= SHARD_BASE;
+    pfs->shards = malloc(sizeof(Shard) * pfs->count);
+    if (pfs->shards == NULL) {
+        free(pfs);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < pfs->count; i++) {
+        Shard* shard = &pfs->shards[i];
+        shard->pf = phfwdNew();
+        if (shard->pf == NULL || pthread_rwlock_init(&shard->lock, NULL) != 0) {
+            phfwdDelete(shard->pf);
+            // Usunięcie tylko części utworzonych w całości.
+            pfs->count = i;
+            phfwdShardedDelete(pfs);
+            return NULL;
+        }
+    }
+    return pfs;
+}
+
+/** @brief Usuwa strukturę.
+ * Usuwa strukturę wskazywaną przez @p pfs wraz ze wszystkimi częściami. Nic
+ * nie robi, jeśli wskaźnik ten ma wartość NULL. Struktura nie może być w tym
+ * czasie używana przez inne wątki.
+ * @param[in] pfs – wskaźnik na usuwaną strukturę.
+ */
+void phfwdShardedDelete(PhoneForwardSharded *pfs) {
+    if (pfs == NULL)
+        return;
+    for (size_t i = 0; i < pfs->count; i++) {
+        phfwdDelete(pfs->shards[i].pf);
+        pthread_rwlock_destroy(&pfs->shards[i].lock);
+    }
+    free(pfs->shards);
+    free(pfs);
+}
+
+/** @brief Dodaje przekierowanie.
+ * Działa tak jak funkcja @ref phfwdAdd. Blokuje tylko części, do których
+ * trafia przekierowanie, wszystkie na czas całej zmiany, więc współbieżne
+ * zmiany tego samego prefiksu dają we wszystkich częściach ten sam wynik.
+ * @param[in,out] pfs – wskaźnik na strukturę przechowującą przekierowania
+ *                      numerów;
+ * @param[in] num1    – wskaźnik na napis reprezentujący prefiks numerów
+ *                      przekierowywanych;
+ * @param[in] num2    – wskaźnik na napis reprezentujący prefiks numerów,
+ *                      na które jest wykonywane przekierowanie.
+ * @return Wartość @p true, jeśli przekierowanie zostało dodane.
+ *         Wartość @p false, jeśli wystąpił błąd, np. podany napis nie
+ *         reprezentuje numeru, oba podane numery są identyczne lub nie udało
+ *         się alokować pamięci. Jeśli zabrakło pamięci przy powielaniu
+ *         przekierowania, może ono zostać dodane tylko do części struktury.
+ */
+bool phfwdShardedAdd(PhoneForwardSharded *pfs, char const *num1, char const *num2) {
+    size_t first, end;
+    if (pfs == NULL || !shard_range(pfs, num1, &first, &end))
+        return false;
+
+    // Wszystkie części są zablokowane przez całą zmianę, więc współbieżne
+    // zmiany tego samego prefiksu są wykonywane we wszystkich częściach w tej
+    // samej kolejności. Błędne parametry są wykrywane już w pierwszej części,
+    // przed zmianami.
+    shard_lock(pfs, first, end, true);
+    bool added = true;
+    for (size_t i = first; i < end && added; i++)
+        added = phfwdAdd(pfs->shards[i].pf, num1, num2);
+    shard_unlock(pfs, first, end);
+    return added;
+}
+
+/** @brief Usuwa przekierowania.
+ * Działa tak jak funkcja @ref phfwdRemove. Blokuje tylko części, które mogą
+ * zawierać usuwane przekierowania, wszystkie na czas całej zmiany.
+ * @param[in,out] pfs – wskaźnik na strukturę przechowującą przekierowania
+ *                      numerów;
+ * @param[in] num     – wskaźnik na napis reprezentujący prefiks numerów.
+ */
+void phfwdShardedRemove(PhoneForwardSharded *pfs, char const *num) {
+    size_t first, end;
+    if (pfs == NULL || !shard_range(pfs, num, &first, &end))
+        return;
+
+    shard_lock(pfs, first, end, true);
+    for (size_t i = first; i < end; i++)
+        phfwdRemove(pfs->shards[i].pf, num);
+    shard_unlock(pfs, first, end);
+}
+
+/** @brief Wyznacza przekierowanie numeru.
+ * Działa tak jak funkcja @ref phfwdGet. Odczytuje tylko jedną część struktury.
+ * @param[in] pfs – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci bądź @p pfs ma wartość NULL.
+ */
+PhoneNumbers * phfwdShardedGet(PhoneForwardSharded const *pfs, char const *num) {
+    if (pfs == NULL)
+        return NULL;
+    size_t first = 0, end;
+    // Napis niebędący numerem daje pusty wynik w dowolnej części. Numer
+    // krótszy od klucza może przekierować tylko prefiks powielony w każdej
+    // części swojego przedziału, więc wystarcza pierwsza z nich.
+    shard_range(pfs, num, &first, &end);
+
+    Shard* shard = &pfs->shards[first];
+    pthread_rwlock_rdlock(&shard->lock);
+    PhoneNumbers* result = phfwdGet(shard->pf, num);
+    pthread_rwlock_unlock(&shard->lock);
+    return result;
+}
+
+/** @brief Wyznacza przekierowania na dany numer.
+ * Działa tak jak funkcja @ref phfwdReverse. Przekierowywany prefiks może
+ * należeć do dowolnej części, więc wyznacza posortowane wyniki wszystkich
+ * niepustych części i scala je, pomijając powtórzenia. Części są odczytywane
+ * pod wspólną blokadą, więc wynik nie obejmuje zmiany wykonanej tylko w
+ * części z nich.
+ * @param[in] pfs – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci bądź @p pfs ma wartość NULL.
+ */
+PhoneNumbers * phfwdShardedReverse(PhoneForwardSharded const *pfs, char const *num) {
+    if (pfs == NULL)
+        return NULL;
+    size_t first, end;
+    if (!shard_range(pfs, num, &first, &end))
+        return phfwdReverse(pfs->shards[0].pf, num);
+
+    PhoneNumbers** lists = malloc(sizeof(PhoneNumbers*) * pfs->count);
+    if (lists == NULL)
+        return NULL;
+    size_t count = 0;
+    bool failed = false;
+    // Wyniki części są wyznaczane pod wspólną blokadą, więc nie obejmują
+    // zmiany wykonanej tylko w części z nich.
+    shard_lock(pfs, 0, pfs->count, false);
+    for (size_t i = 0; i < pfs->count && !failed; i++) {
+        Shard* shard = &pfs->shards[i];
+        PhoneForwardStats stats;
+        // Pusta część daje tylko sam numer, więc wystarcza jedna taka część.
+        phfwdStats(shard->pf, &stats);
+        if (stats.rules > 0 || (count == 0 && i + 1 == pfs->count)) {
+            lists[count] = phfwdReverse(shard->pf, num);
+            failed = lists[count++] == NULL;
+        }
+    }
+    shard_unlock(pfs, 0, pfs->count);
+
+    PhoneNumbers* result = failed ? NULL
+                           : phnumMerge((PhoneNumbers const * const *)lists, count);
+    for (size_t i = 0; i < count; i++)
+        phnumDelete(lists[i]);
+    free(lists);
+    return result;
+}
@@ -0,0 +1,98 @@
+/** @file
+ * Interfejs kontenera przekierowań podzielonego na niezależne części.
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef __PHONE_FORWARD_SHARDED_H__
+#define __PHONE_FORWARD_SHARDED_H__
+
+#include "phone_forward.h"
+
+#define PHFWD_SHARD_DIGITS_MAX 2 ///< Największa ilość cyfr wyznaczających część.
+
+/**
+ * To jest struktura przechowująca przekierowania numerów telefonów podzielone
+ * na części według początkowych cyfr prefiksu przekierowywanego.
+ */
+struct PhoneForwardSharded;
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct PhoneForwardSharded PhoneForwardSharded;
+
+/** @brief Tworzy nową strukturę podzieloną na części.
+ * Tworzy strukturę złożoną z 12^@p digits niezależnych struktur
+ * @ref PhoneForward, z których każda ma własną blokadę. Przekierowanie trafia
+ * do części wyznaczonej przez pierwsze @p digits cyfr prefiksu @p num1, a
+ * przekierowanie krótszego prefiksu jest powielane we wszystkich częściach,
+ * których cyfry zaczynają się od tego prefiksu. Modyfikacje różnych części
+ * mogą być wykonywane jednocześnie przez różne wątki.
+ * @param[in] digits – ilość cyfr wyznaczających część, od 1 do
+ *                     @ref PHFWD_SHARD_DIGITS_MAX.
+ * @return Wskaźnik na utworzoną strukturę lub NULL, gdy nie udało się
+ *         alokować pamięci bądź @p digits ma niepoprawną wartość.
+ */
+PhoneForwardSharded * phfwdShardedNew(unsigned digits);
+
+/** @brief Usuwa strukturę.
+ * Usuwa strukturę wskazywaną przez @p pfs wraz ze wszystkimi częściami. Nic
+ * nie robi, jeśli wskaźnik ten ma wartość NULL. Struktura nie może być w tym
+ * czasie używana przez inne wątki.
+ * @param[in] pfs – wskaźnik na usuwaną strukturę.
+ */
+void phfwdShardedDelete(PhoneForwardSharded *pfs);
+
+/** @brief Dodaje przekierowanie.
+ * Działa tak jak funkcja @ref phfwdAdd. Blokuje tylko części, do których
+ * trafia przekierowanie, wszystkie na czas całej zmiany, więc współbieżne
+ * zmiany tego samego prefiksu dają we wszystkich częściach ten sam wynik.
+ * @param[in,out] pfs – wskaźnik na strukturę przechowującą przekierowania
+ *                      numerów;
+ * @param[in] num1    – wskaźnik na napis reprezentujący prefiks numerów
+ *                      przekierowywanych;
+ * @param[in] num2    – wskaźnik na napis reprezentujący prefiks numerów,
+ *                      na które jest wykonywane przekierowanie.
+ * @return Wartość @p true, jeśli przekierowanie zostało dodane.
+ *         Wartość @p false, jeśli wystąpił błąd, np. podany napis nie
+ *         reprezentuje numeru, oba podane numery są identyczne lub nie udało
+ *         się alokować pamięci. Jeśli zabrakło pamięci przy powielaniu
+ *         przekierowania, może ono zostać dodane tylko do części struktury.
+ */
+bool phfwdShardedAdd(PhoneForwardSharded *pfs, char const *num1, char const *num2);
+
+/** @brief Usuwa przekierowania.
+ * Działa tak jak funkcja @ref phfwdRemove. Blokuje tylko części, które mogą
+ * zawierać usuwane przekierowania, wszystkie na czas całej zmiany.
+ * @param[in,out] pfs – wskaźnik na strukturę przechowującą przekierowania
+ *                      numerów;
+ * @param[in] num     – wskaźnik na napis reprezentujący prefiks numerów.
+ */
+void phfwdShardedRemove(PhoneForwardSharded *pfs, char const *num);
+
+/** @brief Wyznacza przekierowanie numeru.
+ * Działa tak jak funkcja @ref phfwdGet. Odczytuje tylko jedną część struktury.
+ * @param[in] pfs – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci bądź @p pfs ma wartość NULL.
+ */
+PhoneNumbers * phfwdShardedGet(PhoneForwardSharded const *pfs, char const *num);
+
+/** @brief Wyznacza przekierowania na dany numer.
+ * Działa tak jak funkcja @ref phfwdReverse. Przekierowywany prefiks może
+ * należeć do dowolnej części, więc wyznacza posortowane wyniki wszystkich
+ * niepustych części i scala je, pomijając powtórzenia. Części są odczytywane
+ * pod wspólną blokadą, więc wynik nie obejmuje zmiany wykonanej tylko w
+ * części z nich.
+ * @param[in] pfs – wskaźnik na strukturę przechowującą przekierowania numerów;
+ * @param[in] num – wskaźnik na napis reprezentujący numer.
+ * @return Wskaźnik na strukturę przechowującą ciąg numerów lub NULL, gdy nie
+ *         udało się alokować pamięci bądź @p pfs ma wartość NULL.
+ */
+PhoneNumbers * phfwdShardedReverse(PhoneForwardSharded const *pfs, char const *num);
+
+#endif /* __PHONE_FORWARD_SHARDED_H__ */
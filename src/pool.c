@@ -0,0 +1,189 @@
+/** @file
+ * Implementacja puli pamięci dla węzłów i napisów struktury przekierowań.
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+/**
+ * Zaokrągla rozmiar w górę do wielokrotności @ref POOL_ALIGNMENT.
+ */
+#define ROUND_UP(size) (((size) + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1))
+
+/**
+ * To jest nagłówek płata pamięci, z którego wydzielane są małe bloki.
+ */
+struct PoolSlab {
+    struct PoolSlab* next;          ///< Następny płat na liście.
+};
+
+/**
+ * To jest nagłówek dużego bloku alokowanego poza płatami.
+ */
+struct PoolLarge {
+    struct PoolLarge* prev;         ///< Poprzedni duży blok na liście.
+    struct PoolLarge* next;         ///< Następny duży blok na liście.
+};
+
+#define SLAB_HEADER ROUND_UP(sizeof(struct PoolSlab))   ///< Rozmiar nagłówka płata.
+#define LARGE_HEADER ROUND_UP(sizeof(struct PoolLarge)) ///< Rozmiar nagłówka dużego bloku.
+
+/**
+ * @brief Wyznacza klasę rozmiaru bloku.
+ * Wyznacza numer klasy rozmiaru dla bloku o rozmiarze @p size, przy założeniu,
+ * że nie przekracza on @ref POOL_MAX_SMALL.
+ * @param[in] size - rozmiar bloku.
+ * @return Numer klasy rozmiaru.
+ */
+static size_t size_class(size_t size) {
+    return size == 0 ? 0 : (size - 1) / POOL_ALIGNMENT;
+}
+
+/** @brief Inicjalizuje pustą pulę.
+ * Inicjalizuje pulę niezawierającą żadnych bloków. Nie alokuje pamięci.
+ * @param[out] pool – wskaźnik na inicjalizowaną pulę.
+ */
+void pool_init(Pool *pool) {
+    pool->slabs = NULL;
+    pool->bump = NULL;
+    pool->bump_end = NULL;
+    for (size_t i = 0; i < POOL_CLASSES; i++)
+        pool->free_lists[i] = NULL;
+    pool->large = NULL;
+    pool->reserved = 0;
+}
+
+/**
+ * @brief Alokuje duży blok pamięci.
+ * Alokuje blok poza płatami i dołącza go do listy dużych bloków puli.
+ * @param[in,out] pool - wskaźnik na pulę;
+ * @param[in] size - rozmiar bloku.
+ * @return Wskaźnik na blok lub NULL, gdy nie udało się alokować pamięci.
+ */
+static void * pool_alloc_large(Pool *pool, size_t size) {
+    struct PoolLarge* block = malloc(LARGE_HEADER + size);
+    if (block == NULL)
+        return NULL;
+
+    block->prev = NULL;
+    block->next = pool->large;
+    if (pool->large != NULL)
+        pool->large->prev = block;
+    pool->large = block;
+    pool->reserved += LARGE_HEADER + size;
+    return (char*)block + LARGE_HEADER;
+}
+
+/** @brief Alokuje blok pamięci z puli.
+ * Alokuje blok co najmniej @p size bajtów wyrównany do @ref POOL_ALIGNMENT.
+ * Zawartość bloku jest nieokreślona.
+ * @param[in,out] pool – wskaźnik na pulę;
+ * @param[in] size     – rozmiar bloku w bajtach.
+ * @return Wskaźnik na blok lub NULL, gdy nie udało się alokować pamięci.
+ */
+void * pool_alloc(Pool *pool, size_t size) {
+    if (size > POOL_MAX_SMALL)
+        return pool_alloc_large(pool, size);
+
+    size_t class = size_class(size);
+    void* block = pool->free_lists[class];
+    if (block != NULL) {
+        pool->free_lists[class] = *(void**)block;
+        return block;
+    }
+
+    size_t rounded = (class + 1) * POOL_ALIGNMENT;
+    if (pool->bump == NULL || (size_t)(pool->bump_end - pool->bump) < rounded) {
+        struct PoolSlab* slab = malloc(POOL_SLAB_SIZE);
+        if (slab == NULL)
+            return NULL;
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->reserved += POOL_SLAB_SIZE;
+        pool->bump = (char*)slab + SLAB_HEADER;
+        pool->bump_end = (char*)slab + POOL_SLAB_SIZE;
+    }
+    block = pool->bump;
+    pool->bump += rounded;
+    return block;
+}
+
+/** @brief Zwraca blok pamięci do puli.
+ * Zwraca do puli blok uprzednio zaalokowany przez @ref pool_alloc z tym samym
+ * rozmiarem @p size. Nic nie robi, jeśli wskaźnik ma wartość NULL.
+ * @param[in,out] pool – wskaźnik na pulę;
+ * @param[in] ptr      – wskaźnik na zwalniany blok;
+ * @param[in] size     – rozmiar podany przy alokacji bloku.
+ */
+void pool_free(Pool *pool, void *ptr, size_t size) {
+    if (ptr == NULL)
+        return;
+
+    if (size > POOL_MAX_SMALL) {
+        struct PoolLarge* block = (struct PoolLarge*)((char*)ptr - LARGE_HEADER);
+        if (block->prev != NULL)
+            block->prev->next = block->next;
+        else
+            pool->large = block->next;
+        if (block->next != NULL)
+            block->next->prev = block->prev;
+        pool->reserved -= LARGE_HEADER + size;
+        free(block);
+        return;
+    }
+
+    size_t class = size_class(size);
+    *(void**)ptr = pool->free_lists[class];
+    pool->free_lists[class] = ptr;
+}
+
+/** @brief Zmienia rozmiar bloku pamięci z puli.
+ * Działa analogicznie do funkcji bibliotecznej realloc. W przypadku błędu
+ * blok @p ptr pozostaje nienaruszony.
+ * @param[in,out] pool – wskaźnik na pulę;
+ * @param[in] ptr      – wskaźnik na blok lub NULL;
+ * @param[in] old_size – rozmiar podany przy alokacji bloku;
+ * @param[in] new_size – nowy rozmiar bloku.
+ * @return Wskaźnik na blok o nowym rozmiarze lub NULL, gdy nie udało się
+ *         alokować pamięci.
+ */
+void * pool_realloc(Pool *pool, void *ptr, size_t old_size, size_t new_size) {
+    if (ptr == NULL)
+        return pool_alloc(pool, new_size);
+    // Blok tej samej klasy rozmiaru nie wymaga przenoszenia.
+    if (old_size <= POOL_MAX_SMALL && new_size <= POOL_MAX_SMALL
+        && size_class(old_size) == size_class(new_size))
+        return ptr;
+
+    void* result = pool_alloc(pool, new_size);
+    if (result == NULL)
+        return NULL;
+    memcpy(result, ptr, old_size < new_size ? old_size : new_size);
+    pool_free(pool, ptr, old_size);
+    return result;
+}
+
+/** @brief Zwalnia całą pamięć puli.
+ * Zwalnia wszystkie płaty i duże bloki puli w czasie proporcjonalnym do ich
+ * ilości, a nie do ilości zaalokowanych bloków. Po wywołaniu pula jest pusta
+ * i może być używana ponownie.
+ * @param[in,out] pool – wskaźnik na pulę.
+ */
+void pool_destroy(Pool *pool) {
+    while (pool->slabs != NULL) {
+        struct PoolSlab* next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+    while (pool->large != NULL) {
+        struct PoolLarge* next = pool->large->next;
+        free(pool->large);
+        pool->large = next;
+    }
+    pool_init(pool);
+}
@@ -0,0 +1,85 @@
+/** @file
+ * Interfejs puli pamięci dla węzłów i napisów struktury przekierowań.
+ *
+ * @author Adam Wojciechowski <a.wojciecho2@students.mimuw.edu.pl>
+ * @copyright Uniwersytet Warszawski
+ * @date 2022
+ */
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stddef.h>
+
+#define POOL_ALIGNMENT 16           ///< Wyrównanie i ziarnistość bloków puli.
+#define POOL_CLASSES 16             ///< Ilość klas rozmiarów małych bloków.
+#define POOL_MAX_SMALL (POOL_ALIGNMENT * POOL_CLASSES)
+///< Największy rozmiar bloku obsługiwany przez klasy rozmiarów.
+#define POOL_SLAB_SIZE (64 * 1024)  ///< Rozmiar pojedynczego płata pamięci.
+
+/**
+ * To jest struktura przechowująca pulę pamięci.
+ * Małe bloki są wydzielane kolejno z dużych płatów pamięci, a zwolnione bloki
+ * trafiają na listy wolnych bloków swojej klasy rozmiaru i są ponownie
+ * wykorzystywane. Duże bloki są alokowane osobno, ale pula pamięta je na
+ * liście, więc cała pamięć jest zwalniana jednym wywołaniem @ref pool_destroy.
+ */
+struct Pool {
+    struct PoolSlab* slabs;             ///< Lista płatów pamięci.
+    char* bump;                         ///< Początek wolnej części bieżącego płata.
+    char* bump_end;                     ///< Koniec bieżącego płata.
+    void* free_lists[POOL_CLASSES];     ///< Listy wolnych bloków kolejnych klas.
+    struct PoolLarge* large;            ///< Lista dużych bloków.
+    size_t reserved;                    ///< Łączny rozmiar płatów i dużych bloków.
+};
+
+/**
+ * Pozbycie się konieczności używania słowa kluczowego "struct".
+ */
+typedef struct Pool Pool;
+
+/** @brief Inicjalizuje pustą pulę.
+ * Inicjalizuje pulę niezawierającą żadnych bloków. Nie alokuje pamięci.
+ * @param[out] pool – wskaźnik na inicjalizowaną pulę.
+ */
+void pool_init(Pool *pool);
+
+/** @brief Alokuje blok pamięci z puli.
+ * Alokuje blok co najmniej @p size bajtów wyrównany do @ref POOL_ALIGNMENT.
+ * Zawartość bloku jest nieokreślona.
+ * @param[in,out] pool – wskaźnik na pulę;
+ * @param[in] size     – rozmiar bloku w bajtach.
+ * @return Wskaźnik na blok lub NULL, gdy nie udało się alokować pamięci.
+ */
+void * pool_alloc(Pool *pool, size_t size);
+
+/** @brief Zwraca blok pamięci do puli.
+ * Zwraca do puli blok uprzednio zaalokowany przez @ref pool_alloc z tym samym
+ * rozmiarem @p size. Nic nie robi, jeśli wskaźnik ma wartość NULL.
+ * @param[in,out] pool – wskaźnik na pulę;
+ * @param[in] ptr      – wskaźnik na zwalniany blok;
+ * @param[in] size     – rozmiar podany przy alokacji bloku.
+ */
+void pool_free(Pool *pool, void *ptr, size_t size);
+
+/** @brief Zmienia rozmiar bloku pamięci z puli.
+ * Działa analogicznie do funkcji bibliotecznej realloc. W przypadku błędu
+ * blok @p ptr pozostaje nienaruszony.
+ * @param[in,out] pool – wskaźnik na pulę;
+ * @param[in] ptr      – wskaźnik na blok lub NULL;
+ * @param[in] old_size – rozmiar podany przy alokacji bloku;
+ * @param[in] new_size – nowy rozmiar bloku.
+ * @return Wskaźnik na blok o nowym rozmiarze lub NULL, gdy nie udało się
+ *         alokować pamięci.
+ */
+void * pool_realloc(Pool *pool, void *ptr, size_t old_size, size_t new_size);
+
+/** @brief Zwalnia całą pamięć puli.
+ * Zwalnia wszystkie płaty i duże bloki puli w czasie proporcjonalnym do ich
+ * ilości, a nie do ilości zaalokowanych bloków. Po wywołaniu pula jest pusta
+ * i może być używana ponownie.
+ * @param[in,out] pool – wskaźnik na pulę.
+ */
+void pool_destroy(Pool *pool);
+
+#endif /* __POOL_H__ */